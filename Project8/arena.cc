@@ -0,0 +1,63 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+CCompileContext compile_context;
+long CArena::mTotalAllocs = 0;
+
+/******************************************
+ * BEGIN CArena
+ *****************************************/
+
+// Every allocation is rounded up to this, which suits any type the compiler stores.
+static const size_t ALIGNMENT = alignof(std::max_align_t);
+
+void CArena::NewChunk(size_t min_size)
+{
+  size_t size = (min_size > CHUNK_SIZE) ? min_size : CHUNK_SIZE;
+  // Through operator new (not malloc) so that -time-report sees the chunks as heap use.
+  char * chunk = (char *) ::operator new(size, std::nothrow);
+  if (chunk == NULL) {
+    std::cerr << "INTERNAL ERROR: Out of memory." << std::endl;
+    exit(1);
+  }
+  mChunks.push_back(chunk);
+  mNext = chunk;
+  mEnd = chunk + size;
+}
+
+void * CArena::Allocate(size_t size)
+{
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  if (mNext == NULL || (size_t) (mEnd - mNext) < size) NewChunk(size);
+  void * mem = mNext;
+  mNext += size;
+  mNumAllocs++;
+  mTotalAllocs++;
+  mBytesUsed += size;
+  return mem;
+}
+
+char * CArena::StrDup(const char * str)
+{
+  size_t length = strlen(str) + 1;
+  char * copy = (char *) Allocate(length);
+  memcpy(copy, str, length);
+  return copy;
+}
+
+void CArena::Release()
+{
+  for (int i = (int) mCleanups.size() - 1; i >= 0; i--) {
+    mCleanups[i].mDestroy(mCleanups[i].mObject);
+  }
+  std::vector<Cleanup>().swap(mCleanups);
+  for (int i = 0; i < (int) mChunks.size(); i++) ::operator delete(mChunks[i]);
+  mChunks.clear();
+  mNext = mEnd = NULL;
+  mNumAllocs = 0;
+  mBytesUsed = 0;
+}
@@ -0,0 +1,88 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The classes in this file manage the memory used while compiling a program.
+//
+//  CArena is a bump-pointer allocator.  It hands out memory from large chunks and frees all of
+//  it at once in Release(); nothing allocated from it is ever freed on its own.  Objects with
+//  non-trivial destructors register themselves with OnRelease() so that Release() can run
+//  those destructors (in reverse order of registration) before the chunks are dropped.
+//
+//  CCompileContext owns one arena per phase of the compiler:
+//    * The parse arena holds the AST, the symbol table entries and the lexemes from the
+//      scanner.  It is released once the IC has been generated.
+//    * The IC arena holds the ICEntries.  It is released once the output has been written.
+//  Classes that live in an arena (ASTNode, CTableEntry, CFunctionEntry, ICEntry) get their
+//  memory from it through a class-level operator new, so the code creating them is unchanged.
+//  Their operator delete does nothing, and they must never be deleted one at a time: the
+//  arena already runs their destructors when it is released.
+//
+
+#include <cstddef>
+#include <vector>
+
+class CArena {
+private:
+  struct Cleanup {
+    void (*mDestroy)(void *);
+    void * mObject;
+  };
+
+  std::vector<char *> mChunks;
+  char * mNext;                 // Next free byte in the current chunk.
+  char * mEnd;                  // One past the last byte of the current chunk.
+  std::vector<Cleanup> mCleanups;
+  int mNumAllocs;               // Allocations since the last Release().
+  size_t mBytesUsed;            // Bytes handed out since the last Release().
+  static long mTotalAllocs;     // Allocations from every arena, ever (for -time-report).
+
+  static const size_t CHUNK_SIZE = 64 * 1024;
+
+  template <class T> static void Destroy(void * obj) { static_cast<T *>(obj)->~T(); }
+  void NewChunk(size_t min_size);
+
+public:
+  CArena() : mNext(NULL), mEnd(NULL), mNumAllocs(0), mBytesUsed(0) { ; }
+  ~CArena() { Release(); }
+
+  // Get 'size' bytes, aligned for any type.
+  void * Allocate(size_t size);
+  // Copy a C string into the arena.
+  char * StrDup(const char * str);
+  // Run obj's destructor when the arena is released.
+  template <class T> void OnRelease(T * obj) {
+    Cleanup cleanup = { &Destroy<T>, obj };
+    mCleanups.push_back(cleanup);
+  }
+
+  // Destroy every registered object and give all chunks back.
+  void Release();
+
+  int GetNumAllocs() const { return mNumAllocs; }
+  size_t GetBytesUsed() const { return mBytesUsed; }
+  static long GetTotalAllocs() { return mTotalAllocs; }
+};
+
+class CCompileContext {
+private:
+  CArena mParseArena;   // AST, symbol table entries and lexemes.
+  CArena mICArena;      // Intermediate code.
+
+public:
+  CCompileContext() { ; }
+  ~CCompileContext() { ; }
+
+  CArena & GetParseArena() { return mParseArena; }
+  CArena & GetICArena() { return mICArena; }
+
+  // Called once nothing will look at the AST or symbol table entries again.
+  void EndParse() { mParseArena.Release(); }
+  // Called once the IC has been written out.
+  void EndIC() { mICArena.Release(); }
+};
+
+extern CCompileContext compile_context;
+
+#endif
@@ -12,6 +12,8 @@ extern void yyerror2(std::string err_string, int orig_line);
 /////////////////////
 //  ASTNode
 
+int ASTNode::mNumNodes = 0;
+
 void ASTNode::TransferChildren(ASTNode * target) //grab children
 {
   // Grab all of the mChildren from the target
@@ -19,10 +21,18 @@ void ASTNode::TransferChildren(ASTNode * target) //grab children
     AddChild(target->GetChild(i));
   }
 
-  // Clear the mChildren in from_node so they are not recursively deleted when it is.
+  // Clear the mChildren in from_node so they are only compiled once.
   target->mChildren.resize(0);
 }
 
+void ASTNode::CompileBranchIC(CSymbolTable & table, ICArray & ica, const std::string & label,
+                              bool when_true)
+{
+  CTableEntry * in = CompileTubeIC(table, ica);
+  ica.Add(when_true ? Opcode::JUMP_IF_N0 : Opcode::JUMP_IF_0, in->GetVarID(), label);
+  if (in->GetTemp() == true) table.RemoveEntry( in );
+}
+
 
 /////////////////////
 //  ASTNodeBlock
@@ -120,8 +130,7 @@ ASTNodeLiteral::ASTNodeLiteral(int in_type, std::string in_lex)
 {
   if(mType == Type::CHAR_ARRAY)
   {
-    char *lex = new char[in_lex.length() + 1];
-    strcpy(lex, in_lex.c_str());
+    char *lex = compile_context.GetParseArena().StrDup(in_lex.c_str());
     lex = translate(lex);
     mLexeme = std::string(lex);
   }
@@ -138,7 +147,7 @@ CTableEntry * ASTNodeLiteral::CompileTubeIC(CSymbolTable & table, ICArray & ica)
 {
   CTableEntry * outVar = table.AddTempEntry(mType);
   if (mType == Type::INT || mType == Type::CHAR) {
-    ica.Add("val_copy", mLexeme, outVar->GetVarID());
+    ica.Add(Opcode::VAL_COPY, mLexeme, outVar->GetVarID());
     if (mType == Type::INT) {
       int intLex = atoi(mLexeme.c_str());
       outVar->SetSize(intLex);
@@ -152,8 +161,8 @@ CTableEntry * ASTNodeLiteral::CompileTubeIC(CSymbolTable & table, ICArray & ica)
     std::stringstream ss;
     ss << mLexeme.size(); //convert the size to a string
     CTableEntry * sizeVar = table.AddTempEntry(Type::INT);
-    ica.Add("val_copy", ss.str(), sizeVar->GetVarID());
-    ica.Add("ar_set_size", outVar->GetVarID(), ss.str());
+    ica.Add(Opcode::VAL_COPY, ss.str(), sizeVar->GetVarID());
+    ica.Add(Opcode::AR_SET_SIZE, outVar->GetVarID(), ss.str());
     outVar->SetSize(mLexeme.size());
     outVar->SetContent(mLexeme);
     for(int i=0; i < mLexeme.size(); i++ ) {
@@ -186,9 +195,9 @@ CTableEntry * ASTNodeLiteral::CompileTubeIC(CSymbolTable & table, ICArray & ica)
           break;
       }
       //CTableEntry * posVar = table.AddTempEntry(Type::INT);
-      //ica.Add("val_copy", ss.str(), posVar->GetVarID());
-      //ica.Add("ar_set_idx", outVar->GetVarID(), posVar->GetVarID(), s.str());
-      ica.Add("ar_set_idx", outVar->GetVarID(), ss.str(), s.str());
+      //ica.Add(Opcode::VAL_COPY, ss.str(), posVar->GetVarID());
+      //ica.Add(Opcode::AR_SET_IDX, outVar->GetVarID(), posVar->GetVarID(), s.str());
+      ica.Add(Opcode::AR_SET_IDX, outVar->GetVarID(), ss.str(), s.str());
     }
   }
   else {
@@ -230,17 +239,17 @@ CTableEntry * ASTNodeAssign::CompileTubeIC(CSymbolTable & table,
       arrayID << left->GetArray()->GetVarID();
       rightID << right->GetVarID();
       index << left->GetIndex();
-      //ica.Add("ar_copy", right->GetVarID(), left->GetVarID());
-      ica.Add("ar_set_idx", left->GetArray()->GetVarID(), left->GetIndex()->GetVarID(), right->GetVarID());
+      //ica.Add(Opcode::AR_COPY, right->GetVarID(), left->GetVarID());
+      ica.Add(Opcode::AR_SET_IDX, left->GetArray()->GetVarID(), left->GetIndex()->GetVarID(), right->GetVarID());
       left->SetSize(right->GetSize());
     }
     else {
-      ica.Add("val_copy", right->GetVarID(), left->GetVarID());
+      ica.Add(Opcode::VAL_COPY, right->GetVarID(), left->GetVarID());
       left->SetSize(right->GetSize());
     }
   }
   else if (mType == Type::INT_ARRAY || mType == Type::CHAR_ARRAY) {
-    ica.Add("ar_copy", right->GetVarID(), left->GetVarID());
+    ica.Add(Opcode::AR_COPY, right->GetVarID(), left->GetVarID());
     left->SetSize(right->GetSize());
     left->SetContent(right->GetContent());
   }
@@ -280,12 +289,12 @@ CTableEntry * ASTNodeMath1::CompileTubeIC(CSymbolTable & table, ICArray & ica)
 
   switch (mMathOp) {
   case '-':
-    ica.Add("mult", in->GetVarID(), "-1", outVar->GetVarID());
+    ica.Add(Opcode::MULT, in->GetVarID(), "-1", outVar->GetVarID());
     outVar->SetNegative(true);
     outVar->SetSize(-1*in->GetSize());
     break;
   case '!':
-    ica.Add("test_equ", in->GetVarID(), "0", outVar->GetVarID());
+    ica.Add(Opcode::TEST_EQU, in->GetVarID(), "0", outVar->GetVarID());
     break;
   default:
     std::cerr << "Internal compiler error: unknown Math1 operation '"
@@ -298,6 +307,14 @@ CTableEntry * ASTNodeMath1::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   return outVar;
 }
 
+void ASTNodeMath1::CompileBranchIC(CSymbolTable & table, ICArray & ica, const std::string & label,
+                                   bool when_true)
+{
+  // A '!' just swaps which way the branch goes.
+  if (mMathOp == '!') mChildren[0]->CompileBranchIC(table, ica, label, !when_true);
+  else ASTNode::CompileBranchIC(table, ica, label, when_true);
+}
+
 
 /////////////////////
 // ASTNodeMath2
@@ -347,28 +364,28 @@ CTableEntry * ASTNodeMath2::CompileTubeIC(CSymbolTable & table, ICArray & ica)
 
   // Determine the correct operation...
   if (mMathOp == '+') {
-      ica.Add("add", i1, i2, o3);
+      ica.Add(Opcode::ADD, i1, i2, o3);
       //size = in1->GetSize() + in2->GetSize();
   }
   else if (mMathOp == '-') {
-      ica.Add("sub",  i1, i2, o3);
+      ica.Add(Opcode::SUB,  i1, i2, o3);
       //size = in1->GetSize() - in2->GetSize();
   }
   else if (mMathOp == '*') {
-      ica.Add("mult", i1, i2, o3);
+      ica.Add(Opcode::MULT, i1, i2, o3);
       //size = in1->GetSize() * in2->GetSize();
   }
   else if (mMathOp == '/') {
-      ica.Add("div",  i1, i2, o3);
+      ica.Add(Opcode::DIV,  i1, i2, o3);
       //size = in1->GetSize() / in2->GetSize();
   }
-  else if (mMathOp == '%') { ica.Add("mod",  i1, i2, o3); }
-  else if (mMathOp == COMP_EQU)  { ica.Add("test_equ",  i1, i2, o3); }
-  else if (mMathOp == COMP_NEQU) { ica.Add("test_nequ", i1, i2, o3); }
-  else if (mMathOp == COMP_GTR)  { ica.Add("test_gtr",  i1, i2, o3); }
-  else if (mMathOp == COMP_GTE)  { ica.Add("test_gte",  i1, i2, o3); }
-  else if (mMathOp == COMP_LESS) { ica.Add("test_less", i1, i2, o3); }
-  else if (mMathOp == COMP_LTE)  { ica.Add("test_lte",  i1, i2, o3); }
+  else if (mMathOp == '%') { ica.Add(Opcode::MOD,  i1, i2, o3); }
+  else if (mMathOp == COMP_EQU)  { ica.Add(Opcode::TEST_EQU,  i1, i2, o3); }
+  else if (mMathOp == COMP_NEQU) { ica.Add(Opcode::TEST_NEQU, i1, i2, o3); }
+  else if (mMathOp == COMP_GTR)  { ica.Add(Opcode::TEST_GTR,  i1, i2, o3); }
+  else if (mMathOp == COMP_GTE)  { ica.Add(Opcode::TEST_GTE,  i1, i2, o3); }
+  else if (mMathOp == COMP_LESS) { ica.Add(Opcode::TEST_LESS, i1, i2, o3); }
+  else if (mMathOp == COMP_LTE)  { ica.Add(Opcode::TEST_LTE,  i1, i2, o3); }
   else {
     std::cerr << "INTERNAL ERROR: Unknown Math2 type '" << mMathOp << "'" << std::endl;
   }
@@ -411,14 +428,14 @@ CTableEntry * ASTNodeBool2::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   std::string end_label = table.NextLabelID("end_bool_");
 
   // Convert the first answer to a 0 or 1 and put it in outVar.
-  ica.Add("test_nequ", in1->GetVarID(), "0", outVar->GetVarID());
+  ica.Add(Opcode::TEST_NEQU, in1->GetVarID(), "0", outVar->GetVarID());
 
   // Determine the correct operation for short-circuiting...
   if (mBoolOp == '&') {
-    ica.Add("jump_if_0", outVar->GetVarID(), end_label, -1, "AND!");
+    ica.Add(Opcode::JUMP_IF_0, outVar->GetVarID(), end_label, -1, "AND!");
   }
   else if (mBoolOp == '|') {
-    ica.Add("jump_if_n0", outVar->GetVarID(), end_label, -1, "OR!");
+    ica.Add(Opcode::JUMP_IF_N0, outVar->GetVarID(), end_label, -1, "OR!");
   }
   else { std::cerr << "INTERNAL ERROR: Unknown Bool2 type '" << mBoolOp << "'" << std::endl; }
 
@@ -426,7 +443,7 @@ CTableEntry * ASTNodeBool2::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   CTableEntry * in2 = mChildren[1]->CompileTubeIC(table, ica);
 
   // Convert the second answer to a 0 or 1 and put it in outVar.
-  ica.Add("test_nequ", in2->GetVarID(), "0", outVar->GetVarID());
+  ica.Add(Opcode::TEST_NEQU, in2->GetVarID(), "0", outVar->GetVarID());
 
   // Leave the output label to jump to.
   ica.AddLabel(end_label);
@@ -438,6 +455,30 @@ CTableEntry * ASTNodeBool2::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   return outVar;
 }
 
+void ASTNodeBool2::CompileBranchIC(CSymbolTable & table, ICArray & ica, const std::string & label,
+                                   bool when_true)
+{
+  if (mBoolOp != '&' && mBoolOp != '|') {
+    std::cerr << "INTERNAL ERROR: Unknown Bool2 type '" << mBoolOp << "'" << std::endl;
+    return;
+  }
+
+  // The first operand alone decides an AND that is false or an OR that is true.  If that is
+  // the outcome we jump on, both operands jump straight to the label...
+  bool short_value = (mBoolOp == '|');
+  if (when_true == short_value) {
+    mChildren[0]->CompileBranchIC(table, ica, label, when_true);
+    mChildren[1]->CompileBranchIC(table, ica, label, when_true);
+    return;
+  }
+
+  // ...otherwise a short-circuit skips the test of the second operand.
+  std::string end_label = table.NextLabelID("end_bool_");
+  mChildren[0]->CompileBranchIC(table, ica, end_label, short_value);
+  mChildren[1]->CompileBranchIC(table, ica, label, when_true);
+  ica.AddLabel(end_label);
+}
+
 
 /////////////////////
 // ASTNodeIf
@@ -461,10 +502,8 @@ CTableEntry * ASTNodeIf::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   std::string else_label = table.NextLabelID("if_else_");
   std::string end_label = table.NextLabelID("if_end_");
 
-  CTableEntry * in0 = mChildren[0]->CompileTubeIC(table, ica);
-
   // If the condition is false, jump to else.  Otherwise continue through if.
-  ica.Add("jump_if_0", in0->GetVarID(), else_label);
+  mChildren[0]->CompileBranchIC(table, ica, else_label, false);
 
   if (mChildren[1]) {
     CTableEntry * in1 = mChildren[1]->CompileTubeIC(table, ica);
@@ -472,7 +511,7 @@ CTableEntry * ASTNodeIf::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   }
 
   // Now that we are done with "if", jump to the end; also start the else here.
-  ica.Add("jump", end_label);
+  ica.Add(Opcode::JUMP, end_label);
   ica.AddLabel(else_label);
 
   if (mChildren[2]) {
@@ -512,10 +551,8 @@ CTableEntry * ASTNodeWhile::CompileTubeIC(CSymbolTable & table, ICArray & ica)
 
   ica.AddLabel(start_label);
 
-  CTableEntry * in0 = mChildren[0]->CompileTubeIC(table, ica);
-
   // If the condition is false, jump to end.  Otherwise continue through body.
-  ica.Add("jump_if_0", in0->GetVarID(), end_label);
+  mChildren[0]->CompileBranchIC(table, ica, end_label, false);
 
   if (mChildren[1]) {
     CTableEntry * in1 = mChildren[1]->CompileTubeIC(table, ica);
@@ -523,7 +560,7 @@ CTableEntry * ASTNodeWhile::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   }
 
   // Now that we are done with the while body, jump back to the start.
-  ica.Add("jump", start_label);
+  ica.Add(Opcode::JUMP, start_label);
   ica.AddLabel(end_label);
 
   table.PopWhileEndLabel();
@@ -549,7 +586,7 @@ CTableEntry * ASTNodeBreak::CompileTubeIC(CSymbolTable & table, ICArray & ica)
     exit(1);
   }
 
-  ica.Add("jump", table.GetWhileEndLabel());
+  ica.Add(Opcode::JUMP, table.GetWhileEndLabel());
 
   return NULL;
 }
@@ -575,7 +612,7 @@ CTableEntry * ASTNodeRandom::CompileTubeIC(CSymbolTable & table, ICArray & ica)
     e += "' as an argument to random";
     yyerror(e);
   }
-  ica.Add("random",inVar->GetVarID(),outVar->GetVarID());
+  ica.Add(Opcode::RANDOM,inVar->GetVarID(),outVar->GetVarID());
   return outVar;
   }
 
@@ -596,10 +633,10 @@ CTableEntry * ASTNodePrint::CompileTubeIC(CSymbolTable & table, ICArray & ica)
     CTableEntry * cur_var = mChildren[i]->CompileTubeIC(table, ica);
     switch (cur_var->GetType()) {
     case Type::INT:
-      ica.Add("out_int", cur_var->GetVarID());
+      ica.Add(Opcode::OUT_INT, cur_var->GetVarID());
       break;
     case Type::CHAR:
-      ica.Add("out_char", cur_var->GetVarID());
+      ica.Add(Opcode::OUT_CHAR, cur_var->GetVarID());
       break;
     case Type::INT_ARRAY: {
       CTableEntry * loop_var = table.AddTempEntry(Type::INT);
@@ -608,20 +645,20 @@ CTableEntry * ASTNodePrint::CompileTubeIC(CSymbolTable & table, ICArray & ica)
       std::string start_label = table.NextLabelID("print_array_start_");
       std::string end_label = table.NextLabelID("print_array_end_");
 
-      ica.Add("val_copy", "0", loop_var->GetVarID());
-      ica.Add("ar_get_size", cur_var->GetVarID(), size_var->GetVarID());
+      ica.Add(Opcode::VAL_COPY, "0", loop_var->GetVarID());
+      ica.Add(Opcode::AR_GET_SIZE, cur_var->GetVarID(), size_var->GetVarID());
 
       ica.AddLabel(start_label);
 
       CTableEntry * test_var = table.AddTempEntry(Type::INT);
-      ica.Add("test_gte", loop_var->GetVarID(), size_var->GetVarID(),
+      ica.Add(Opcode::TEST_GTE, loop_var->GetVarID(), size_var->GetVarID(),
               test_var->GetVarID());
-      ica.Add("jump_if_n0", test_var->GetVarID(), end_label);
-      ica.Add("ar_get_idx", cur_var->GetVarID(), loop_var->GetVarID(),
+      ica.Add(Opcode::JUMP_IF_N0, test_var->GetVarID(), end_label);
+      ica.Add(Opcode::AR_GET_IDX, cur_var->GetVarID(), loop_var->GetVarID(),
               test_var->GetVarID());
-      ica.Add("out_int", test_var->GetVarID());
-      ica.Add("add", loop_var->GetVarID(), "1", loop_var->GetVarID());
-      ica.Add("jump", start_label);
+      ica.Add(Opcode::OUT_INT, test_var->GetVarID());
+      ica.Add(Opcode::ADD, loop_var->GetVarID(), "1", loop_var->GetVarID());
+      ica.Add(Opcode::JUMP, start_label);
 
       ica.AddLabel(end_label);
 
@@ -631,23 +668,23 @@ CTableEntry * ASTNodePrint::CompileTubeIC(CSymbolTable & table, ICArray & ica)
       CTableEntry * loop_var = table.AddTempEntry(Type::INT);
       CTableEntry * size_var = table.AddTempEntry(Type::INT);
 
-      ica.Add("val_copy", "0", loop_var->GetVarID());
-      ica.Add("ar_get_size", cur_var->GetVarID(), size_var->GetVarID());
+      ica.Add(Opcode::VAL_COPY, "0", loop_var->GetVarID());
+      ica.Add(Opcode::AR_GET_SIZE, cur_var->GetVarID(), size_var->GetVarID());
 
       std::string start_label = table.NextLabelID("print_array_start_");
       std::string end_label = table.NextLabelID("print_array_end_");
       ica.AddLabel(start_label);
 
       CTableEntry * test_var = table.AddTempEntry(Type::INT);
-      ica.Add("test_gte", loop_var->GetVarID(), size_var->GetVarID(),
+      ica.Add(Opcode::TEST_GTE, loop_var->GetVarID(), size_var->GetVarID(),
               test_var->GetVarID());
-      ica.Add("jump_if_n0", test_var->GetVarID(), end_label);
+      ica.Add(Opcode::JUMP_IF_N0, test_var->GetVarID(), end_label);
       CTableEntry * elem_var = table.AddTempEntry(Type::CHAR);
-      ica.Add("ar_get_idx", cur_var->GetVarID(), loop_var->GetVarID(),
+      ica.Add(Opcode::AR_GET_IDX, cur_var->GetVarID(), loop_var->GetVarID(),
               elem_var->GetVarID());
-      ica.Add("out_char", elem_var->GetVarID());
-      ica.Add("add", loop_var->GetVarID(), "1", loop_var->GetVarID());
-      ica.Add("jump", start_label);
+      ica.Add(Opcode::OUT_CHAR, elem_var->GetVarID());
+      ica.Add(Opcode::ADD, loop_var->GetVarID(), "1", loop_var->GetVarID());
+      ica.Add(Opcode::JUMP, start_label);
 
       ica.AddLabel(end_label);
 
@@ -658,7 +695,7 @@ CTableEntry * ASTNodePrint::CompileTubeIC(CSymbolTable & table, ICArray & ica)
       exit(1);
     };
   }
-  ica.Add("out_char", "'\\n'", -1, -1, "End print statements with a newline.");
+  ica.Add(Opcode::OUT_CHAR, "'\\n'", -1, -1, "End print statements with a newline.");
 
   return NULL;
 }
@@ -724,7 +761,7 @@ CTableEntry * ASTNodeIndex::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   int size = index->GetSize();
   //std::cout << "element: " << array;
   outVar->SetSize(array[size]);
-  ica.Add("ar_get_idx", mArray->GetVarID(), index->GetVarID(), o3);
+  ica.Add(Opcode::AR_GET_IDX, mArray->GetVarID(), index->GetVarID(), o3);
 
   return outVar;
 
@@ -751,7 +788,7 @@ CTableEntry * ASTNodeSize::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   CTableEntry * outVar = table.AddTempEntry(Type::INT);
   outVar->SetSize(mArray->GetSize());
 
-  ica.Add("ar_get_size", mArray->GetVarID(), outVar->GetVarID());
+  ica.Add(Opcode::AR_GET_SIZE, mArray->GetVarID(), outVar->GetVarID());
 
   return outVar;
 
@@ -793,7 +830,7 @@ CTableEntry * ASTNodeResize::CompileTubeIC(CSymbolTable & table, ICArray & ica)
       }
   }
   mArray->SetSize(size->GetSize());
-  ica.Add("ar_set_size", mArray->GetVarID(), size->GetVarID());
+  ica.Add(Opcode::AR_SET_SIZE, mArray->GetVarID(), size->GetVarID());
 
   return NULL;
 
@@ -813,11 +850,11 @@ CTableEntry * ASTNodeFunction::CompileTubeIC(CSymbolTable & table, ICArray & ica
 {
   //std::cout << "In ASTNodeFunction::CompileTubeIC" << std::endl;
   std::string end_label = mEntry->GetLabel() + "_end";
-  ica.Add("jump", end_label);
+  ica.Add(Opcode::JUMP, end_label);
   ica.AddLabel(mEntry->GetLabel());
   mBody->CompileTubeIC(table, ica);
   CTableEntry * entry = mEntry->GetReturn(); // Get the return TableEntry
-  //ica.Add("jump", entry->GetVarID());        // Jump to back the function call
+  //ica.Add(Opcode::JUMP, entry->GetVarID());        // Jump to back the function call
   ica.AddLabel(end_label);
   return NULL;
 }
@@ -844,25 +881,38 @@ CTableEntry * ASTNodeFunctionCall::CompileTubeIC(CSymbolTable & table, ICArray &
     //std::cout << ss.str();
     if(cur_var->GetType() == Type::INT || cur_var->GetType() == Type::CHAR)
     {
-      ica.Add("val_copy", cur_var->GetVarID(), mEntry->GetArg(i)->GetVarID());
+      ica.Add(Opcode::VAL_COPY, cur_var->GetVarID(), mEntry->GetArg(i)->GetVarID());
     }
     else if(cur_var->GetType() == Type::INT_ARRAY ||
             cur_var->GetType() == Type::CHAR_ARRAY)
     {
-      ica.Add("ar_copy", cur_var->GetVarID(), mEntry->GetArg(i)->GetVarID());
+      ica.Add(Opcode::AR_COPY, cur_var->GetVarID(), mEntry->GetArg(i)->GetVarID());
     }
   }
 
   // Copy return point to special return label variable
-  ica.Add("val_copy", label, mEntry->GetReturn()->GetVarID());
+  ica.Add(Opcode::VAL_COPY, label, mEntry->GetReturn()->GetVarID());
 
   // Jump to function definition
-  ica.Add("jump", mEntry->GetLabel());
+  ica.Add(Opcode::JUMP, mEntry->GetLabel());
 
   // Add l
   ica.AddLabel(label);
 
-  return mEntry->GetReturnValue();
+  // Move the result out of the function's shared return slot; otherwise a
+  // later call to the same function (or freeing this temp) would clobber it.
+  CTableEntry * return_value = mEntry->GetReturnValue();
+  if (return_value->GetType() == Type::INT || return_value->GetType() == Type::CHAR) {
+    CTableEntry * result = table.AddTempEntry(return_value->GetType());
+    ica.Add(Opcode::VAL_COPY, return_value->GetVarID(), result->GetVarID());
+    return result;
+  }
+  if (Type::IsArray(return_value->GetType())) {
+    CTableEntry * result = table.AddTempEntry(return_value->GetType());
+    ica.Add(Opcode::AR_COPY, return_value->GetVarID(), result->GetVarID());
+    return result;
+  }
+  return return_value;
 }
 
 /////////////////////////
@@ -885,16 +935,16 @@ CTableEntry * ASTNodeReturn::CompileTubeIC(CSymbolTable & table, ICArray & ica)
   CTableEntry * argument = mArgument->CompileTubeIC(table, ica);
 
   if(argument->GetType() == Type::INT || argument->GetType() == Type::CHAR) {
-    ica.Add("val_copy", argument->GetVarID(),
+    ica.Add(Opcode::VAL_COPY, argument->GetVarID(),
             mCurrentFunction->GetReturnValue()->GetVarID());
   }
   else if(argument->GetType() == Type::INT_ARRAY ||
           argument->GetType() == Type::CHAR_ARRAY)
   {
-    ica.Add("ar_copy", argument->GetVarID(),
+    ica.Add(Opcode::AR_COPY, argument->GetVarID(),
             mCurrentFunction->GetReturnValue()->GetVarID());
   }
 
-  ica.Add("jump", mCurrentFunction->GetReturn()->GetVarID());
+  ica.Add(Opcode::JUMP, mCurrentFunction->GetReturn()->GetVarID());
   return NULL;
 }
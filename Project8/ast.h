@@ -31,6 +31,7 @@
 #include <vector>
 #include <fstream>
 
+#include "arena.h"
 #include "ic.h"
 #include "type_info.h"
 #include "symbol_table.h"
@@ -42,18 +43,25 @@ protected:
   std::vector<ASTNode *> mChildren;  // What sub-trees does this node have?
   bool mDebug;
   //std::vector<CFunctionEntry *> mArgs;
+  static int mNumNodes;              // How many nodes have been built (for -time-report).
 
 public:
-  ASTNode(int in_type) : mType(in_type), mLineNum(-1), mDebug(false) { ; }
-  virtual ~ASTNode() {
-    for (int i = 0; i < (int) mChildren.size(); i++) delete mChildren[i];
+  ASTNode(int in_type) : mType(in_type), mLineNum(-1), mDebug(false) {
+    compile_context.GetParseArena().OnRelease(this);
+    mNumNodes++;
   }
+  virtual ~ASTNode() { ; }
+
+  // Nodes live in the parse arena and are all freed together when it is released.
+  static void * operator new(size_t size) { return compile_context.GetParseArena().Allocate(size); }
+  static void operator delete(void *) { ; }
 
   int GetType()              { return mType; }
   int GetLineNum()           { return mLineNum; }
   bool GetDebug()            { return mDebug; }
   ASTNode * GetChild(int id) { return mChildren[id]; }
   int GetNumChildren()       { return mChildren.size(); }
+  static int GetNumNodes()   { return mNumNodes; }
 
   void SetType(int new_type) { mType = new_type; } // Use inside constructor only!
   void SetLineNum(int _in)                 { mLineNum = _in; }
@@ -65,6 +73,13 @@ public:
   // Convert a single node to TubeIC and return information about the
   // variable where the results are saved.  Call mChildren recursively.
   virtual CTableEntry * CompileTubeIC(CSymbolTable & table, ICArray & ica) = 0;
+
+  // Compile this node as the condition of a branch: jump to 'label' if its value is non-zero
+  // ('when_true') or zero (!'when_true'), and fall through otherwise.  By default the value
+  // is computed and then tested; boolean operators override this to jump without ever
+  // building a 0 or 1.
+  virtual void CompileBranchIC(CSymbolTable & table, ICArray & ica, const std::string & label,
+                               bool when_true);
 };
 
 
@@ -152,6 +167,7 @@ public:
   virtual ~ASTNodeMath1() { ; }
 
   CTableEntry * CompileTubeIC(CSymbolTable & table, ICArray & ica);
+  void CompileBranchIC(CSymbolTable & table, ICArray & ica, const std::string & label, bool when_true);
 };
 
 class ASTNodeMath2 : public ASTNode {
@@ -172,6 +188,7 @@ public:
   virtual ~ASTNodeBool2() { ; }
 
   CTableEntry * CompileTubeIC(CSymbolTable & table, ICArray & ica);
+  void CompileBranchIC(CSymbolTable & table, ICArray & ica, const std::string & label, bool when_true);
 };
 
 class ASTNodeIf : public ASTNode {
@@ -0,0 +1,127 @@
+#! /bin/bash
+
+# This file can be executed by calling "bash bench_suite.sh [-u] [-O2] [report file]"
+# It compiles every Test_Suite/good-*.tube with tube8, runs the result on the
+# in-project TubeCode VM (tubevm), and records for each program:
+#   status        ok, wrong (output differs from the reference), error (did not
+#                 compile), or over_budget (correct, but more cycles than the
+#                 limit in its filename)
+#   cycles        dynamic cycles used, and the budget from the filename
+#   static_insts  TubeCode instructions in the output
+#   static_memory ICArray::static_memory_size
+#   peak_heap_kb  peak heap the compiler used (from -time-report)
+# Each is compared with the stored baseline (bench_baseline.tsv).  The report
+# (default bench_report.tsv) is tab-separated with one line per program.
+#
+# Exits with 1 if a program that was correct in the baseline no longer is, or
+# now takes more cycles than in the baseline.  Use -u to store the current
+# results as the new baseline.  With -O2, every program is compiled at -O2; the
+# baseline is still the default build, so the deltas show what -O2 changes.
+project=tube8
+baseline=bench_baseline.tsv
+update=0
+flags=""
+if [ "$1" == "-u" ]; then
+	update=1
+	shift
+fi
+if [ "$1" == "-O2" ]; then
+	flags="-O2"
+	shift
+fi
+report=${1:-bench_report.tsv}
+
+make $project tubevm > /dev/null
+if [ ! -f $project ] || [ ! -f tubevm ]; then
+	echo $project "not correctly compiled";
+	exit 1;
+fi;
+chmod a+x Test_Suite/reference_$project
+
+# Look up one column of a program's line in the baseline ("" if there is none).
+function base_value {
+	if [ -f $baseline ]; then
+		awk -F'\t' -v p=$1 -v c=$2 '$1 == p { print $c }' $baseline
+	fi
+}
+
+function delta {
+	if [ -z "$1" ] || [ -z "$2" ] || [ "$1" == "-" ] || [ "$2" == "-" ]; then
+		echo "-"
+	else
+		echo $(( $1 - $2 ))
+	fi
+}
+
+printf "program\tstatus\tcycles\tbudget\tbudget_pct\tstatic_insts\tstatic_memory\tpeak_heap_kb" > $report
+printf "\tbase_cycles\tdelta_cycles\tbase_insts\tdelta_insts\tbase_memory\tdelta_memory\tbase_heap_kb\tdelta_heap_kb\n" >> $report
+
+regressions=0
+for F in Test_Suite/good-*.tube; do
+	name=$(basename $F .tube)
+	IFS='-' read -a array <<< "$name"
+	budget=${array[2]}
+
+	./$project $flags -time-report $F bench.tca > bench.cout 2> bench.time
+	if grep -Fq "ERROR" bench.cout; then
+		status=error; cycles=-; insts=-; memory=-; heap=-
+	else
+		memory=$(awk '/^static memory size/ { print $NF }' bench.time)
+		heap=$(awk '$1 == "total" { print $(NF-1) }' bench.time)
+		insts=$(awk '{ sub(/#.*/, ""); sub(/^[ \t]*[A-Za-z_0-9]+[ \t]*:/, ""); if ($0 ~ /[^ \t]/) n++ } END { print n+0 }' bench.tca)
+		./tubevm -c bench.tca > bench.out
+		cycles=$(tail -1 bench.out | grep -oE '[0-9]+')
+		sed '$d' bench.out > bench.mine
+
+		Test_Suite/reference_$project $F bench_ref.tca > /dev/null
+		./tubevm bench_ref.tca > bench.ref
+		if ! diff -q bench.ref bench.mine > /dev/null; then
+			status=wrong
+		elif [ $cycles -gt $budget ]; then
+			status=over_budget
+		else
+			status=ok
+		fi
+	fi
+
+	pct=-
+	if [ "$cycles" != "-" ]; then
+		pct=$(awk -v c=$cycles -v b=$budget 'BEGIN { printf "%.1f", 100.0 * c / b }')
+	fi
+	base_status=$(base_value $name 2)
+	base_cycles=$(base_value $name 3)
+	base_insts=$(base_value $name 6)
+	base_memory=$(base_value $name 7)
+	base_heap=$(base_value $name 8)
+	d_cycles=$(delta "$cycles" "$base_cycles")
+
+	printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s" $name $status $cycles $budget $pct $insts $memory $heap >> $report
+	printf "\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" "${base_cycles:--}" $d_cycles \
+		"${base_insts:--}" $(delta "$insts" "$base_insts") \
+		"${base_memory:--}" $(delta "$memory" "$base_memory") \
+		"${base_heap:--}" $(delta "$heap" "$base_heap") >> $report
+
+	note=""
+	if [ "$base_status" == "ok" ] || [ "$base_status" == "over_budget" ]; then
+		if [ "$status" == "wrong" ] || [ "$status" == "error" ]; then
+			note="REGRESSION (was $base_status)"
+		elif [ "$d_cycles" != "-" ] && [ $d_cycles -gt 0 ]; then
+			note="REGRESSION (+$d_cycles cycles)"
+		fi
+	fi
+	if [ -n "$note" ]; then
+		regressions=$((regressions + 1))
+	fi
+	printf "%-20s %-12s %10s / %-6s %s\n" $name $status $cycles $budget "$note"
+done
+rm -f bench.tca bench_ref.tca bench.cout bench.time bench.out bench.mine bench.ref
+
+if [ $update -eq 1 ]; then
+	cp $report $baseline
+	echo "Baseline updated ($baseline)."
+fi
+if [ $regressions -ne 0 ]; then
+	echo "$regressions regression(s); see $report"
+	exit 1
+fi
+echo "No regressions; see $report"
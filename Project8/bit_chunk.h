@@ -0,0 +1,24 @@
+#ifndef BIT_CHUNK_H
+#define BIT_CHUNK_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The bit-vector dataflow passes give each item they track one bit of a machine word, and
+//  solve their problems for BitChunk::SIZE items at a time: one word per block per chunk, with
+//  no vector of words to allocate.  Item i of a chunk is bit (1 << i).
+//
+
+namespace BitChunk {
+  typedef unsigned long long Bits;
+
+  const int SIZE = 64;             // Items per chunk (bits in Bits).
+
+  // The bits in use by the chunk that starts at item 'first' of 'num_items'.
+  inline Bits Mask(int first, int num_items)
+  {
+    int size = num_items - first;
+    return (size >= SIZE) ? ~0ULL : (1ULL << size) - 1;
+  }
+}
+
+#endif
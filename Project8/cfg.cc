@@ -0,0 +1,326 @@
+#include "cfg.h"
+
+#include <algorithm>
+#include <set>
+
+/******************************************
+ * BEGIN CControlFlowGraph
+ *****************************************/
+
+// Which argument of a jump holds where it goes.
+int CControlFlowGraph::JumpTargetArg(int op)
+{
+  return (op == Opcode::JUMP) ? 0 : 1;
+}
+
+void CControlFlowGraph::AddEdge(std::vector<int> & edges, int block)
+{
+  if (std::find(edges.begin(), edges.end(), block) == edges.end()) edges.push_back(block);
+}
+
+void CControlFlowGraph::Build(ICArray & ica)
+{
+  mBlocks.clear();
+  mLoops.clear();
+  mBlockOf.clear();
+  mDomOrder.clear();
+  mDomIndex.clear();
+  mTreeEnter.clear();
+  mTreeExit.clear();
+  if (ica.GetNumEntries() == 0) return;
+
+  FindBlocks(ica);
+  FindEdges(ica);
+  FindDominators();
+  FindLoops();
+  FindPreheaders(ica);
+}
+
+// A new block starts at the first line, at every label, and right after every jump.
+void CControlFlowGraph::FindBlocks(ICArray & ica)
+{
+  int num_lines = ica.GetNumEntries();
+  mBlockOf.resize(num_lines);
+  int first = 0;
+  for (int i = 0; i < num_lines; i++) {
+    if (i > first && ica.GetEntry(i)->GetLabel() != "") {
+      mBlocks.push_back(CBasicBlock(first, i - 1));
+      first = i;
+    }
+    mBlockOf[i] = mBlocks.size();
+    if (Opcode::IsJump(ica.GetEntry(i)->GetOpcode()) || i == num_lines - 1) {
+      mBlocks.push_back(CBasicBlock(first, i));
+      first = i + 1;
+    }
+  }
+}
+
+void CControlFlowGraph::FindEdges(ICArray & ica)
+{
+  int num_lines = ica.GetNumEntries();
+  std::map<int, int> label_line;   // Interned label ID -> line it is on.
+  for (int i = 0; i < num_lines; i++) {
+    const std::string & label = ica.GetEntry(i)->GetLabel();
+    if (label != "") label_line[ICOperand::InternLabel(label)] = i;
+  }
+
+  // Return points are labels copied into a variable; remember which variable
+  // each one went into so "jump sR" only returns to its own call sites.
+  std::map<int, std::vector<int> > returns_via;
+  std::vector<int> all_returns;
+  for (int i = 0; i < num_lines; i++) {
+    ICEntry * entry = ica.GetEntry(i);
+    if (entry->GetOpcode() != Opcode::VAL_COPY || !entry->GetOperand(0).IsLabel()) continue;
+    std::map<int, int>::iterator target = label_line.find(entry->GetOperand(0).GetValue());
+    if (target == label_line.end()) continue;
+    int block = mBlockOf[target->second];
+    AddEdge(returns_via[entry->GetArgID(1)], block);
+    AddEdge(all_returns, block);
+  }
+
+  for (int b = 0; b < (int) mBlocks.size(); b++) {
+    CBasicBlock & block = mBlocks[b];
+    ICEntry * last = ica.GetEntry(block.mLastLine);
+    int inst = last->GetOpcode();
+    bool falls_through = (inst != Opcode::JUMP) && (b + 1 < (int) mBlocks.size());
+
+    if (Opcode::IsJump(inst)) {
+      int target_arg = JumpTargetArg(inst);
+      if (last->GetOperand(target_arg).IsLabel()) {
+        std::map<int, int>::iterator target = label_line.find(last->GetOperand(target_arg).GetValue());
+        if (target != label_line.end()) {
+          AddEdge(block.mSuccs, mBlockOf[target->second]);
+          AddEdge(block.mDomSuccs, mBlockOf[target->second]);
+        }
+      }
+      else {
+        // An indirect jump is a function return.
+        std::map<int, std::vector<int> >::iterator ret = returns_via.find(last->GetArgID(target_arg));
+        const std::vector<int> & targets = (ret != returns_via.end()) ? ret->second : all_returns;
+        for (int i = 0; i < (int) targets.size(); i++) AddEdge(block.mSuccs, targets[i]);
+      }
+
+      // A call stores the label that immediately follows it; in the dominator
+      // view it "falls through" to that return point.
+      if (inst == Opcode::JUMP && last->GetOperand(0).IsLabel() && block.mLastLine > block.mFirstLine &&
+          block.mLastLine + 1 < num_lines) {
+        ICEntry * store = ica.GetEntry(block.mLastLine - 1);
+        const std::string & next_label = ica.GetEntry(block.mLastLine + 1)->GetLabel();
+        if (store->GetOpcode() == Opcode::VAL_COPY && store->GetOperand(0).IsLabel() &&
+            next_label != "" && store->GetOperand(0) == ICOperand::Label(next_label)) {
+          block.mIsCall = true;
+          AddEdge(block.mDomSuccs, b + 1);
+        }
+      }
+    }
+
+    if (falls_through) {
+      AddEdge(block.mSuccs, b + 1);
+      AddEdge(block.mDomSuccs, b + 1);
+    }
+  }
+
+  for (int b = 0; b < (int) mBlocks.size(); b++) {
+    for (int i = 0; i < (int) mBlocks[b].mSuccs.size(); i++) {
+      AddEdge(mBlocks[mBlocks[b].mSuccs[i]].mPreds, b);
+    }
+    for (int i = 0; i < (int) mBlocks[b].mDomSuccs.size(); i++) {
+      AddEdge(mBlocks[mBlocks[b].mDomSuccs[i]].mDomPreds, b);
+    }
+  }
+}
+
+// Cooper, Harvey & Kennedy's iterative algorithm over reverse postorder.
+void CControlFlowGraph::FindDominators()
+{
+  int num_blocks = mBlocks.size();
+
+  // Postorder with an explicit stack; programs can be deep enough to overflow recursion.
+  std::vector<int> postorder;
+  std::vector<bool> visited(num_blocks, false);
+  std::vector< std::pair<int, int> > stack;
+  stack.push_back(std::make_pair(0, 0));
+  visited[0] = true;
+  while (stack.size() > 0) {
+    int block = stack.back().first;
+    int & next = stack.back().second;
+    if (next < (int) mBlocks[block].mDomSuccs.size()) {
+      int succ = mBlocks[block].mDomSuccs[next++];
+      if (!visited[succ]) {
+        visited[succ] = true;
+        stack.push_back(std::make_pair(succ, 0));
+      }
+    }
+    else {
+      postorder.push_back(block);
+      stack.pop_back();
+    }
+  }
+
+  mDomOrder.assign(postorder.rbegin(), postorder.rend());
+  mDomIndex.assign(num_blocks, -1);
+  for (int i = 0; i < (int) mDomOrder.size(); i++) mDomIndex[mDomOrder[i]] = i;
+
+  std::vector<int> idom(num_blocks, -1);
+  idom[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = 1; i < (int) mDomOrder.size(); i++) {
+      int block = mDomOrder[i];
+      int new_idom = -1;
+      const std::vector<int> & preds = mBlocks[block].mDomPreds;
+      for (int p = 0; p < (int) preds.size(); p++) {
+        int pred = preds[p];
+        if (idom[pred] == -1) continue;
+        if (new_idom == -1) { new_idom = pred; continue; }
+        // Walk both fingers up the tree until they meet.
+        int finger1 = pred, finger2 = new_idom;
+        while (finger1 != finger2) {
+          while (mDomIndex[finger1] > mDomIndex[finger2]) finger1 = idom[finger1];
+          while (mDomIndex[finger2] > mDomIndex[finger1]) finger2 = idom[finger2];
+        }
+        new_idom = finger1;
+      }
+      if (idom[block] != new_idom) {
+        idom[block] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  for (int b = 1; b < num_blocks; b++) {
+    mBlocks[b].mIDom = idom[b];
+    if (idom[b] != -1) mBlocks[idom[b]].mDomChildren.push_back(b);
+  }
+
+  // Number the dominator tree so Dominates() is a range check.
+  mTreeEnter.assign(num_blocks, -1);
+  mTreeExit.assign(num_blocks, -1);
+  int counter = 0;
+  stack.clear();
+  stack.push_back(std::make_pair(0, 0));
+  mTreeEnter[0] = counter++;
+  while (stack.size() > 0) {
+    int block = stack.back().first;
+    int & next = stack.back().second;
+    if (next < (int) mBlocks[block].mDomChildren.size()) {
+      int child = mBlocks[block].mDomChildren[next++];
+      mTreeEnter[child] = counter++;
+      stack.push_back(std::make_pair(child, 0));
+    }
+    else {
+      mTreeExit[block] = counter++;
+      stack.pop_back();
+    }
+  }
+}
+
+// Every edge to a block that dominates its source closes a natural loop.
+void CControlFlowGraph::FindLoops()
+{
+  std::map<int, std::set<int> > body_of;   // Header -> blocks in its loop.
+  for (int i = 0; i < (int) mDomOrder.size(); i++) {
+    int tail = mDomOrder[i];
+    const std::vector<int> & succs = mBlocks[tail].mDomSuccs;
+    for (int s = 0; s < (int) succs.size(); s++) {
+      int header = succs[s];
+      if (!Dominates(header, tail)) continue;
+
+      std::set<int> & body = body_of[header];
+      body.insert(header);
+      std::vector<int> work;
+      if (body.insert(tail).second) work.push_back(tail);
+      while (work.size() > 0) {
+        int block = work.back();
+        work.pop_back();
+        const std::vector<int> & preds = mBlocks[block].mDomPreds;
+        for (int p = 0; p < (int) preds.size(); p++) {
+          if (IsReachable(preds[p]) && body.insert(preds[p]).second) work.push_back(preds[p]);
+        }
+      }
+    }
+  }
+
+  for (std::map<int, std::set<int> >::iterator it = body_of.begin(); it != body_of.end(); ++it) {
+    mLoops.push_back(CLoop(it->first));
+    mLoops.back().mBlocks.assign(it->second.begin(), it->second.end());
+  }
+
+  // Natural loops are either nested or disjoint, so going from the largest loop to the smallest,
+  // a loop's parent is the last loop seen that holds its header, and each block ends up in the
+  // innermost loop containing it.
+  std::vector<std::pair<int, int> > by_size;   // (minus number of blocks, loop)
+  for (int l = 0; l < (int) mLoops.size(); l++) by_size.push_back(std::make_pair(-(int) mLoops[l].mBlocks.size(), l));
+  std::sort(by_size.begin(), by_size.end());
+  for (int i = 0; i < (int) by_size.size(); i++) {
+    CLoop & loop = mLoops[by_size[i].second];
+    loop.mParent = mBlocks[loop.mHeader].mLoop;
+    loop.mDepth = (loop.mParent == -1) ? 1 : mLoops[loop.mParent].mDepth + 1;
+    for (int b = 0; b < (int) loop.mBlocks.size(); b++) {
+      mBlocks[loop.mBlocks[b]].mLoop = by_size[i].second;
+      mBlocks[loop.mBlocks[b]].mLoopDepth = loop.mDepth;
+    }
+  }
+}
+
+// Find each loop's exits and its preheader edge: the one edge into the header from outside the
+// loop.  A loop has none if more than one block outside it leads to its header.
+void CControlFlowGraph::FindPreheaders(ICArray & ica)
+{
+  for (int l = 0; l < (int) mLoops.size(); l++) {
+    CLoop & loop = mLoops[l];
+    for (int i = 0; i < (int) loop.mBlocks.size(); i++) {
+      const CBasicBlock & block = mBlocks[loop.mBlocks[i]];
+      if (block.mIsCall) loop.mHasCall = true;
+      for (int s = 0; s < (int) block.mSuccs.size(); s++) {
+        if (!InLoop(block.mSuccs[s], l)) AddEdge(loop.mExits, block.mSuccs[s]);
+      }
+    }
+
+    const std::vector<int> & preds = mBlocks[loop.mHeader].mPreds;
+    int preheader = -1;
+    for (int p = 0; p < (int) preds.size(); p++) {
+      if (InLoop(preds[p], l)) continue;
+      if (preheader != -1) { preheader = -1; break; }
+      preheader = preds[p];
+    }
+    if (preheader == -1) continue;
+
+    // Falling into the header from just above it (as a while loop does), lines placed in front
+    // of the header's label run only on that edge; back edges jump to the label.  Otherwise the
+    // preheader must lead nowhere else, and they go at its bottom.
+    const CBasicBlock & info = mBlocks[preheader];
+    int last_op = ica.GetEntry(info.mLastLine)->GetOpcode();
+    bool jumps_to_header = Opcode::IsJump(last_op)
+      && (last_op == Opcode::JUMP || info.mSuccs.size() == 1);
+    if (preheader + 1 == loop.mHeader && !jumps_to_header) {
+      loop.mPreheaderLine = mBlocks[loop.mHeader].mFirstLine;
+    }
+    else if (info.mSuccs.size() == 1) {
+      loop.mPreheaderLine = Opcode::IsJump(last_op) ? info.mLastLine : info.mLastLine + 1;
+    }
+  }
+}
+
+bool CControlFlowGraph::InLoop(int block, int loop) const
+{
+  for (int l = mBlocks[block].mLoop; l != -1; l = mLoops[l].mParent) {
+    if (l == loop) return true;
+  }
+  return false;
+}
+
+bool CControlFlowGraph::Dominates(int block1, int block2) const
+{
+  if (!IsReachable(block1) || !IsReachable(block2)) return false;
+  return mTreeEnter[block1] <= mTreeEnter[block2] && mTreeExit[block2] <= mTreeExit[block1];
+}
+
+// Is line1 certain to have run before line2 is reached?
+bool CControlFlowGraph::DominatesLine(int line1, int line2) const
+{
+  int block1 = mBlockOf[line1], block2 = mBlockOf[line2];
+  if (block1 == block2) return IsReachable(block1) && line1 <= line2;
+  return Dominates(block1, block2);
+}
@@ -0,0 +1,107 @@
+#ifndef CFG_H
+#define CFG_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  The classes in this file describe the control flow of the intermediate code in an ICArray.
+//
+//  CBasicBlock holds one maximal straight-line run of IC entries: it begins at a label (or right
+//  after a jump) and ends with a jump or just before the next label.
+//
+//  CLoop holds one natural loop: its header block, every block in its body, its parent loop,
+//  and where code can be put so that it runs once each time the loop is entered (its preheader).
+//
+//  CControlFlowGraph splits an ICArray into basic blocks and links them up.  Function calls
+//  ("val_copy return_pointN sR; jump function_X; return_pointN:") produce two kinds of edges:
+//    * Successors/predecessors are the real transfers of control, including the edges from each
+//      "jump sR" back to every return point that was stored in sR.  Use these for dataflow.
+//    * Dominators and loops are found on a view where a call instead has an edge to its own
+//      return point and the "jump sR" has none; a return can only ever land after a call that
+//      was made, so this view is both tighter and still sound.
+//
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ic.h"
+
+class CBasicBlock {
+public:
+  int mFirstLine;               // First IC line in this block.
+  int mLastLine;                // Last IC line in this block (inclusive).
+  std::vector<int> mSuccs;      // Blocks that control can go to next.
+  std::vector<int> mPreds;      // Blocks that control can come from.
+  std::vector<int> mDomSuccs;   // Successors in the call-summary view used for dominators.
+  std::vector<int> mDomPreds;
+  int mIDom;                    // Immediate dominator (-1 for the entry and unreachable blocks).
+  std::vector<int> mDomChildren;
+  int mLoop;                    // Innermost loop containing this block (-1 if none).
+  int mLoopDepth;               // Number of loops this block is nested inside.
+  bool mIsCall;                 // Does this block end by calling a function?
+
+  CBasicBlock(int first, int last)
+    : mFirstLine(first), mLastLine(last), mIDom(-1), mLoop(-1), mLoopDepth(0), mIsCall(false) { ; }
+  ~CBasicBlock() { ; }
+};
+
+class CLoop {
+public:
+  int mHeader;                  // Block that every back edge of this loop returns to.
+  std::vector<int> mBlocks;     // All blocks in the loop (header included), in line order.
+  int mParent;                  // Enclosing loop (-1 if outermost).
+  int mDepth;                   // 1 for an outermost loop.
+  std::vector<int> mExits;      // Blocks outside the loop that its exit edges go to.
+  bool mHasCall;                // Does any block in the loop call a function?
+  int mPreheaderLine;           // Line to insert in front of to run on entry (-1 if none).
+
+  CLoop(int header) : mHeader(header), mParent(-1), mDepth(1), mHasCall(false), mPreheaderLine(-1) { ; }
+  ~CLoop() { ; }
+};
+
+class CControlFlowGraph {
+private:
+  std::vector<CBasicBlock> mBlocks;
+  std::vector<CLoop> mLoops;
+  std::vector<int> mBlockOf;         // Block that each IC line belongs to.
+  std::vector<int> mDomOrder;        // Reachable blocks in reverse postorder (dominator view).
+  std::vector<int> mDomIndex;        // Position of each block in mDomOrder (-1 if unreachable).
+  std::vector<int> mTreeEnter;       // Pre- and post-order numbers in the dominator tree,
+  std::vector<int> mTreeExit;        //   for constant-time dominance queries.
+
+  void FindBlocks(ICArray & ica);
+  void FindEdges(ICArray & ica);
+  void FindDominators();
+  void FindLoops();
+  void FindPreheaders(ICArray & ica);
+
+  static void AddEdge(std::vector<int> & edges, int block);
+
+public:
+  CControlFlowGraph() { ; }
+  ~CControlFlowGraph() { ; }
+
+  // (Re)build the graph for the current contents of the ICArray.
+  void Build(ICArray & ica);
+
+  int GetNumBlocks() const { return mBlocks.size(); }
+  const CBasicBlock & GetBlock(int id) const { return mBlocks[id]; }
+  int GetBlockOf(int line) const { return mBlockOf[line]; }
+
+  int GetNumLoops() const { return mLoops.size(); }
+  const CLoop & GetLoop(int id) const { return mLoops[id]; }
+  bool InLoop(int block, int loop) const;   // Is the block in this loop or one nested in it?
+
+  // Reachable blocks, ordered so that every block comes after its dominators.
+  const std::vector<int> & GetDomOrder() const { return mDomOrder; }
+
+  bool IsReachable(int block) const { return mDomIndex[block] != -1; }
+  bool Dominates(int block1, int block2) const;
+  bool DominatesLine(int line1, int line2) const;
+  int GetLoopDepth(int line) const { return mBlocks[mBlockOf[line]].mLoopDepth; }
+
+  // Which argument of a jump instruction holds its target.
+  static int JumpTargetArg(int op);
+};
+
+#endif
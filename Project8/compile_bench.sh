@@ -0,0 +1,173 @@
+#! /bin/bash
+
+# This file can be executed by calling
+#   "bash compile_bench.sh [-s shape] [-d depth] [-t seconds] [-g] [sizes...]"
+# It generates synthetic Tube programs of the given sizes (default: 1000 5000
+# 20000 50000), compiles each one with "tube8 -time-report", and reports how
+# long every phase of the compile took, along with source lines/sec and IC
+# entries/sec over the whole compile.  It is meant for spotting super-linear
+# behavior in the compiler (e.g. in OptimizeIC).
+#
+# Shapes (-s, default branches; "all" runs each in turn); size is the number of
+# statement groups the generator writes:
+#   branches   straight-line code with if statements and small while loops
+#   straight   long chains of arithmetic on fresh variables
+#   nested     groups of if/while blocks nested -d levels deep (default 16)
+#   functions  many functions, all declared up front and defined at the end,
+#              each calling the one before it
+#   strings    string variables holding literals of a few hundred characters
+#   arrays     arrays resized, filled, summed and copied in while loops
+#
+# A compile that runs longer than -t seconds (default 120) is stopped and
+# reported as timed out.  With -g the program for the first size is written to
+# stdout instead.
+project=tube8
+shape=branches
+depth=16
+time_limit=120
+generate_only=0
+while getopts "s:d:t:g" opt; do
+	case $opt in
+		s) shape=$OPTARG ;;
+		d) depth=$OPTARG ;;
+		t) time_limit=$OPTARG ;;
+		g) generate_only=1 ;;
+		*) exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+sizes="$@"
+if [ -z "$sizes" ]; then
+	sizes="1000 5000 20000 50000"
+fi
+shapes=$shape
+if [ "$shape" == "all" ]; then
+	shapes="branches straight nested functions strings arrays"
+fi
+
+function generate {
+	awk -v n=$2 -v depth=$depth -v shape=$1 '
+	function branches(i) {
+		print "int v" i " = random(10) + " i % 13 ";";
+		print "v" i " = v" i " * 3 + 2 * 4;";
+		if (i % 5 == 0) print "if (v" i " > 20) total = total + v" i ";";
+		if (i % 50 == 0) print "int c" i " = 0; while (c" i " < 3) { c" i " = c" i " + 1; total = total + c" i "; }";
+	}
+	function straight(i) {
+		if (i == 0) { print "int v0 = random(10);"; return; }
+		print "int v" i " = v" i - 1 " * " i % 7 + 2 " - " i % 11 " + v" int(i / 2) " / " i % 5 + 1 ";";
+		print "v" i " = (v" i " + total) % 1000 - v" i - 1 " * 2;";
+		if (i % 20 == 0) print "total = total + v" i ";";
+	}
+	function nested(i,   d, pad, line) {
+		pad = "";
+		print "{ int d" i "_0 = random(5);";
+		for (d = 1; d < depth; d++) {
+			pad = pad "  ";
+			if (d % 2 == 1) print pad "if (d" i "_" d - 1 " >= 0) { int d" i "_" d " = d" i "_" d - 1 " + 1;";
+			else print pad "while (d" i "_" d - 1 " < " d + 2 ") { d" i "_" d - 1 " = d" i "_" d - 1 " + 1; int d" i "_" d " = d" i "_" d - 1 " * 2;";
+		}
+		print pad "  total = total + d" i "_" depth - 1 ";";
+		line = "";
+		for (d = 0; d < depth; d++) line = line "}";
+		print line;
+	}
+	function string_literal(i, len,   s, k) {
+		s = "";
+		for (k = 0; k < len; k++) s = s sprintf("%c", 97 + (i + k * 7) % 26);
+		return "\"" s "\"";
+	}
+	function strings(i) {
+		print "string s" i " = " string_literal(i, 200 + (i * 37) % 600) ";";
+		print "s" i "[" i % 200 "] = \x27Q\x27;";
+		print "total = total + s" i ".size();";
+		if (i % 3 == 0) print "if (s" i "[" i % 200 "] == \x27Q\x27) total = total + 1;";
+		if (i % 10 == 0) print "string t" i " = s" i "; print t" i ";";
+	}
+	function arrays(i) {
+		print "array(int) a" i ";";
+		print "a" i ".resize(" 8 + i % 24 ");";
+		print "int i" i " = 0;";
+		print "while (i" i " < a" i ".size()) { a" i "[i" i "] = i" i " * " i % 9 + 1 " + total % 7; i" i " = i" i " + 1; }";
+		print "i" i " = 1;";
+		print "while (i" i " < a" i ".size()) { a" i "[i" i "] = a" i "[i" i "] + a" i "[i" i " - 1]; i" i " = i" i " + 1; }";
+		print "total = total + a" i "[a" i ".size() - 1] % 100;";
+		if (i % 4 == 0) print "array(int) b" i " = a" i "; b" i ".resize(b" i ".size() + 2); total = total + b" i "[" i % 8 "];";
+	}
+	BEGIN {
+		if (shape == "functions") {
+			for (i = 0; i < n; i++) print "declare int f" i "(int a, int b);";
+		}
+		print "int total = 0;";
+		for (i = 0; i < n; i++) {
+			if (shape == "branches") branches(i);
+			else if (shape == "straight") straight(i);
+			else if (shape == "nested") nested(i);
+			else if (shape == "strings") strings(i);
+			else if (shape == "arrays") arrays(i);
+			else if (shape == "functions" && i % 10 == 0) print "total = total + f" i "(total % 5, " i % 13 ");";
+		}
+		print "print total;";
+		if (shape != "functions") exit;
+		for (i = 0; i < n; i++) {
+			print "define int f" i "(int a, int b) {";
+			print "  int r = a * " i % 7 + 1 " + b;";
+			print "  if (r > " i % 20 " && a < b) { r = r - b; } else { r = r + 1; }";
+			if (i % 10 != 0) print "  r = r + f" i - 1 "(b % 3, a);";
+			print "  return r % 1000;";
+			print "}";
+		}
+	}'
+}
+
+if [ $generate_only -eq 1 ]; then
+	generate $shapes ${sizes%% *}
+	exit 0
+fi
+
+if [ ! -f $project ]; then
+	make
+fi
+if [ ! -f $project ]; then
+	echo $project "not correctly compiled";
+	exit 1;
+fi;
+
+# Per-phase wall ms from the -time-report table; the optimize sub-phases are summed.
+function phase_ms {
+	awk -v p="$1" '
+		NF >= 6 && $1 != "phase" {
+			name = $1; for (i = 2; i <= NF - 5; i++) name = name " " $i;
+			if (name == p || index(name, p ":") == 1) ms += $(NF-4);
+		}
+		END { printf "%.2f", ms }' bench.time
+}
+
+printf "%-10s %8s %9s %10s %9s %9s %9s %9s %9s %10s %12s %12s\n" shape size lines ic_entries \
+	parse_ms ast_ic_ms opt_ms alloc_ms emit_ms total_ms lines/sec ic/sec
+for shape in $shapes; do
+	for size in $sizes; do
+		generate $shape $size > bench.tube
+		lines=$(wc -l < bench.tube)
+		timeout $time_limit ./$project -time-report bench.tube bench.tca > bench.cout 2> bench.time
+		status=$?
+		if [ $status -eq 124 ]; then
+			echo "$shape $size: timed out after $time_limit seconds"
+			continue
+		fi
+		if [ $status -ne 0 ] || grep -Fq "ERROR" bench.cout; then
+			echo "$shape $size: did not compile:"
+			grep -F "ERROR" bench.cout | head -3
+			continue
+		fi
+		ic=$(awk '/^IC entries before optimize/ { print $NF }' bench.time)
+		total=$(phase_ms total)
+		awk -v sh=$shape -v s=$size -v l=$lines -v ic=$ic -v t=$total \
+			-v p=$(phase_ms parse) -v a=$(phase_ms "AST -> IC") -v o=$(phase_ms optimize) \
+			-v r=$(phase_ms "register allocation") -v e=$(phase_ms "emit TubeCode") 'BEGIN {
+			if (t <= 0) t = 0.01;
+			printf "%-10s %8d %9d %10d %9.1f %9.1f %9.1f %9.1f %9.1f %10.1f %12.0f %12.0f\n",
+				sh, s, l, ic, p, a, o, r, e, t, l * 1000 / t, ic * 1000 / t }'
+	done
+done
+rm -f bench.tube bench.tca bench.cout bench.time
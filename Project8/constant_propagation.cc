@@ -0,0 +1,251 @@
+#include "constant_propagation.h"
+#include "cfg.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN CConstantPropagation
+ *****************************************/
+
+// Work out "a op b" the way TubeIC does; false if it would be an error (division by zero).
+static bool Fold(int op, int a, int b, int & result)
+{
+  switch (op) {
+  case Opcode::ADD:       result = (int) ((unsigned int) a + (unsigned int) b); return true;
+  case Opcode::SUB:       result = (int) ((unsigned int) a - (unsigned int) b); return true;
+  case Opcode::MULT:      result = (int) ((unsigned int) a * (unsigned int) b); return true;
+  case Opcode::DIV:
+    if (b == 0) return false;
+    result = (b == -1) ? (int) (0u - (unsigned int) a) : a / b;
+    return true;
+  case Opcode::MOD:
+    if (b == 0) return false;
+    result = (b == -1) ? 0 : a % b;
+    return true;
+  case Opcode::TEST_LESS: result = a < b;  return true;
+  case Opcode::TEST_GTR:  result = a > b;  return true;
+  case Opcode::TEST_EQU:  result = a == b; return true;
+  case Opcode::TEST_NEQU: result = a != b; return true;
+  case Opcode::TEST_LTE:  result = a <= b; return true;
+  case Opcode::TEST_GTE:  result = a >= b; return true;
+  }
+  return false;
+}
+
+// The constant an operand holds in this state (a NONE operand if it is not known).
+ICOperand CConstantPropagation::Value(const State & state, const ICOperand & arg)
+{
+  if (arg.IsConst()) return arg;
+  if (!arg.IsScalar()) return ICOperand();
+  State::const_iterator it = state.find(arg.GetID());
+  return (it == state.end()) ? ICOperand() : it->second;
+}
+
+// Update the state for everything one line writes.
+void CConstantPropagation::Transfer(const ICEntry * entry, State & state)
+{
+  int op = entry->GetOpcode();
+  ICOperand result;
+  if (op == Opcode::VAL_COPY) result = Value(state, entry->GetOperand(0));
+  else if (Opcode::IsMath(op)) {
+    ICOperand in0 = Value(state, entry->GetOperand(0));
+    ICOperand in1 = Value(state, entry->GetOperand(1));
+    int value = 0;
+    if (in0.IsImmediate() && in1.IsImmediate() && Fold(op, in0.GetValue(), in1.GetValue(), value)) {
+      result = ICOperand::Int(value);
+    }
+    else if (op == Opcode::MULT && (in0 == ICOperand::Int(0) || in1 == ICOperand::Int(0))) {
+      result = ICOperand::Int(0);
+    }
+  }
+
+  for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+    if (!Opcode::IsArgWritten(op, i)) continue;
+    if (result.IsNone()) state.erase(entry->GetArgID(i));
+    else state[entry->GetArgID(i)] = result;
+  }
+}
+
+// The blocks control can go to from the end of 'block', given the state there.
+void CConstantPropagation::FindSuccs(ICArray & ica, int block, const State & state,
+                                     std::vector<int> & succs) const
+{
+  const CBasicBlock & info = mCFG->GetBlock(block);
+  succs = info.mSuccs;
+  const ICEntry * last = ica.GetEntry(info.mLastLine);
+  int op = last->GetOpcode();
+  if (!Opcode::IsJump(op)) return;
+
+  if (op != Opcode::JUMP) {
+    ICOperand test = Value(state, last->GetOperand(0));
+    if (!test.IsImmediate()) return;
+    bool taken = (op == Opcode::JUMP_IF_0) == (test.GetValue() == 0);
+    if (!taken) {
+      succs.assign(1, block + 1);
+      return;
+    }
+  }
+  ICOperand target = Value(state, last->GetOperand(CControlFlowGraph::JumpTargetArg(op)));
+  if (!target.IsLabel()) return;
+  std::map<int, int>::const_iterator it = mLabelBlock.find(target.GetValue());
+  if (it != mLabelBlock.end()) succs.assign(1, it->second);
+}
+
+// The constants entering a block: those every executable edge into it agrees on.
+void CConstantPropagation::MeetIn(int block, State & state) const
+{
+  state.clear();
+  if (block == 0) return;  // Nothing is known on entry to the program.
+  bool first = true;
+  const std::vector<int> & preds = mCFG->GetBlock(block).mPreds;
+  for (int p = 0; p < (int) preds.size(); p++) {
+    if (mEdges.count(std::make_pair(preds[p], block)) == 0) continue;
+    const State & out = mOut[preds[p]];
+    if (first) {
+      state = out;
+      first = false;
+      continue;
+    }
+    for (State::iterator it = state.begin(); it != state.end(); ) {
+      State::const_iterator other = out.find(it->first);
+      if (other == out.end() || other->second != it->second) state.erase(it++);
+      else ++it;
+    }
+  }
+}
+
+void CConstantPropagation::Solve(ICArray & ica)
+{
+  int num_blocks = mCFG->GetNumBlocks();
+  mOut.assign(num_blocks, State());
+  mExecuted.assign(num_blocks, false);
+  std::vector<int> worklist(1, 0);
+  std::vector<bool> on_worklist(num_blocks, false);
+  on_worklist[0] = true;
+
+  while (worklist.size() > 0) {
+    int block = worklist.back();
+    worklist.pop_back();
+    on_worklist[block] = false;
+
+    State state;
+    MeetIn(block, state);
+    const CBasicBlock & info = mCFG->GetBlock(block);
+    for (int line = info.mFirstLine; line <= info.mLastLine; line++) {
+      Transfer(ica.GetEntry(line), state);
+    }
+    std::vector<int> succs;
+    FindSuccs(ica, block, state, succs);
+
+    // Only scalars that other blocks use need to be passed on.
+    for (State::iterator it = state.begin(); it != state.end(); ) {
+      if (!mGlobal[it->first]) state.erase(it++);
+      else ++it;
+    }
+    bool changed = !mExecuted[block] || state != mOut[block];
+    mExecuted[block] = true;
+    mOut[block].swap(state);
+
+    for (int s = 0; s < (int) succs.size(); s++) {
+      bool new_edge = mEdges.insert(std::make_pair(block, succs[s])).second;
+      if ((new_edge || changed) && !on_worklist[succs[s]]) {
+        on_worklist[succs[s]] = true;
+        worklist.push_back(succs[s]);
+      }
+    }
+  }
+}
+
+void CConstantPropagation::Rewrite(ICArray & ica)
+{
+  for (int block = 0; block < mCFG->GetNumBlocks(); block++) {
+    const CBasicBlock & info = mCFG->GetBlock(block);
+    if (!mExecuted[block]) {
+      for (int line = info.mFirstLine; line <= info.mLastLine; line++) {
+        ica.GetEntry(line)->SetDelete(true);
+        mNumChanged++;
+      }
+      continue;
+    }
+
+    State state;
+    MeetIn(block, state);
+    for (int line = info.mFirstLine; line <= info.mLastLine; line++) {
+      ICEntry * entry = ica.GetEntry(line);
+      int op = entry->GetOpcode();
+      for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+        if (!entry->IsScalarArg(i) || Opcode::IsArgWritten(op, i)) continue;
+        ICOperand value = Value(state, entry->GetOperand(i));
+        if (value.IsNone()) continue;
+        // Labels only make sense where code addresses go.
+        if (value.IsLabel() && op != Opcode::VAL_COPY && !Opcode::IsJump(op)) continue;
+        entry->SetOperand(i, value);
+        mNumChanged++;
+      }
+      Transfer(entry, state);
+    }
+
+    // A branch on a known condition always goes the same way.
+    ICEntry * last = ica.GetEntry(info.mLastLine);
+    int op = last->GetOpcode();
+    if ((op == Opcode::JUMP_IF_0 || op == Opcode::JUMP_IF_N0) && last->GetOperand(0).IsImmediate()) {
+      bool taken = (op == Opcode::JUMP_IF_0) == (last->GetOperand(0).GetValue() == 0);
+      if (taken) last->SetInstruction(Opcode::JUMP, last->GetOperand(1), ICOperand());
+      else last->SetDelete(true);
+      mNumChanged++;
+    }
+  }
+
+  // Keep the labels of dead blocks that live code still names (eg, as a return address).
+  std::set<int> named;
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (entry->GetOperand(i).IsLabel()) named.insert(entry->GetOperand(i).GetValue());
+    }
+  }
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    if (!entry->GetDelete() || entry->GetLabel() == "") continue;
+    if (named.count(ICOperand::InternLabel(entry->GetLabel())) == 0) continue;
+    entry->SetInstruction(Opcode::NONE, ICOperand(), ICOperand());
+    entry->SetDelete(false);
+    mNumChanged--;
+  }
+}
+
+int CConstantPropagation::Run(ICArray & ica)
+{
+  mNumChanged = 0;
+  if (ica.GetNumEntries() == 0) return 0;
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  mCFG = &cfg;
+
+  int num_lines = ica.GetNumEntries();
+  int num_scalars = 0;
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (entry->IsScalarArg(i)) num_scalars = std::max(num_scalars, entry->GetArgID(i) + 1);
+    }
+  }
+  std::vector<int> first_block(num_scalars, -1);
+  mGlobal.assign(num_scalars, false);
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    int block = cfg.GetBlockOf(line);
+    if (entry->GetLabel() != "") mLabelBlock[ICOperand::InternLabel(entry->GetLabel())] = block;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!entry->IsScalarArg(i)) continue;
+      int id = entry->GetArgID(i);
+      if (first_block[id] == -1) first_block[id] = block;
+      else if (first_block[id] != block) mGlobal[id] = true;
+    }
+  }
+
+  Solve(ica);
+  Rewrite(ica);
+  return mNumChanged;
+}
@@ -0,0 +1,62 @@
+#ifndef CONSTANT_PROPAGATION_H
+#define CONSTANT_PROPAGATION_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CConstantPropagation is conditional constant propagation in the style of Wegman and Zadeck's
+//  SCCP: it finds which scalars hold a known constant at each point of an ICArray, and which
+//  blocks can run at all, solving both together so that each sharpens the other.
+//    * A block is only looked at once some edge into it can be taken, and a branch whose
+//      condition is known only makes the edge it takes executable.  Code behind "if (0)" never
+//      runs, so nothing it writes reaches the rest of the program.
+//    * The value of a scalar entering a block is the meet over the executable edges into it:
+//      a constant if every one of them brings the same constant, otherwise unknown.  Loops are
+//      entered optimistically and values only drop to unknown once a back edge disagrees.
+//    * Scalars start out unknown (TubeIC and TubeCode start memory at different values), as do
+//      the results of array reads, random and pop.  Return addresses are constants too, so a
+//      function called from one place returns only there.
+//
+//  Afterwards, known scalars are replaced by their constants, branches on known conditions
+//  become jumps (or disappear), and blocks that can never run are deleted along with their
+//  labels, unless a live line still names the label.
+//
+//  This works on basic blocks rather than SSA names: each block keeps the constants it passes
+//  on, for just the scalars used in more than one block.
+//
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ic.h"
+
+class CControlFlowGraph;
+
+class CConstantPropagation {
+private:
+  typedef std::map<int, ICOperand> State;     // Scalar ID -> its constant (absent: unknown).
+
+  const CControlFlowGraph * mCFG;
+  std::vector<bool> mGlobal;                 // Scalar ID -> is it used in more than one block?
+  std::map<int, int> mLabelBlock;            // Label ID -> block it starts.
+  std::vector<State> mOut;                   // Block -> constants leaving it.
+  std::vector<bool> mExecuted;               // Block -> has it been reached?
+  std::set<std::pair<int, int> > mEdges;     // Executable edges (from block, to block).
+  int mNumChanged;
+
+  static ICOperand Value(const State & state, const ICOperand & arg);
+  static void Transfer(const ICEntry * entry, State & state);
+  void FindSuccs(ICArray & ica, int block, const State & state, std::vector<int> & succs) const;
+  void MeetIn(int block, State & state) const;
+  void Solve(ICArray & ica);
+  void Rewrite(ICArray & ica);
+
+public:
+  CConstantPropagation() : mCFG(NULL), mNumChanged(0) { ; }
+  ~CConstantPropagation() { ; }
+
+  // Propagate constants and remove dead branches; returns how many lines changed.
+  int Run(ICArray & ica);
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "dead_code.h"
+#include "cfg.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN CDeadCodeElimination
+ *****************************************/
+
+// Number the array elements that at least two lines store to.
+void CDeadCodeElimination::FindElements(ICArray & ica, int num_ids)
+{
+  int num_lines = ica.GetNumEntries();
+  // Array -> the index (kind and value) and line of each store to it.
+  std::vector<std::vector<std::pair<std::pair<int, int>, int> > > stores(num_ids);
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete() || entry->GetOpcode() != Opcode::AR_SET_IDX) continue;
+    if (!mCFG->IsReachable(mCFG->GetBlockOf(line))) continue;
+    ICOperand index = entry->GetOperand(1);
+    if (index.IsImmediate()) index = ICOperand::Int(index.GetValue());
+    stores[entry->GetArgID(0)].push_back(
+        std::make_pair(std::make_pair(index.GetKind(), index.GetValue()), line));
+  }
+
+  mElements.clear();
+  mLineElement.assign(num_lines, -1);
+  for (int array = 0; array < num_ids; array++) {
+    std::vector<std::pair<std::pair<int, int>, int> > & lines = stores[array];
+    std::sort(lines.begin(), lines.end());
+    for (int first = 0, last; first < (int) lines.size(); first = last) {
+      for (last = first + 1; last < (int) lines.size(); last++) {
+        if (lines[last].first != lines[first].first) break;
+      }
+      if (last - first < 2) continue;
+      for (int i = first; i < last; i++) mLineElement[lines[i].second] = mElements.size();
+      CElement element = { array, ICOperand(lines[first].first.first, lines[first].first.second) };
+      mElements.push_back(element);
+    }
+  }
+}
+
+// Which elements of the current chunk could this line read, or stop a later store from
+// matching (by changing an index)?
+CDeadCodeElimination::Bits CDeadCodeElimination::LineReads(const ICEntry * entry, Bits all) const
+{
+  int op = entry->GetOpcode();
+  Bits reads = 0;
+  for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+    if (Opcode::IsArgWritten(op, i)) reads |= mScalarMask[entry->GetArgID(i)];
+  }
+  switch (op) {
+  case Opcode::AR_GET_IDX:
+  case Opcode::AR_SET_SIZE:
+  case Opcode::AR_PUSH:
+  case Opcode::AR_POP:
+  case Opcode::AR_GET_PTR:
+    reads |= mArrayMask[entry->GetArgID(0)];
+    break;
+  case Opcode::AR_COPY:
+    reads |= mArrayMask[entry->GetArgID(0)] | mArrayMask[entry->GetArgID(1)];
+    break;
+  case Opcode::PTR_GET:
+  case Opcode::PTR_SET:
+    reads = all;  // Could be any element of any array.
+    break;
+  }
+  return reads;
+}
+
+// Find the dead stores among elements first_element .. first_element + 63.
+void CDeadCodeElimination::SolveChunk(ICArray & ica, int first_element)
+{
+  int num_blocks = mCFG->GetNumBlocks();
+  int chunk_size = std::min(BitChunk::SIZE, (int) mElements.size() - first_element);
+  Bits all = BitChunk::Mask(first_element, mElements.size());
+  const std::vector<int> & order = mCFG->GetDomOrder();
+
+  std::fill(mScalarMask.begin(), mScalarMask.end(), 0);
+  std::fill(mArrayMask.begin(), mArrayMask.end(), 0);
+  for (int i = 0; i < chunk_size; i++) {
+    const CElement & element = mElements[first_element + i];
+    Bits bit = 1ULL << i;
+    mArrayMask[element.mArray] |= bit;
+    if (element.mIndex.IsScalar()) mScalarMask[element.mIndex.GetID()] |= bit;
+  }
+
+  // Per block: elements stored to before anything reads them, and elements touched at all.
+  std::vector<Bits> stored(num_blocks, 0), touched(num_blocks, 0);
+  for (int i = 0; i < (int) order.size(); i++) {
+    const CBasicBlock & info = mCFG->GetBlock(order[i]);
+    Bits store = 0, touch = 0;
+    for (int line = info.mFirstLine; line <= info.mLastLine; line++) {
+      const ICEntry * entry = ica.GetEntry(line);
+      if (entry->GetDelete()) continue;
+      int element = mLineElement[line] - first_element;
+      if (element >= 0 && element < BitChunk::SIZE) {
+        Bits bit = 1ULL << element;
+        if (!(touch & bit)) store |= bit;
+        touch |= bit;
+      }
+      touch |= LineReads(entry, all);
+    }
+    stored[order[i]] = store;
+    touched[order[i]] = touch;
+  }
+
+  // Overwritten: stored to again on every path out of the block before being read.  Nothing
+  // is read once the program ends.
+  std::vector<Bits> over_in(num_blocks, all), over_out(num_blocks, all);
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = order.size() - 1; i >= 0; i--) {
+      int b = order[i];
+      const std::vector<int> & succs = mCFG->GetBlock(b).mSuccs;
+      Bits out = all;
+      for (int s = 0; s < (int) succs.size(); s++) {
+        if (mCFG->IsReachable(succs[s])) out &= over_in[succs[s]];
+      }
+      over_out[b] = out;
+      Bits in = stored[b] | (out & ~touched[b]);
+      if (in != over_in[b]) { over_in[b] = in; changed = true; }
+    }
+  }
+
+  // Walk each block backwards from what is overwritten at its end, dropping dead stores.
+  for (int i = 0; i < (int) order.size(); i++) {
+    const CBasicBlock & info = mCFG->GetBlock(order[i]);
+    Bits over = over_out[order[i]];
+    for (int line = info.mLastLine; line >= info.mFirstLine; line--) {
+      ICEntry * entry = ica.GetEntry(line);
+      if (entry->GetDelete()) continue;
+      int element = mLineElement[line] - first_element;
+      if (element >= 0 && element < BitChunk::SIZE) {
+        Bits bit = 1ULL << element;
+        if (over & bit) {
+          entry->SetDelete(true);
+          mNumRemoved++;
+          continue;
+        }
+        over |= bit;
+      }
+      over &= ~LineReads(entry, all);
+    }
+  }
+}
+
+// Can this line go, given what is live after it?  Only lines whose one effect is writing a
+// scalar that is not live.
+bool CDeadCodeElimination::IsDead(const ICEntry * entry) const
+{
+  int op = entry->GetOpcode();
+  if (Opcode::HasSideEffects(op)) return false;
+  for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+    if (Opcode::IsArgWritten(op, i)) return !mLive[entry->GetArgID(i)];
+  }
+  return false;
+}
+
+void CDeadCodeElimination::MarkLive(int id)
+{
+  if (mLive[id]) return;
+  mLive[id] = true;
+  mLiveList.push_back(id);
+}
+
+// Walk a block backwards from what its successors need, skipping (with 'remove', deleting)
+// the lines that are dead, and find what is live on entry to it.
+void CDeadCodeElimination::ScanBlock(ICArray & ica, int block, bool remove,
+                                     std::vector<int> & live_in)
+{
+  const CBasicBlock & info = mCFG->GetBlock(block);
+  mLiveList.clear();
+  for (int s = 0; s < (int) info.mSuccs.size(); s++) {
+    const std::vector<int> & live = mLiveIn[info.mSuccs[s]];
+    for (int i = 0; i < (int) live.size(); i++) MarkLive(live[i]);
+  }
+
+  for (int line = info.mLastLine; line >= info.mFirstLine; line--) {
+    ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    if (IsDead(entry)) {
+      if (remove) {
+        entry->SetDelete(true);
+        mNumRemoved++;
+      }
+      continue;
+    }
+    int op = entry->GetOpcode();
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (Opcode::IsArgWritten(op, i)) mLive[entry->GetArgID(i)] = false;
+    }
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (entry->IsScalarArg(i) && !Opcode::IsArgWritten(op, i)) MarkLive(entry->GetArgID(i));
+    }
+  }
+
+  // Collect (and clear) the marks; a scalar killed and marked again is listed twice.
+  live_in.clear();
+  for (int i = 0; i < (int) mLiveList.size(); i++) {
+    int id = mLiveList[i];
+    if (!mLive[id]) continue;
+    live_in.push_back(id);
+    mLive[id] = false;
+  }
+  std::sort(live_in.begin(), live_in.end());
+}
+
+// Live scalars grow from nothing until every block agrees with its successors; a block is
+// looked at again whenever what is live into one of its successors grows.
+void CDeadCodeElimination::SolveLiveness(ICArray & ica)
+{
+  int num_blocks = mCFG->GetNumBlocks();
+  const std::vector<int> & order = mCFG->GetDomOrder();
+  mLiveIn.assign(num_blocks, std::vector<int>());
+  std::vector<int> worklist(order.begin(), order.end());  // Popped from the back: last first.
+  std::vector<bool> on_worklist(num_blocks, false);
+  for (int i = 0; i < (int) order.size(); i++) on_worklist[order[i]] = true;
+
+  std::vector<int> live_in;
+  while (worklist.size() > 0) {
+    int block = worklist.back();
+    worklist.pop_back();
+    on_worklist[block] = false;
+    ScanBlock(ica, block, false, live_in);
+    if (live_in.size() == mLiveIn[block].size()) continue;
+    mLiveIn[block].swap(live_in);
+
+    const std::vector<int> & preds = mCFG->GetBlock(block).mPreds;
+    for (int p = 0; p < (int) preds.size(); p++) {
+      if (on_worklist[preds[p]] || !mCFG->IsReachable(preds[p])) continue;
+      on_worklist[preds[p]] = true;
+      worklist.push_back(preds[p]);
+    }
+  }
+}
+
+int CDeadCodeElimination::Run(ICArray & ica)
+{
+  mNumRemoved = 0;
+  if (ica.GetNumEntries() == 0) return 0;
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  mCFG = &cfg;
+
+  int num_ids = 0;
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      num_ids = std::max(num_ids, entry->GetArgID(i) + 1);
+    }
+  }
+
+  // Stores first: the index and value computations of the ones that go can then go too.
+  FindElements(ica, num_ids);
+  mScalarMask.assign(num_ids, 0);
+  mArrayMask.assign(num_ids, 0);
+  for (int first = 0; first < (int) mElements.size(); first += BitChunk::SIZE) {
+    SolveChunk(ica, first);
+  }
+
+  mLive.assign(num_ids, false);
+  SolveLiveness(ica);
+  std::vector<int> live_in;
+  const std::vector<int> & order = mCFG->GetDomOrder();
+  for (int i = 0; i < (int) order.size(); i++) ScanBlock(ica, order[i], true, live_in);
+  return mNumRemoved;
+}
@@ -0,0 +1,74 @@
+#ifndef DEAD_CODE_H
+#define DEAD_CODE_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CDeadCodeElimination removes lines whose results can never be seen, using dataflow over the
+//  whole CFG rather than counts of how often each variable is read.
+//    * Scalars: a line with no side effects is dead when the scalar it writes is not live after
+//      it, so a value overwritten on every path before it is read goes even though the
+//      variable is read elsewhere.  Liveness is solved with dead lines left out (only the
+//      reads of lines that stay count), so a chain of computations that only feed each other,
+//      like a counter nothing else looks at, goes in one pass.
+//    * Array stores: "ar_set_idx a i v" is dead when, on every path from it, the same element
+//      is stored to again (or the program ends) before anything could read it.  Elements only
+//      match with the same array and the same index operand, with no write to an index scalar
+//      in between; any line that reads the array, resizes it, or copies it to or from another
+//      array counts as a read of all of it.
+//
+//  Edges are the real ones (see cfg.h), so a function body reads whatever it reads after
+//  every call, and what a return reads counts at every return point.
+//
+//  Only elements stored to by two or more lines are tracked for stores; the vectors are 64
+//  bits wide and the problem is solved for 64 elements at a time.
+//
+
+#include <vector>
+
+#include "bit_chunk.h"
+#include "ic.h"
+
+class CControlFlowGraph;
+
+class CDeadCodeElimination {
+private:
+  typedef BitChunk::Bits Bits;
+
+  // An array element: the array plus the operand that indexes it.
+  struct CElement {
+    int mArray;
+    ICOperand mIndex;
+  };
+
+  const CControlFlowGraph * mCFG;
+  std::vector<CElement> mElements;       // Elements stored to by two or more lines.
+  std::vector<int> mLineElement;         // IC line -> element it stores to (-1 if none).
+
+  // Masks for the current chunk: which of its elements are indexed by each scalar, or lie in
+  // each array.
+  std::vector<Bits> mScalarMask;
+  std::vector<Bits> mArrayMask;
+
+  std::vector<std::vector<int> > mLiveIn;  // Block -> scalars live on entry (sorted).
+  std::vector<bool> mLive;               // While scanning a block: is each scalar live?
+  std::vector<int> mLiveList;            // The scalars marked in mLive (may repeat).
+  int mNumRemoved;
+
+  void FindElements(ICArray & ica, int num_ids);
+  Bits LineReads(const ICEntry * entry, Bits all) const;
+  void SolveChunk(ICArray & ica, int first_element);
+
+  bool IsDead(const ICEntry * entry) const;
+  void MarkLive(int id);
+  void ScanBlock(ICArray & ica, int block, bool remove, std::vector<int> & live_in);
+  void SolveLiveness(ICArray & ica);
+
+public:
+  CDeadCodeElimination() : mCFG(NULL), mNumRemoved(0) { ; }
+  ~CDeadCodeElimination() { ; }
+
+  // Delete dead stores and computations; returns how many lines were removed.
+  int Run(ICArray & ica);
+};
+
+#endif
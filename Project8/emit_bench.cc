@@ -0,0 +1,67 @@
+// Emit-throughput microbenchmark: "make emit_bench; ./emit_bench [lines] [output file]"
+//
+// Writes the same stream of TubeCode-like lines three ways and reports how fast each one is:
+//   * an ofstream ended with std::endl (a flush per line, as PrintTC used to do),
+//   * an ofstream ended with '\n', and
+//   * a CEmitter, written out with one call at the end.
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "emitter.h"
+
+// One "instruction" worth of output, in the shape PrintTC produces.
+template <class OUT, class END>
+static void EmitLine(OUT & out, int i, END end)
+{
+  out << "  load " << i % 20000 << " regA" << end;
+  out << "  add regA " << i << " regC" << end;
+  out << "  store regC " << (i * 7) % 20000 << end;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Report(const char * name, double seconds, const std::string & filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+  double mb = in.tellg() / (1024.0 * 1024.0);
+  std::cout << name << ": " << seconds << " s, " << mb / seconds << " MB/s" << std::endl;
+}
+
+int main(int argc, char * argv[])
+{
+  int num_lines = (argc > 1) ? atoi(argv[1]) : 1000000;
+  std::string filename = (argc > 2) ? argv[2] : "emit_bench.out";
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    std::ofstream ofs(filename.c_str());
+    for (int i = 0; i < num_lines; i++) EmitLine(ofs, i, std::endl<char, std::char_traits<char> >);
+  }
+  Report("ofstream + std::endl", Seconds(start), filename);
+
+  start = std::chrono::steady_clock::now();
+  {
+    std::ofstream ofs(filename.c_str());
+    for (int i = 0; i < num_lines; i++) EmitLine(ofs, i, '\n');
+  }
+  Report("ofstream + '\\n'     ", Seconds(start), filename);
+
+  start = std::chrono::steady_clock::now();
+  {
+    std::ofstream ofs(filename.c_str());
+    CEmitter out;
+    for (int i = 0; i < num_lines; i++) EmitLine(out, i, '\n');
+    out.WriteTo(ofs);
+  }
+  Report("CEmitter            ", Seconds(start), filename);
+
+  remove(filename.c_str());
+  return 0;
+}
@@ -0,0 +1,34 @@
+#include "emitter.h"
+
+/******************************************
+ * BEGIN CEmitter
+ *****************************************/
+
+CEmitter & CEmitter::operator<<(int value)
+{
+  char digits[12];
+  int pos = sizeof(digits);
+  unsigned int magnitude = (value < 0) ? 0u - (unsigned int) value : (unsigned int) value;
+  do {
+    digits[--pos] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0) digits[--pos] = '-';
+  mBuffer.append(digits + pos, sizeof(digits) - pos);
+  return *this;
+}
+
+void CEmitter::PadTo(int column)
+{
+  size_t line_start = mBuffer.rfind('\n');
+  line_start = (line_start == std::string::npos) ? 0 : line_start + 1;
+  int cur_column = mBuffer.size() - line_start;
+  if (cur_column < column) mBuffer.append(column - cur_column, ' ');
+}
+
+void CEmitter::WriteTo(std::ostream & ofs)
+{
+  ofs.write(mBuffer.data(), mBuffer.size());
+  ofs.flush();
+  mBuffer.clear();
+}
@@ -0,0 +1,40 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CEmitter collects the text of the output file (IC or TubeCode) in one large in-memory buffer
+//  and writes it out with a single call once everything has been generated.
+//
+//  It only knows how to append strings, chars and ints; ints are formatted by hand rather than
+//  through a stream.  Nothing is flushed until WriteTo() is called.
+//
+
+#include <ostream>
+#include <string>
+
+class CEmitter {
+private:
+  std::string mBuffer;
+
+public:
+  CEmitter(size_t reserve = 1 << 20) { mBuffer.reserve(reserve); }
+  ~CEmitter() { ; }
+
+  CEmitter & operator<<(char c) { mBuffer.push_back(c); return *this; }
+  CEmitter & operator<<(const char * str) { mBuffer.append(str); return *this; }
+  CEmitter & operator<<(const std::string & str) { mBuffer.append(str); return *this; }
+  CEmitter & operator<<(int value);
+  CEmitter & Append(const char * str, size_t length) { mBuffer.append(str, length); return *this; }
+
+  // Pad the current line with spaces out to the given column.
+  void PadTo(int column);
+
+  size_t GetSize() const { return mBuffer.size(); }
+  const std::string & GetText() const { return mBuffer; }
+
+  // Write everything collected so far in one go, and empty the buffer.
+  void WriteTo(std::ostream & ofs);
+};
+
+#endif
@@ -1,4 +1,80 @@
 #include "ic.h"
+#include "cfg.h"
+#include "constant_propagation.h"
+#include "jump_threading.h"
+#include "time_report.h"
+#include "lazy_code_motion.h"
+#include "load_forwarding.h"
+#include "loop_invariant.h"
+#include "ssa.h"
+#include "dead_code.h"
+#include "strength_reduction.h"
+#include "value_number.h"
+#include "tc_peephole.h"
+#include "tube_vm.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN ICOperand
+ *****************************************/
+
+std::vector<std::string> ICOperand::mLabelNames;
+std::map<std::string, int> ICOperand::mLabelIDs;
+
+int ICOperand::InternLabel(const std::string & name)
+{
+  std::map<std::string, int>::iterator it = mLabelIDs.find(name);
+  if (it != mLabelIDs.end()) return it->second;
+  int id = mLabelNames.size();
+  mLabelNames.push_back(name);
+  mLabelIDs[name] = id;
+  return id;
+}
+
+ICOperand ICOperand::FromLexeme(const std::string & lexeme)
+{
+  if (isdigit(lexeme[0]) || (lexeme[0] == '-' && lexeme.size() > 1)) {
+    return ICOperand(INT, atoi(lexeme.c_str()));
+  }
+  if (lexeme[0] == '\'' && lexeme.size() >= 3) {
+    if (lexeme[1] != '\\' || lexeme.size() == 3) return ICOperand(CHAR, lexeme[1]);
+    switch (lexeme[2]) {
+    case 'n': return ICOperand(CHAR, '\n');
+    case 't': return ICOperand(CHAR, '\t');
+    case 'v': return ICOperand(CHAR, '\v');
+    case 'a': return ICOperand(CHAR, '\a');
+    case '0': return ICOperand(CHAR, '\0');
+    default:  return ICOperand(CHAR, lexeme[2]);
+    }
+  }
+  return Label(lexeme);
+}
+
+void ICOperand::Emit(CEmitter & out) const
+{
+  switch (mKind) {
+  case SCALAR: out << 's' << mValue; break;
+  case ARRAY:  out << 'a' << mValue; break;
+  case INT:    out << mValue; break;
+  case LABEL:  out << mLabelNames[mValue]; break;
+  case CHAR:
+    if (mValue == '\n') out << "'\\n'";
+    else if (mValue == '\t') out << "'\\t'";
+    else if (mValue == '\\' || mValue == '\'') out << "'\\" << (char) mValue << '\'';
+    else if (isprint(mValue)) out << '\'' << (char) mValue << '\'';
+    else out << mValue;       // TubeCode takes any other char by its code.
+    break;
+  }
+}
+
+std::string ICOperand::AsString() const
+{
+  CEmitter out(16);
+  Emit(out);
+  return out.GetText();
+}
+
 /******************************************
  * BEGIN ICEntry
  *****************************************/
@@ -6,120 +82,124 @@
 bool first_run = true;
 int label_num = 0;
 
-void ICEntry::PrintIC(std::ostream & ofs)
-{
-  std::stringstream out_line;
+namespace {
+  // The TubeCode instruction with the same name as IC opcode 'op' (math, tests, jumps, output
+  // and random), or TubeOp::NUM_OPS if there is none.
+  int TubeOpFor(int op)
+  {
+    static std::vector<int> tube_ops;
+    if (tube_ops.size() == 0) {
+      for (int i = 0; i < Opcode::NUM_OPCODES; i++) tube_ops.push_back(TubeOp::FromString(Opcode::AsString(i)));
+    }
+    return tube_ops[op];
+  }
+}
 
+void ICEntry::PrintIC(CEmitter & out)
+{
   // If there is a label, include it in the output.
-  if (label != "") { out_line << label << ": "; }
-  else { out_line << "  "; }
-  out_line << " blockid: " << mBlockID << " ";
+  if (label != "") { out << label << ": "; }
+  else { out << "  "; }
+  out << " blockid: " << mBlockID << ' ';
   // If there is an instruction, print it and all its arguments.
-  if (mInst != "") {
-    out_line << mInst << " ";
-    for (int i = 0; i < (int) mArgs.size(); i++) {
-      out_line << mArgs[i]->AsString() << " ";
+  if (mOp != Opcode::NONE) {
+    out << Opcode::AsString(mOp) << ' ';
+    for (int i = 0; i < mNumArgs; i++) {
+      mArgs[i].Emit(out);
+      out << ' ';
     }
   }
 
   // If there is a comment, print it!
   if (comment != "") {
-    while (out_line.str().size() < 40) out_line << " "; // Align comments for easy reading.
-    out_line << "# " << comment;
+    out.PadTo(40);                 // Align comments for easy reading.
+    out << "# " << comment;
   }
 
-  ofs << out_line.str() << std::endl;
+  out << '\n';
 }
 
-bool ICEntry::OptimizeIC()
+bool ICEntry::HasScalarArg(int id) const
 {
-    variableTracker * tracker;
-    bool progress = false;
-    for (int i =0; i < GetNumArgs(); i++ ) {
-        if (mDelete) {
-            //check if entry should be deleted
-        }
-        if (mArgs[i]->IsScalar()) {
-            std::string name = mArgs[i]->AsString();
-            tracker = mArray->FindVariable(name);
-            if (tracker != NULL) {
-                if (tracker->replace != "") {
-                    delete mArgs[i];
-                    mArgs[i] = new ICArg_Const(tracker->replace);
-                    tracker->usedCount = tracker->usedCount - 1;
-                    progress = true;
-                }
-                else if (mSimplify && tracker->simplify != "") {
-                    mInst = "val_copy";
-                    mArgs.erase(mArgs.begin()+1);
-                    mArgs.erase(mArgs.begin());
-                    std::string simp = tracker->simplify;
-                    if(simp[0] != 's')
-                        mArgs.insert(mArgs.begin(),new ICArg_Const(simp));
-                    else {// == 's'
-                        std::string arg = simp.substr(1,simp.size()-1);
-                        int id = atoi(arg.c_str());
-                        mArgs.insert(mArgs.begin(),new ICArg_VarScalar(id));
-                    }
-
-                    progress = true;
-                    tracker->simplify = "";
-                    mSimplify = false;
-                    //std::cout << GetArg(0) << GetArg(1) << std::endl;
-                }
+  ICOperand var = ICOperand::Scalar(id);
+  for (int i = 0; i < mNumArgs; i++) {
+    if (mArgs[i] == var) return true;
+  }
+  return false;
+}
 
-            }
-        }
-    }
-    return progress;
+bool ICEntry::ReadsScalar(int id) const
+{
+  ICOperand var = ICOperand::Scalar(id);
+  for (int i = 0; i < mNumArgs; i++) {
+    if (mArgs[i] == var && !Opcode::IsArgWritten(mOp, i)) return true;
+  }
+  return false;
 }
-void ICEntry::TrackVariables()
+
+void ICEntry::ReplaceScalarArg(int id, const ICOperand & value)
 {
+  ICOperand var = ICOperand::Scalar(id);
+  for (int i = 0; i < mNumArgs; i++) {
+    if (mArgs[i] == var) mArgs[i] = value;
+  }
+}
 
-    for(int i =0; i < GetNumArgs(); i++ )
-    {
-        if(mArgs[i]->IsScalar())
-        {
-            std::string name = mArgs[i]->AsString();
-            variableTracker * tracker = mArray->FindVariable(name);
-            if (tracker != NULL)
-            {   //variable already has a tracker
-                tracker->lastLine = mLineNumber;
-                tracker->usedCount = tracker->usedCount + 1;
-                tracker->lastBlock = mBlockID;
-                if (tracker->firstBlock == tracker->lastBlock)
-                    tracker->local = true;
-
-                else tracker->local = false;
-                if ( mInst == "val_copy" && i==1 )
-                    tracker->SSA = false;
-            }
+void ICEntry::SetInstruction(int op, const ICOperand & arg0, const ICOperand & arg1)
+{
+  mOp = op;
+  mArgs[0] = arg0;
+  mArgs[1] = arg1;
+  mArgs[2] = ICOperand();
+  mNumArgs = Opcode::GetInfo(op).num_args;
+}
 
-            else
-            {   //new tracker
-                tracker = new variableTracker;
-                tracker->replace = "";
-                tracker->simplify  = "";
-                mArray->AddVariable(name, tracker);
+void ICEntry::SetToCopy(const ICOperand & value)
+{
+  ICOperand target = mArgs[mNumArgs - 1];
+  mOp = Opcode::VAL_COPY;
+  mArgs[0] = value;
+  mArgs[1] = target;
+  mNumArgs = 2;
+}
 
-                // first used here
-                tracker->firstLine = mLineNumber;
-                tracker->firstBlock = mBlockID;
+// The register the allocator gave a scalar argument (kind NONE if it lives in memory).
+CTCArg ICEntry::ArgHome(int position) const
+{
+  if (!mArgs[position].IsScalar()) return CTCArg();
+  std::string home = mArray->GetReg(mArgs[position].GetID());
+  return (home != "") ? CTCArg::Reg(home[3]) : CTCArg();
+}
 
-                // last used here
-                tracker->lastLine = mLineNumber;
-                tracker->lastBlock = mBlockID;
-                tracker->usedCount = 0;
-                tracker->local = true; //lastBlock = firstBlock
-                tracker->SSA = false;
+// Get an argument ready to be read, loading it into 'reg' if it is in memory; returns the
+// TubeCode argument to use for it.
+CTCArg ICEntry::ReadArg(CTubeCode & code, int position, char reg) const
+{
+  const ICOperand & arg = mArgs[position];
+  switch (arg.GetKind()) {
+  case ICOperand::INT:   return CTCArg::Number(arg.GetValue());
+  case ICOperand::CHAR:  return CTCArg::Char(arg.GetValue());
+  case ICOperand::LABEL: return CTCArg::Name(arg.GetValue());
+  case ICOperand::SCALAR: break;
+  default: return CTCArg();
+  }
+  CTCArg home = ArgHome(position);
+  if (home.mKind != CTCArg::NONE) return home;  // Already in its register.
+  code.AddInst(TubeOp::LOAD, Address(position), CTCArg::Reg(reg));
+  return CTCArg::Reg(reg);
+}
 
-                if(mInst == "val_copy" && i==1 )
-                    tracker->SSA = true;
+// Store a result computed into DestReg(position, reg) back to memory, if it lives there.
+void ICEntry::WriteArg(CTubeCode & code, int position, char reg) const
+{
+  if (!mArgs[position].IsScalar() || InRegister(position)) return;
+  code.AddInst(TubeOp::STORE, CTCArg::Reg(reg), Address(position));
+}
 
-            }
-        }
-    }
-    mArray->SetFirst(false);
+CTCArg ICEntry::DestReg(int position, char reg) const
+{
+  CTCArg home = ArgHome(position);
+  return (home.mKind != CTCArg::NONE) ? home : CTCArg::Reg(reg);
 }
 
 /*void ICEntry::EliminateDeadCode()
@@ -149,239 +229,257 @@ void ICEntry::TrackVariables()
         }
     }
 }*/
-void ICEntry::PrintTC(std::ostream & ofs)
+void ICEntry::PrintTC(CTubeCode & code)
 {
-    variableTracker * tracker ;
   if (first_run) {
-    ofs << "  store 20000 0" << std::endl;
-    ofs << "  val_copy 10000 regH" << std::endl;
+    code.AddInst(TubeOp::STORE, CTCArg::Number(20000), CTCArg::Number(0));
+    code.AddInst(TubeOp::VAL_COPY, CTCArg::Number(10000), CTCArg::Reg('H'));
     first_run = false;
   }
 
   // If there is a label, include it in the output.
   if (label != "") {
-    ofs << label << ": " << std::endl << "  nop" << std::endl;
+    code.AddLabel(CTCArg::Name(label));
+    code.AddInst(TubeOp::NOP);
   }
 
-  if (mInst != "") {
+  if (mOp != Opcode::NONE) {
     // Print intermediate code as comment
-    std::stringstream out_line;
-    out_line << "# " << mInst << " ";
-    for (int i = 0; i < (int) mArgs.size(); i++) {
-      out_line << mArgs[i]->AsString() << " ";
-    }
-    ofs << out_line.str() << std::endl;
-
-    if(mInst == "val_copy"){
-      //if(mArray->GetReg("regA") == (std::string) mArgs[0]->GetID())
-      //{
-      //}
-      mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
-      //mArgs[0]->SetReg('A');
-      //ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-     // mArray->AddVariable("regA", tracker);
-     //mArray->AddReg(mArgs[0]->GetID(),"regA");
-
-      ofs << "  val_copy " << mArgs[0]->AsAssemblyString() << " regB" << std::endl;
-      //mArray->AddReg( mArgs[0]->AsAssemblyString(), "regB");
-      mArgs[1]->AssemblyWrite(ofs, mArgs[1]->GetID(), 'B');
-      //mArray->AddReg(mArgs[1]->GetID(),);
-      //ofs << "  store regB " << mArgs[1]->GetID() << std::endl;
+    CEmitter & comment = code.AddComment();
+    comment << Opcode::AsString(mOp) << ' ';
+    for (int i = 0; i < mNumArgs; i++) {
+      mArgs[i].Emit(comment);
+      comment << ' ';
     }
-      //mArgs[0]->AssemblyWrite(ofs, mArgs[0]->GetID(), 'A');
-      //ofs << "  store regA " << mArgs[0]->GetID() << std::endl;
+    comment << '\n';
 
-      //mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
-      //mArgs[0]->SetReg('A');
-      //ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-
-    else if(mInst == "add" || mInst == "sub" || mInst == "mult" ||
-            mInst == "div" || mInst == "mod" || mInst == "test_less" ||
-            mInst == "test_gtr" || mInst == "test_equ" ||
-            mInst == "test_nequ" || mInst == "test_lte" ||
-            mInst == "test_lte" || mInst == "test_gte") {
-      mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
-      mArgs[1]->AssemblyRead(ofs, mArgs[1]->GetID(), 'B');
-      ofs << "  " << mInst << " " << mArgs[0]->AsAssemblyString() << " ";
-      ofs <<  mArgs[1]->AsAssemblyString() << " regC" << std::endl;
-      mArgs[2]->AssemblyWrite(ofs, mArgs[2]->GetID(), 'C');
-    }
-    else if(mInst == "jump" || mInst == "out_int" || mInst == "out_char") {
-      mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
-      ofs << "  " << mInst << " " << mArgs[0]->AsAssemblyString() << " " << std::endl;
-    }
-    else if(mInst == "jump_if_0" || mInst == "jump_if_n0") {
-      mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
-      mArgs[1]->AssemblyRead(ofs, mArgs[1]->GetID(), 'A');
-      ofs << "  " << mInst << " " << mArgs[0]->AsAssemblyString() << " ";
-      ofs <<  mArgs[1]->AsAssemblyString() << std::endl;
-    }
-    else if(mInst == "random") {
-      mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
-      ofs << "  " << mInst << " " << mArgs[0]->AsAssemblyString() << " ";
-      ofs << mArgs[1]->AsAssemblyString() << " regB" << std::endl;
-      mArgs[1]->AssemblyWrite(ofs, mArgs[1]->GetID(), 'B');
-    }
-    else if(mInst == "nop") {
-      ofs << "  nop" << std::endl;
-    }
-    else if(mInst == "push") {
-      mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
-      ofs << "  store regA regH" << std::endl;
-      ofs << "  add 1 regH regH" << std::endl;
-    }
-    else if(mInst == "pop") {
-      ofs << "  load regH regA" << std::endl;
-      mArgs[0]->AssemblyWrite(ofs, mArgs[0]->GetID(), 'A');
-      //ofs << "  store regA " << mArgs[0]->GetID() << std::endl;
-
-      ofs << "  sub regH 1 regH" << std::endl;
-    }
-    else if(mInst == "ar_push") {
-      mArgs[0]->AssemblyRead(ofs, mArgs[0]->GetID(), 'A');
+    int tube_op = TubeOpFor(mOp);
+    switch (Opcode::GetInfo(mOp).lowering) {
+    case Opcode::LOWER_COPY:
+      if (mArgs[0].IsScalar() && !InRegister(0) && !InRegister(1)) {
+        code.AddInst(TubeOp::MEM_COPY, Address(0), Address(1));
+      }
+      else {
+        CTCArg src = ReadArg(code, 0, 'A');
+        if (!InRegister(1)) {
+          code.AddInst(TubeOp::STORE, src, Address(1));
+        }
+        else if (src != DestReg(1, 'B')) {
+          code.AddInst(TubeOp::VAL_COPY, src, DestReg(1, 'B'));
+        }
+      }
+      break;
+    case Opcode::LOWER_BINARY: {
+      CTCArg in0 = ReadArg(code, 0, 'A');
+      CTCArg in1 = ReadArg(code, 1, 'B');
+      code.AddInst(tube_op, in0, in1, DestReg(2, 'A'));
+      WriteArg(code, 2, 'A');
+      break;
+    }
+    case Opcode::LOWER_OUTPUT: {
+      CTCArg in0 = ReadArg(code, 0, 'A');
+      code.AddInst(tube_op, in0);
+      break;
+    }
+    case Opcode::LOWER_BRANCH: {
+      CTCArg test = ReadArg(code, 0, 'A');
+      CTCArg target = ReadArg(code, 1, 'A');
+      code.AddInst(tube_op, test, target);
+      break;
+    }
+    case Opcode::LOWER_RANDOM: {
+      CTCArg range = ReadArg(code, 0, 'A');
+      code.AddInst(tube_op, range, DestReg(1, 'B'));
+      WriteArg(code, 1, 'B');
+      break;
+    }
+    case Opcode::LOWER_NOP:
+      code.AddInst(TubeOp::NOP);
+      break;
+    case Opcode::LOWER_PUSH: {
+      CTCArg value = ReadArg(code, 0, 'A');
+      code.AddInst(TubeOp::STORE, value, CTCArg::Reg('H'));
+      code.AddInst(TubeOp::ADD, CTCArg::Number(1), CTCArg::Reg('H'), CTCArg::Reg('H'));
+      break;
+    }
+    case Opcode::LOWER_POP:
+      code.AddInst(TubeOp::LOAD, CTCArg::Reg('H'), DestReg(0, 'A'));
+      WriteArg(code, 0, 'A');
+      code.AddInst(TubeOp::SUB, CTCArg::Reg('H'), CTCArg::Number(1), CTCArg::Reg('H'));
+      break;
+    case Opcode::LOWER_AR_PUSH: {
+      ReadArg(code, 0, 'A');
       //mArgs[0]->SetReg('A');
-      //ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-
-      ofs << "  load regA regB" << std::endl;
-      ofs << "  val_copy 0 regC" << std::endl;
-      ofs << "ar_push_start" << label_num << ":" << std::endl;
-      ofs << "  comp_equ regC regB regD" << std::endl;
-      ofs << "  jump_if_n0 regD ar_push_end" << label_num << std::endl;
-      ofs << "  add regA regC regE" << std::endl;
-      ofs << "  mem_copy regE regH" << std::endl;
-      ofs << "  add regC 1 regC" << std::endl;
-      ofs << "  add regH 1 regH" << std::endl;
-      ofs << "  jump ar_push_start" << label_num << std::endl;
-      ofs << "ar_push_end" << label_num << std::endl;
+      //out << "  load " << mArgs[0].GetID() << " regA\n";
+
+      CTCArg start = CTCArg::Name("ar_push_start" + std::to_string(label_num));
+      CTCArg end = CTCArg::Name("ar_push_end" + std::to_string(label_num));
+      code.AddInst(TubeOp::LOAD, CTCArg::Reg('A'), CTCArg::Reg('B'));
+      code.AddInst(TubeOp::VAL_COPY, CTCArg::Number(0), CTCArg::Reg('C'));
+      code.AddLabel(start);
+      code.AddInst(TubeOp::TEST_EQU, CTCArg::Reg('C'), CTCArg::Reg('B'), CTCArg::Reg('D'));
+      code.AddInst(TubeOp::JUMP_IF_N0, CTCArg::Reg('D'), end);
+      code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), CTCArg::Reg('C'), CTCArg::Reg('E'));
+      code.AddInst(TubeOp::MEM_COPY, CTCArg::Reg('E'), CTCArg::Reg('H'));
+      code.AddInst(TubeOp::ADD, CTCArg::Reg('C'), CTCArg::Number(1), CTCArg::Reg('C'));
+      code.AddInst(TubeOp::ADD, CTCArg::Reg('H'), CTCArg::Number(1), CTCArg::Reg('H'));
+      code.AddInst(TubeOp::JUMP, start);
+      code.AddLabel(end);
 
       // Store size in last memory position
-      ofs << "  mem_copy regB regH" << std::endl;
-      ofs << "  add regH 1 regH" << std::endl;
+      code.AddInst(TubeOp::MEM_COPY, CTCArg::Reg('B'), CTCArg::Reg('H'));
+      code.AddInst(TubeOp::ADD, CTCArg::Reg('H'), CTCArg::Number(1), CTCArg::Reg('H'));
+      break;
     }
     // Assumes argument is large enough to fit popped array!
-    else if(mInst == "ar_pop") {
-      mArgs[0]->AssemblyWrite(ofs, mArgs[0]->GetID(), 'A');
-      ofs << "  add regA regH regB" << std::endl;
-      ofs << "  val_copy regA regC" << std::endl;
-      ofs << "ar_pop_start" << label_num << ":" << std::endl;
-      ofs << "  comp_equ regB regC regD" << std::endl;
-      ofs << "  jump_if_n0 regD ar_pop_end" << label_num << std::endl;
-      ofs << "  mem_copy regH regC" << std::endl;
-      ofs << "  sub regH 1 regH" << std::endl;
-      ofs << "  add regC 1 regC" << std::endl;
-      ofs << "  jump ar_pop_start" << label_num << std::endl;
-      ofs << "ar_pop_end" << label_num << std::endl;
-    }
-    else if(mInst == "ar_get_idx" || mInst == "ar_set_idx") {
-      ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-      mArgs[1]->AssemblyRead(ofs, mArgs[1]->GetID(), 'B');
-      ofs << "  add regA 1 regA" << std::endl;
-      ofs << "  add regA " << mArgs[1]->AsAssemblyString() << " regA" << std::endl;
-      if(mInst == "ar_get_idx") {
-        ofs << "  mem_copy regA " << mArgs[2]->GetID() << std::endl;
+    case Opcode::LOWER_AR_POP: {
+      CTCArg start = CTCArg::Name("ar_pop_start" + std::to_string(label_num));
+      CTCArg end = CTCArg::Name("ar_pop_end" + std::to_string(label_num));
+      WriteArg(code, 0, 'A');
+      code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), CTCArg::Reg('H'), CTCArg::Reg('B'));
+      code.AddInst(TubeOp::VAL_COPY, CTCArg::Reg('A'), CTCArg::Reg('C'));
+      code.AddLabel(start);
+      code.AddInst(TubeOp::TEST_EQU, CTCArg::Reg('B'), CTCArg::Reg('C'), CTCArg::Reg('D'));
+      code.AddInst(TubeOp::JUMP_IF_N0, CTCArg::Reg('D'), end);
+      code.AddInst(TubeOp::MEM_COPY, CTCArg::Reg('H'), CTCArg::Reg('C'));
+      code.AddInst(TubeOp::SUB, CTCArg::Reg('H'), CTCArg::Number(1), CTCArg::Reg('H'));
+      code.AddInst(TubeOp::ADD, CTCArg::Reg('C'), CTCArg::Number(1), CTCArg::Reg('C'));
+      code.AddInst(TubeOp::JUMP, start);
+      code.AddLabel(end);
+      break;
+    }
+    case Opcode::LOWER_AR_INDEX: {
+      code.AddInst(TubeOp::LOAD, Address(0), CTCArg::Reg('A'));
+      CTCArg index = ReadArg(code, 1, 'B');
+      if (mArgs[1].GetKind() == ICOperand::INT) {
+        // Literal index; skip over the size slot with a single add.
+        code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), CTCArg::Number(mArgs[1].GetValue() + 1), CTCArg::Reg('A'));
       }
       else {
-        if(mArgs[2]->IsScalar()) {
-          ofs << "  mem_copy " << mArgs[2]->GetID() << " regA" << std::endl;
-        }
-        else {
-          ofs << "  val_copy " << mArgs[2]->AsString() << " regC" << std::endl;
-          ofs << "  store regC regA" << std::endl;
-        }
+        code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), CTCArg::Number(1), CTCArg::Reg('A'));
+        code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), index, CTCArg::Reg('A'));
+      }
+      if(mOp == Opcode::AR_GET_IDX) {
+        if (InRegister(2)) code.AddInst(TubeOp::LOAD, CTCArg::Reg('A'), DestReg(2, 'B'));
+        else code.AddInst(TubeOp::MEM_COPY, CTCArg::Reg('A'), Address(2));
+      }
+      else if (mArgs[2].IsScalar() && !InRegister(2)) {
+        code.AddInst(TubeOp::MEM_COPY, Address(2), CTCArg::Reg('A'));
+      }
+      else {
+        CTCArg value = ReadArg(code, 2, 'B');
+        code.AddInst(TubeOp::STORE, value, CTCArg::Reg('A'));
       }
+      break;
     }
-    else if(mInst == "ar_get_size") {
-      ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-      ofs << "  mem_copy regA " << mArgs[1]->GetID() << std::endl;
+    case Opcode::LOWER_AR_GET_PTR: {
+      code.AddInst(TubeOp::LOAD, Address(0), CTCArg::Reg('A'));
+      CTCArg index = ReadArg(code, 1, 'B');
+      if (mArgs[1].GetKind() == ICOperand::INT) {
+        code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), CTCArg::Number(mArgs[1].GetValue() + 1), DestReg(2, 'A'));
+      }
+      else {
+        code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), CTCArg::Number(1), CTCArg::Reg('A'));
+        code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), index, DestReg(2, 'A'));
+      }
+      WriteArg(code, 2, 'A');
+      break;
     }
-    else if(mInst == "ar_set_size") {
-      ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-      if(mArgs[1]->IsScalar()) {
-        ofs << "  load " << mArgs[1]->GetID() << " regB" << std::endl;
+    case Opcode::LOWER_PTR_GET: {
+      CTCArg ptr = ReadArg(code, 0, 'A');
+      if (InRegister(1)) code.AddInst(TubeOp::LOAD, ptr, DestReg(1, 'B'));
+      else code.AddInst(TubeOp::MEM_COPY, ptr, Address(1));
+      break;
+    }
+    case Opcode::LOWER_PTR_SET: {
+      CTCArg ptr = ReadArg(code, 0, 'A');
+      if (mArgs[1].IsScalar() && !InRegister(1)) {
+        code.AddInst(TubeOp::MEM_COPY, Address(1), ptr);
       }
       else {
-        ofs << "  val_copy " << mArgs[1]->AsString() << " regB" << std::endl;
+        CTCArg value = ReadArg(code, 1, 'B');
+        code.AddInst(TubeOp::STORE, value, ptr);
+      }
+      break;
+    }
+    case Opcode::LOWER_AR_GET_SIZE:
+      code.AddInst(TubeOp::LOAD, Address(0), CTCArg::Reg('A'));
+      if (InRegister(1)) code.AddInst(TubeOp::LOAD, CTCArg::Reg('A'), DestReg(1, 'B'));
+      else code.AddInst(TubeOp::MEM_COPY, CTCArg::Reg('A'), Address(1));
+      break;
+    case Opcode::LOWER_AR_SET_SIZE:
+      // Read the new size first; it may sit in a register this template reuses.
+      {
+        CTCArg size = ReadArg(code, 1, 'B');
+        if (size != CTCArg::Reg('B')) code.AddInst(TubeOp::VAL_COPY, size, CTCArg::Reg('B'));
       }
-      ofs << "  jump_if_0 regA do_resize" << label_num << std::endl;
-      ofs << "  load regA regC" << std::endl;
-      ofs << "  store regB regA" << std::endl;
-      ofs << "  test_lte regB regC regD" << std::endl;
-      ofs << "  jump_if_n0 regD resize_end_" << label_num + 1 << std::endl;
-      ofs << "do_resize" << label_num << ":" << std::endl;
-      ofs << "  load 0 regD" << std::endl;
-      ofs << "  add regD 1 regE" << std::endl;
-      ofs << "  add regE regB regE" << std::endl;
-      ofs << "  store regE 0" << std::endl;
-      ofs << "  store regD " << mArgs[0]->GetID() << std::endl;
-      ofs << "  store regB regD" << std::endl;
-      ofs << "resize_start_" << label_num++ << ":" << std::endl;
-      ofs << "  add regA 1 regA" << std::endl;
-      ofs << "  add regD 1 regD" << std::endl;
-      ofs << "  test_gtr regD regE regF" << std::endl;
-      ofs << "  jump_if_n0 regF resize_end_" << label_num << std::endl;
-      ofs << "  mem_copy regA regD" << std::endl;
-      ofs << "  jump resize_start_" << label_num - 1 << std::endl;
-      ofs << "resize_end_" << label_num++ << ":" << std::endl;
-      ofs << "  nop" << std::endl;
-    }
-    else if(mInst == "ar_copy") {
+      code.AddInst(TubeOp::LOAD, Address(0), CTCArg::Reg('A'));
+      ResizeTC(code, 0);
+      break;
+    case Opcode::LOWER_AR_COPY: {
       // Set size
-      ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-      ofs << "  load regA regB" << std::endl;
-      ofs << "  load " << mArgs[1]->GetID() << " regA" << std::endl;
-      ofs << "  jump_if_0 regA do_resize" << label_num << std::endl;
-      ofs << "  load regA regC" << std::endl;
-      ofs << "  store regB regA" << std::endl;
-      ofs << "  test_lte regB regC regD" << std::endl;
-      ofs << "  jump_if_n0 regD resize_end_" << label_num + 1 << std::endl;
-      ofs << "do_resize" << label_num << ":" << std::endl;
-      ofs << "  load 0 regD" << std::endl;
-      ofs << "  add regD 1 regE" << std::endl;
-      ofs << "  add regE regB regE" << std::endl;
-      ofs << "  store regE 0" << std::endl;
-      ofs << "  store regD " << mArgs[1]->GetID() << std::endl;
-      ofs << "  store regB regD" << std::endl;
-      ofs << "resize_start_" << label_num++ << ":" << std::endl;
-      ofs << "  add regA 1 regA" << std::endl;
-      ofs << "  add regD 1 regD" << std::endl;
-      ofs << "  test_gtr regD regE regF" << std::endl;
-      ofs << "  jump_if_n0 regF resize_end_" << label_num << std::endl;
-      ofs << "  mem_copy regA regD" << std::endl;
-      ofs << "  jump resize_start_" << label_num - 1 << std::endl;
-      ofs << "resize_end_" << label_num++ << ":" << std::endl;
-      ofs << "  nop" << std::endl;
+      code.AddInst(TubeOp::LOAD, Address(0), CTCArg::Reg('A'));
+      code.AddInst(TubeOp::LOAD, CTCArg::Reg('A'), CTCArg::Reg('B'));
+      code.AddInst(TubeOp::LOAD, Address(1), CTCArg::Reg('A'));
+      ResizeTC(code, 1);
 
       // Copy contents
-      ofs << "  load " << mArgs[0]->GetID() << " regA" << std::endl;
-      ofs << "  load " << mArgs[1]->GetID() << " regB" << std::endl;
-      ofs << "  load regA regC" << std::endl;
-      //ofs << "  out_int regC" << std::endl;
-      ofs << "  add 1 regA regA" << std::endl;
-      ofs << "  add 1 regB regB" << std::endl;
-      ofs << "  val_copy 0 regD" << std::endl;
-      ofs << "copy_start" << label_num << ":" << std::endl;
-      //ofs << "  out_int regD" << std::endl;
-      //ofs << "  out_char '\\n'" << std::endl;
-      ofs << "  test_gte regD regC regE" << std::endl;
-      ofs << "  jump_if_n0 regE copy_end" << label_num << std::endl;
-      ofs << "  mem_copy regA regB" << std::endl;
-      ofs << "  add 1 regA regA" << std::endl;
-      ofs << "  add 1 regB regB" << std::endl;
-      ofs << "  add 1 regD regD" << std::endl;
-      ofs << "  jump copy_start" << label_num << std::endl;
-      ofs << "copy_end" << label_num << ":" << std::endl;
-      ofs << "  nop" << std::endl;
+      CTCArg start = CTCArg::Name("copy_start" + std::to_string(label_num));
+      CTCArg end = CTCArg::Name("copy_end" + std::to_string(label_num));
+      code.AddInst(TubeOp::LOAD, Address(0), CTCArg::Reg('A'));
+      code.AddInst(TubeOp::LOAD, Address(1), CTCArg::Reg('B'));
+      code.AddInst(TubeOp::LOAD, CTCArg::Reg('A'), CTCArg::Reg('C'));
+      code.AddInst(TubeOp::ADD, CTCArg::Number(1), CTCArg::Reg('A'), CTCArg::Reg('A'));
+      code.AddInst(TubeOp::ADD, CTCArg::Number(1), CTCArg::Reg('B'), CTCArg::Reg('B'));
+      code.AddInst(TubeOp::VAL_COPY, CTCArg::Number(0), CTCArg::Reg('D'));
+      code.AddLabel(start);
+      code.AddInst(TubeOp::TEST_GTE, CTCArg::Reg('D'), CTCArg::Reg('C'), CTCArg::Reg('E'));
+      code.AddInst(TubeOp::JUMP_IF_N0, CTCArg::Reg('E'), end);
+      code.AddInst(TubeOp::MEM_COPY, CTCArg::Reg('A'), CTCArg::Reg('B'));
+      code.AddInst(TubeOp::ADD, CTCArg::Number(1), CTCArg::Reg('A'), CTCArg::Reg('A'));
+      code.AddInst(TubeOp::ADD, CTCArg::Number(1), CTCArg::Reg('B'), CTCArg::Reg('B'));
+      code.AddInst(TubeOp::ADD, CTCArg::Number(1), CTCArg::Reg('D'), CTCArg::Reg('D'));
+      code.AddInst(TubeOp::JUMP, start);
+      code.AddLabel(end);
+      code.AddInst(TubeOp::NOP);
+      break;
+    }
+    default:
+      break;
     }
 
   }
+}
 
-  // If there is a comment, print it!
-  //if (comment != "") {
-    //while (out_line.str().size() < 40) out_line << " "; // Align comments for easy reading.
-    //out_line << "# " << comment;
- // }
-
-  //ofs << out_line.str() << std::endl;
+// The resize loop shared by ar_set_size and ar_copy: give the array at Address(position),
+// whose pointer is in regA, the size in regB, moving it to the top of the heap if it grows.
+void ICEntry::ResizeTC(CTubeCode & code, int position) const
+{
+  CTCArg do_resize = CTCArg::Name("do_resize" + std::to_string(label_num));
+  CTCArg start = CTCArg::Name("resize_start_" + std::to_string(label_num));
+  CTCArg end = CTCArg::Name("resize_end_" + std::to_string(label_num + 1));
+  code.AddInst(TubeOp::JUMP_IF_0, CTCArg::Reg('A'), do_resize);
+  code.AddInst(TubeOp::LOAD, CTCArg::Reg('A'), CTCArg::Reg('C'));
+  code.AddInst(TubeOp::STORE, CTCArg::Reg('B'), CTCArg::Reg('A'));
+  code.AddInst(TubeOp::TEST_LTE, CTCArg::Reg('B'), CTCArg::Reg('C'), CTCArg::Reg('D'));
+  code.AddInst(TubeOp::JUMP_IF_N0, CTCArg::Reg('D'), end);
+  code.AddLabel(do_resize);
+  code.AddInst(TubeOp::LOAD, CTCArg::Number(0), CTCArg::Reg('D'));
+  code.AddInst(TubeOp::ADD, CTCArg::Reg('D'), CTCArg::Number(1), CTCArg::Reg('E'));
+  code.AddInst(TubeOp::ADD, CTCArg::Reg('E'), CTCArg::Reg('B'), CTCArg::Reg('E'));
+  code.AddInst(TubeOp::STORE, CTCArg::Reg('E'), CTCArg::Number(0));
+  code.AddInst(TubeOp::STORE, CTCArg::Reg('D'), Address(position));
+  code.AddInst(TubeOp::STORE, CTCArg::Reg('B'), CTCArg::Reg('D'));
+  code.AddLabel(start);
+  code.AddInst(TubeOp::ADD, CTCArg::Reg('A'), CTCArg::Number(1), CTCArg::Reg('A'));
+  code.AddInst(TubeOp::ADD, CTCArg::Reg('D'), CTCArg::Number(1), CTCArg::Reg('D'));
+  code.AddInst(TubeOp::TEST_GTR, CTCArg::Reg('D'), CTCArg::Reg('E'), CTCArg::Reg('F'));
+  code.AddInst(TubeOp::JUMP_IF_N0, CTCArg::Reg('F'), end);
+  code.AddInst(TubeOp::MEM_COPY, CTCArg::Reg('A'), CTCArg::Reg('D'));
+  code.AddInst(TubeOp::JUMP, start);
+  code.AddLabel(end);
+  code.AddInst(TubeOp::NOP);
+  label_num += 2;
 }
 
 /***************************************************
@@ -390,7 +488,7 @@ void ICEntry::PrintTC(std::ostream & ofs)
 
 ICEntry& ICArray::AddLabel(std::string label_id, std::string cmt)
 {
-  ICEntry * new_entry = new ICEntry("","",this);
+  ICEntry * new_entry = new ICEntry(Opcode::NONE, "", this);
   new_entry->SetLabel(label_id);
   new_entry->SetComment(cmt);
   mICArray.push_back(new_entry);
@@ -399,51 +497,51 @@ ICEntry& ICArray::AddLabel(std::string label_id, std::string cmt)
 
 
 // This is a quick way to add scalar/array/none args, with all needed error checking.
-void ICArray::AddArg(ICEntry * entry, int in_arg, ArgType::type expected_type)
+void ICArray::AddArg(ICEntry * entry, int in_arg, Opcode::ArgKind expected_type)
 {
   switch (expected_type) {
-  case ArgType::NONE:       // No argument expected...
+  case Opcode::ARG_NONE:       // No argument expected...
     if (in_arg != -1) {     // ... so make sure we're not passing one in...
       std::cerr << "INTERNAL ERROR: Too many arguments provided for inst '"
                 << entry->GetInstName() << "'." << std::endl;
     }
     break;
-  case ArgType::VALUE:      // Argument should have a VALUE, in this case must be a scalar input
-  case ArgType::SCALAR:     // Argument must be a scalar that gets read into!
+  case Opcode::ARG_VALUE:      // Argument should have a VALUE, in this case must be a scalar input
+  case Opcode::ARG_SCALAR:     // Argument must be a scalar that gets read into!
     if (in_arg == -1) {     // ... Make sure we're actually passing an argument in!
       std::cerr << "INTERNAL ERROR: Too insufficient arguments provided for inst '"
                 << entry->GetInstName() << "'." << std::endl;
     }
     else {
-      entry->AddScalarArg(in_arg);
+      entry->AddArg(ICOperand::Scalar(in_arg));
     }
     break;
 
-  case ArgType::ARRAY:      // Argument must be an array variable.
+  case Opcode::ARG_ARRAY:      // Argument must be an array variable.
     if (in_arg == -1) {     // ... Make sure we're actually passing an argument in!
       std::cerr << "INTERNAL ERROR: Insufficient arguments provided for inst '"
                 << entry->GetInstName() << "'." << std::endl;
     }
     else {
-      entry->AddArrayArg(in_arg);
+      entry->AddArg(ICOperand::Array(in_arg));
     }
     break;
   }
 }
 
 
-void ICArray::AddArg(ICEntry * entry, const std::string & in_arg, ArgType::type expected_type)
+void ICArray::AddArg(ICEntry * entry, const std::string & in_arg, Opcode::ArgKind expected_type)
 {
   switch (expected_type) {
-  case ArgType::NONE:       // No argument expected, but in input string means we received one!
+  case Opcode::ARG_NONE:       // No argument expected, but in input string means we received one!
     std::cerr << "INTERNAL ERROR: Too many arguments provided for inst '"
               << entry->GetInstName() << "'." << std::endl;
     break;
-  case ArgType::VALUE:      // Argument should have a VALUE, in this case const was input.
-    entry->AddConstArg(in_arg);
+  case Opcode::ARG_VALUE:      // Argument should have a VALUE, in this case const was input.
+    entry->AddArg(ICOperand::FromLexeme(in_arg));
     break;
-  case ArgType::SCALAR:     // Argument should have been a scalar variable, not a const!
-  case ArgType::ARRAY:      // Argument should have been array variable, not a const!
+  case Opcode::ARG_SCALAR:     // Argument should have been a scalar variable, not a const!
+  case Opcode::ARG_ARRAY:      // Argument should have been array variable, not a const!
     std::cerr << "INTERNAL ERROR: Incorrect type of arguments provided for inst '"
               << entry->GetInstName() << "'." << std::endl;
     break;
@@ -453,13 +551,10 @@ void ICArray::AddArg(ICEntry * entry, const std::string & in_arg, ArgType::type
 
 // This Add is called when all numbers are given to the Add method -- in other words all
 // arguments should be scalars, arrays, or none based on type layout.
-ICEntry& ICArray::Add(std::string inst_name, int arg1, int arg2, int arg3, std::string cmt)
+ICEntry& ICArray::Add(Opcode::OpcodeNames inst_name, int arg1, int arg2, int arg3, std::string cmt)
 {
   ICEntry * new_entry = new ICEntry(inst_name, "", this);
-  if (mArgTypeMap.find(inst_name) == mArgTypeMap.end()) {
-    std::cerr << "INTERNAL ERROR: Unknown instruction '" << inst_name << "'." << std::endl;
-  }
-  std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
+  const Opcode::ArgKind * arg_types = Opcode::GetInfo(inst_name).args;
   AddArg(new_entry, arg1, arg_types[0]);
   AddArg(new_entry, arg2, arg_types[1]);
   AddArg(new_entry, arg3, arg_types[2]);
@@ -468,13 +563,10 @@ ICEntry& ICArray::Add(std::string inst_name, int arg1, int arg2, int arg3, std::
   return *new_entry;
 }
 
-ICEntry& ICArray::Add(std::string inst_name, int arg1, int arg2, std::string arg3, std::string cmt)
+ICEntry& ICArray::Add(Opcode::OpcodeNames inst_name, int arg1, int arg2, std::string arg3, std::string cmt)
 {
   ICEntry * new_entry = new ICEntry(inst_name,"", this);
-  if (mArgTypeMap.find(inst_name) == mArgTypeMap.end()) {
-    std::cerr << "INTERNAL ERROR: Unknown instruction '" << inst_name << "'." << std::endl;
-  }
-  std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
+  const Opcode::ArgKind * arg_types = Opcode::GetInfo(inst_name).args;
   AddArg(new_entry, arg1, arg_types[0]);
   AddArg(new_entry, arg2, arg_types[1]);
   AddArg(new_entry, arg3, arg_types[2]);
@@ -483,13 +575,10 @@ ICEntry& ICArray::Add(std::string inst_name, int arg1, int arg2, std::string arg
   return *new_entry;
 }
 
-ICEntry& ICArray::Add(std::string inst_name, int arg1, std::string arg2, int arg3, std::string cmt)
+ICEntry& ICArray::Add(Opcode::OpcodeNames inst_name, int arg1, std::string arg2, int arg3, std::string cmt)
 {
   ICEntry * new_entry = new ICEntry(inst_name, "", this);
-  if (mArgTypeMap.find(inst_name) == mArgTypeMap.end()) {
-    std::cerr << "INTERNAL ERROR: Unknown instruction '" << inst_name << "'." << std::endl;
-  }
-  std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
+  const Opcode::ArgKind * arg_types = Opcode::GetInfo(inst_name).args;
   AddArg(new_entry, arg1, arg_types[0]);
   AddArg(new_entry, arg2, arg_types[1]);
   AddArg(new_entry, arg3, arg_types[2]);
@@ -498,13 +587,10 @@ ICEntry& ICArray::Add(std::string inst_name, int arg1, std::string arg2, int arg
   return *new_entry;
 }
 
-ICEntry& ICArray::Add(std::string inst_name, int arg1, std::string arg2, std::string arg3, std::string cmt)
+ICEntry& ICArray::Add(Opcode::OpcodeNames inst_name, int arg1, std::string arg2, std::string arg3, std::string cmt)
 {
   ICEntry * new_entry = new ICEntry(inst_name, "", this);
-  if (mArgTypeMap.find(inst_name) == mArgTypeMap.end()) {
-    std::cerr << "INTERNAL ERROR: Unknown instruction '" << inst_name << "'." << std::endl;
-  }
-  std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
+  const Opcode::ArgKind * arg_types = Opcode::GetInfo(inst_name).args;
   AddArg(new_entry, arg1, arg_types[0]);
   AddArg(new_entry, arg2, arg_types[1]);
   AddArg(new_entry, arg3, arg_types[2]);
@@ -513,13 +599,10 @@ ICEntry& ICArray::Add(std::string inst_name, int arg1, std::string arg2, std::st
   return *new_entry;
 }
 
-ICEntry& ICArray::Add(std::string inst_name, std::string arg1, int arg2, int arg3, std::string cmt)
+ICEntry& ICArray::Add(Opcode::OpcodeNames inst_name, std::string arg1, int arg2, int arg3, std::string cmt)
 {
   ICEntry * new_entry = new ICEntry(inst_name, "", this);
-  if (mArgTypeMap.find(inst_name) == mArgTypeMap.end()) {
-    std::cerr << "INTERNAL ERROR: Unknown instruction '" << inst_name << "'." << std::endl;
-  }
-  std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
+  const Opcode::ArgKind * arg_types = Opcode::GetInfo(inst_name).args;
   AddArg(new_entry, arg1, arg_types[0]);
   AddArg(new_entry, arg2, arg_types[1]);
   AddArg(new_entry, arg3, arg_types[2]);
@@ -528,13 +611,10 @@ ICEntry& ICArray::Add(std::string inst_name, std::string arg1, int arg2, int arg
   return *new_entry;
 }
 
-ICEntry& ICArray::Add(std::string inst_name, std::string arg1, int arg2, std::string arg3, std::string cmt)
+ICEntry& ICArray::Add(Opcode::OpcodeNames inst_name, std::string arg1, int arg2, std::string arg3, std::string cmt)
 {
   ICEntry * new_entry = new ICEntry(inst_name, "", this);
-  if (mArgTypeMap.find(inst_name) == mArgTypeMap.end()) {
-    std::cerr << "INTERNAL ERROR: Unknown instruction '" << inst_name << "'." << std::endl;
-  }
-  std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
+  const Opcode::ArgKind * arg_types = Opcode::GetInfo(inst_name).args;
   AddArg(new_entry, arg1, arg_types[0]);
   AddArg(new_entry, arg2, arg_types[1]);
   AddArg(new_entry, arg3, arg_types[2]);
@@ -542,13 +622,10 @@ ICEntry& ICArray::Add(std::string inst_name, std::string arg1, int arg2, std::st
   mICArray.push_back(new_entry);
   return *new_entry;
 }
-ICEntry& ICArray::Add(std::string inst_name, std::string arg1, std::string arg2, std::string arg3, std::string cmt)
+ICEntry& ICArray::Add(Opcode::OpcodeNames inst_name, std::string arg1, std::string arg2, std::string arg3, std::string cmt)
 {
   ICEntry * new_entry = new ICEntry(inst_name, "", this);
-  if (mArgTypeMap.find(inst_name) == mArgTypeMap.end()) {
-    std::cerr << "INTERNAL ERROR: Unknown instruction '" << inst_name << "'." << std::endl;
-  }
-  std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
+  const Opcode::ArgKind * arg_types = Opcode::GetInfo(inst_name).args;
   AddArg(new_entry, arg1, arg_types[0]);
   AddArg(new_entry, arg2, arg_types[1]);
   AddArg(new_entry, arg3, arg_types[2]);
@@ -561,249 +638,344 @@ ICEntry& ICArray::Add(std::string inst_name, std::string arg1, std::string arg2,
 void ICArray::PrintIC(std::ostream & ofs)
 {
   //ofs << "# Output from Dr. Charles Ofria's sample compiler." << std::endl;
+  CEmitter out;
   for (int i = 0; i < (int) mICArray.size(); i++) {
-    mICArray[i]->PrintIC(ofs);
+    mICArray[i]->PrintIC(out);
   }
-  ofs << '\n';
+  out << '\n';
+  out.WriteTo(ofs);
 }
 
-void ICArray::OptimizeIC()
+void ICArray::Revisit(int line)
 {
-  // count block id
-  std::stringstream ss;
-  //std::cout << "hello" << std::endl;
-  for (int i = 0; i < (int) mICArray.size(); i++)
-  {
-      if (mICArray[i]->GetLabel() != ""
-              || mICArray[i]->GetInstName() == "jump_if_0"
-              || mICArray[i]->GetInstName() == "jump_if_n0" )
-          mICArray[i]->SetBlockID(IncBlockID());
-      else
-          mICArray[i]->SetBlockID(mBlockID);
-
-      //printf("Line Number: %d\n", i);
-      mICArray[i]->SetLineNumber(i+1);
-      mICArray[i]->TrackVariables();
+  if (mOnWorklist[line]) return;
+  mOnWorklist[line] = true;
+  mWorklist.push_back(line);
+}
+
+// Count the scalars on a line into their trackers.
+void ICArray::TrackLine(int line, int block)
+{
+  ICEntry * entry = mICArray[line];
+  for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+    if (!entry->IsScalarArg(i)) continue;
+    int id = entry->GetArgID(i);
+    if (id >= (int) mTrackers.size()) mTrackers.resize(id + 1);
+    variableTracker * tracker = &mTrackers[id];
+    if (!tracker->seen) {
+      tracker->seen = true;
+      tracker->firstBlock = block;
+    }
+    if (tracker->lines.size() == 0 || tracker->lines.back() != line) tracker->lines.push_back(line);
+    tracker->lastBlock = block;
+    if (tracker->firstBlock != block) tracker->local = false;
+    if (IsArgWritten(entry->GetOpcode(), i)) {
+      tracker->defCount++;
+      tracker->defLine = line;
+    }
+    else tracker->readCount++;
   }
+}
 
-  bool progress = true;
-  while(progress) {
-    progress = false;
-    for(int j = 0; j < (int) mICArray.size(); j++) { // for each entry in
-      ICEntry * entry = mICArray[j];                 // mArray
-      std::string inst = entry->GetInstName();
-      //ss.str(""); ss << j;
-      //std::cout << "j: " << ss.str() << std::endl;
-
-      //Constant Propogation and Dead Code Elimination
-      if (inst == "val_copy") {
-
-        std::string arg0 = entry->GetArg(0);
-        variableTracker * arg0Tracker = FindVariable(arg0); //var copied into
-        std::string arg1 = entry->GetArg(1);
-        variableTracker * arg1Tracker = FindVariable(arg1);
-          //Constant Propagation
-          if (arg1Tracker->SSA)
-          {
-              if (arg0[0] != 's') { //constant value
-// std::cout << "const prop" << inst << " " << arg0 << " " << arg1 << std::endl;
-              arg1Tracker->replace = arg0;
-              entry->SetDelete(true);
-              progress = true; break;
-          }}
+// Undo TrackLine(); once nothing reads a variable, its writes may have become dead.
+void ICArray::UntrackLine(int line)
+{
+  ICEntry * entry = mICArray[line];
+  for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+    if (!entry->IsScalarArg(i)) continue;
+    variableTracker * tracker = FindVariable(entry->GetArgID(i));
+    if (IsArgWritten(entry->GetOpcode(), i)) {
+      tracker->defCount--;
+      continue;
+    }
+    if (--tracker->readCount > 0) continue;
+    for (int l = 0; l < (int) tracker->lines.size(); l++) {
+      if (tracker->lines[l] != line) Revisit(tracker->lines[l]);
+    }
+  }
+}
+
+void ICArray::DeleteLine(int line)
+{
+  UntrackLine(line);
+  mICArray[line]->SetDelete(true);
+}
+
+// Replace scalar 'id' on a line by 'value', and look at the line again.
+void ICArray::RewriteLine(int line, int id, const ICOperand & value)
+{
+  UntrackLine(line);
+  mICArray[line]->ReplaceScalarArg(id, value);
+  TrackLine(line, mICArray[line]->GetBlockID());
+  Revisit(line);
+}
 
+// Try every local optimization on one line; returns true if anything changed.
+bool ICArray::OptimizeLine(int line)
+{
+  ICEntry * entry = mICArray[line];
+  int inst = entry->GetOpcode();
+
+  if (inst == Opcode::VAL_COPY) {
+    const ICOperand arg0 = entry->GetOperand(0);
+    const ICOperand arg1 = entry->GetOperand(1);
+    variableTracker * arg1Tracker = FindVariable(arg1.GetID());
+
+    //Eliminate Dead Code (a copy onto itself included)
+    if (arg1Tracker->readCount == 0 || arg0 == arg1) {
+      DeleteLine(line);
+      return true;
+    }
+
+    //Constant Propagation: the only write is this one, and it comes before every read.
+    if (!entry->IsScalarArg(0) && arg1Tracker->defCount == 1 && arg1Tracker->defDominates) {
+      std::vector<int> lines = arg1Tracker->lines;
+      int id = entry->GetArgID(1);
+      for (int l = 0; l < (int) lines.size(); l++) {
+        if (lines[l] == line || mICArray[lines[l]]->GetDelete()) continue;
+        if (mICArray[lines[l]]->HasScalarArg(id)) RewriteLine(lines[l], id, arg0);
       }
-      else if (inst == "add" || inst == "sub" || inst == "mult" || inst == "div"
-              || inst == "mod" || inst == "test_less" || inst == "test_gtr"
-              || inst == "test_equ" || inst == "test_nequ" || inst == "test_lte"
-              || inst == "test_gte") {
-          std::string arg0 = entry->GetArg(0);
-          variableTracker * arg0Tracker = FindVariable(arg0); //augend
-          std::string arg1 = entry->GetArg(1);
-          variableTracker * arg1Tracker = FindVariable(arg1); //addend
-          std::string arg2 = entry->GetArg(2);
-          variableTracker * arg2Tracker = FindVariable(arg2); //target var
-          //Eliminate Dead Code
-          if (arg2Tracker->firstLine == arg2Tracker->lastLine) {
-              entry->SetDelete(true);
-              //entry->OptimizeIC();
-              progress = true;
-              //continue;
-              break;
-          }
-          if (arg0[0] != 's' && arg1[0] != 's'
-                  && arg0[0] != 'a' && arg1[0] != 'a')
-          {
-              entry->SetSimplify(true);
-              int a0 = atoi(arg0.c_str());
-              int a1 = atoi(arg1.c_str());
-              // algebraic simplification
-              if (inst == "add")
-              {
-                int result = a0 + a1; ss.str(""); ss << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "sub")
-              {
-                int result = a0 - a1; ss.str(""); ss << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "mult")
-              {
-                int result = a0 * a1;ss.str(""); ss << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "div")
-              {
-                int result = a0 / a1; ss.str("");ss << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "mod")
-              {
-                int result = a0 % a1; ss.str("");ss << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "test_less") {
-                bool result = a0 < a1; ss.str("");
-                ss << std::noboolalpha << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "test_gtr") {
-                bool result = a0 > a1; ss.str("");
-                ss << std::noboolalpha << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "test_equ") {
-                bool result = a0 == a1; ss.str("");
-                ss << std::noboolalpha << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst != "test_nequ") {
-                bool result = a0 == a1; ss.str("");
-                ss << std::noboolalpha << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "test_lte") {
-                bool result = a0 <= a1; ss.str("");
-                ss << std::noboolalpha << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              else if (inst == "test_gte") {
-                bool result = a0 >= a1; ss.str("");
-                ss << std::noboolalpha << result;
-                arg2Tracker->simplify = ss.str();
-              }
-              progress = true; break;
-          }
-          if (inst == "mult") {
-            if (arg0[0] == 's' && arg1[0] != 's' && arg1[0] != 'a') {
-                if (arg1 == "0") {
-                    arg2Tracker->simplify = arg1; //answer always 0
-                    entry->SetSimplify(true);
-                    progress = true; break;
-                }
-                else if (arg1 == "1") {
-                    arg2Tracker->simplify = arg0; //answer always a0
-                    entry->SetSimplify(true);
-                    progress = true; break;
-                }
-            }
-            if(arg0[0] != 's' && arg1[0] == 's' && arg0[0] != 'a') {
-                if(arg0 == "0") {
-                    arg2Tracker->simplify = arg0; //answer always 0
-                    entry->SetSimplify(true);
-                    progress = true; break;
-                }
-                else if (arg0 == "1") {
-                    arg2Tracker->simplify = arg1; //answer always a1
-                    entry->SetSimplify(true);
-                    progress = true; break;
-                }
-            }
-          }
+      DeleteLine(line);
+      return true;
+    }
+
+    //Variable Propagation: sA is last used here and sB is first set here, both
+    //inside this block, so sB can simply be renamed to sA.
+    if (entry->IsScalarArg(0) && arg0 != arg1) {
+      variableTracker * arg0Tracker = FindVariable(arg0.GetID());
+      if (!arg0Tracker->local || !arg1Tracker->local) return false;
+      int id0 = entry->GetArgID(0), id1 = entry->GetArgID(1);
+
+      int first0 = line;
+      for (int l = 0; l < (int) arg0Tracker->lines.size(); l++) {
+        int other = arg0Tracker->lines[l];
+        if (mICArray[other]->GetDelete() || !mICArray[other]->HasScalarArg(id0)) continue;
+        if (other > line) return false;
+        first0 = std::min(first0, other);
+      }
+      if (first0 == line || mICArray[first0]->ReadsScalar(id0)) return false;
+      for (int l = 0; l < (int) arg1Tracker->lines.size(); l++) {
+        int other = arg1Tracker->lines[l];
+        if (mICArray[other]->GetDelete() || !mICArray[other]->HasScalarArg(id1)) continue;
+        if (other < line) return false;
       }
 
-      if (inst == "val_copy") {
-        std::string arg0 = entry->GetArg(0);
-        variableTracker * arg0Tracker = FindVariable(arg0); //var copied into
-        std::string arg1 = entry->GetArg(1);
-        variableTracker * arg1Tracker = FindVariable(arg1);
-
-        //Variable Propagation
-        //this only works if both args are scalar
-        if (arg0[0] == 's' && arg1[1] == 's' ) {
-            //std::cout << "inside first variable propagation check" << std::endl;
-            int ZLL = arg0Tracker->lastLine;
-            int OFL = arg1Tracker->firstLine;
-            bool ZL = arg0Tracker->local;
-            bool OL = arg1Tracker->local;
-            if (ZLL == OFL && ZL && OL){
-              //std::cout << inst << " " << arg0 << " " << arg1 << std::endl;
-              arg1Tracker->replace = arg0; //replace arg1 with arg0
-              entry->SetDelete(true);
-              progress = true; break;
-          }
-        }
-        //Eliminate Dead Code
-          if (arg1Tracker->usedCount < 1) {
-//  std::cout << "dead code el" << inst << " " << arg0 << " " << arg1 << std::endl;
-              entry->SetDelete(true);
-              progress = true; break;
-          }
+      DeleteLine(line);
+      std::vector<int> lines = arg1Tracker->lines;
+      for (int l = 0; l < (int) lines.size(); l++) {
+        if (mICArray[lines[l]]->GetDelete()) continue;
+        if (mICArray[lines[l]]->HasScalarArg(id1)) RewriteLine(lines[l], id1, arg0);
+      }
+      arg0Tracker->defDominates = false;
+      return true;
+    }
+    return false;
+  }
 
+  if (Opcode::IsMath(inst)) {
+    const ICOperand arg0 = entry->GetOperand(0);
+    const ICOperand arg1 = entry->GetOperand(1);
+    variableTracker * arg2Tracker = FindVariable(entry->GetArgID(2)); //target var
 
-      }
-      /*if (!progress) {
-          bool temp = entry->OptimizeIC();
-          if (temp) progress = true;
-      }*/
-    } // END FOR
-    //mTrackerMap.clear();
-    if(progress)
-    {
+    //Eliminate Dead Code
+    if (arg2Tracker->readCount == 0) {
+      DeleteLine(line);
+      return true;
+    }
 
+    // Constant folding
+    int a0 = arg0.GetValue(), a1 = arg1.GetValue();
+    if (arg0.IsImmediate() && arg1.IsImmediate()
+        && !((inst == Opcode::DIV || inst == Opcode::MOD) && a1 == 0)) {
+      int result = 0;
+      switch (inst) {
+      case Opcode::ADD:       result = a0 + a1;  break;
+      case Opcode::SUB:       result = a0 - a1;  break;
+      case Opcode::MULT:      result = a0 * a1;  break;
+      case Opcode::DIV:       result = a0 / a1;  break;
+      case Opcode::MOD:       result = a0 % a1;  break;
+      case Opcode::TEST_LESS: result = a0 < a1;  break;
+      case Opcode::TEST_GTR:  result = a0 > a1;  break;
+      case Opcode::TEST_EQU:  result = a0 == a1; break;
+      case Opcode::TEST_NEQU: result = a0 != a1; break;
+      case Opcode::TEST_LTE:  result = a0 <= a1; break;
+      case Opcode::TEST_GTE:  result = a0 >= a1; break;
+      }
+      entry->SetToCopy(ICOperand::Int(result));
+      Revisit(line);
+      return true;
     }
-    for(int j = 0; j < (int) mICArray.size(); j++) {
-      ICEntry * entry = mICArray[j];
-      bool temp = entry->OptimizeIC();
-      if(temp) progress = true;
-      if (entry->GetDelete()){
-          mICArray.erase(mICArray.begin()+j);
-          progress = true;
+
+    // Algebraic simplification: x*0 = 0 and x*1 = x
+    if (inst == Opcode::MULT) {
+      ICOperand simplify;
+      if (entry->IsScalarArg(0) && arg1.IsImmediate() && (a1 == 0 || a1 == 1)) {
+        simplify = (a1 == 0) ? arg1 : arg0;
       }
-      //entry->TrackVariables();
-    } // END FOR 2
-  } // END WHILE
-//
-/*
-for(std::map<std::string, variableTracker*>::const_iterator it
-                = mTrackerMap.begin(); it != mTrackerMap.end(); ++it)
-    {
-        std::cout << it->first  << ": \n";
-        ss.str(""); ss << it->second->firstLine;
-        std::cout << "  First Line: " << ss.str() << std::endl;
-        ss.str(""); ss << it->second->lastLine;
-        std::cout << "  Last Line: " << ss.str() << std::endl;
-        ss.str(""); ss << it->second->usedCount;
-        std::cout << "  Used Count: " << ss.str() << std::endl;
-        ss.str(""); ss << it->second->firstBlock;
-        std::cout << "  First Block: " << ss.str() << std::endl;
-        ss.str(""); ss << it->second->lastBlock;
-        std::cout << "  Last Block: " << ss.str() << std::endl;
-        ss.str(""); ss << it->second->local;
-        std::cout << "  Local: " << ss.str() << std::endl;
-        ss.str(""); ss << it->second->SSA;
-        std::cout << "  SSA: " << ss.str() << std::endl;
-    }*/
-
-} // END OptimizeIC
+      else if (entry->IsScalarArg(1) && arg0.IsImmediate() && (a0 == 0 || a0 == 1)) {
+        simplify = (a0 == 0) ? arg0 : arg1;
+      }
+      if (!simplify.IsNone()) {
+        UntrackLine(line);
+        entry->SetToCopy(simplify);
+        TrackLine(line, entry->GetBlockID());
+        Revisit(line);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Run the local optimizations to a fixed point.  Every line starts on a
+// worklist; a line only goes back on it when one of its operands changes or
+// the value it computes loses its last reader.  Deleted lines are left in
+// place (marked with SetDelete) and swept out in one pass at the end.
+void ICArray::RunWorklist()
+{
+  int num_lines = mICArray.size();
+  time_report.BeginPhase("optimize: build CFG");
+  CControlFlowGraph cfg;
+  cfg.Build(*this);
+
+  time_report.BeginPhase("optimize: track variables");
+  // Size the trackers once so they never move while the optimizer holds pointers to them.
+  int num_vars = 0;
+  for (int i = 0; i < num_lines; i++) {
+    for (int arg = 0; arg < (int) mICArray[i]->GetNumArgs(); arg++) {
+      num_vars = std::max(num_vars, mICArray[i]->GetArgID(arg) + 1);
+    }
+  }
+  ResetVariables(num_vars);
+  for (int i = 0; i < num_lines; i++) {
+    mICArray[i]->SetBlockID(cfg.GetBlockOf(i));
+    mICArray[i]->SetLineNumber(i);
+    if (!mICArray[i]->GetDelete()) TrackLine(i, cfg.GetBlockOf(i));
+  }
+
+  // A variable's write dominates its reads if it is the only write and every
+  // read is on a line that the write is certain to run before.
+  for (int id = 0; id < (int) mTrackers.size(); id++) {
+    variableTracker * tracker = &mTrackers[id];
+    if (!tracker->seen) continue;
+    tracker->defDominates = (tracker->defCount == 1);
+    for (int l = 0; l < (int) tracker->lines.size() && tracker->defDominates; l++) {
+      if (tracker->lines[l] == tracker->defLine) continue;
+      if (!cfg.DominatesLine(tracker->defLine, tracker->lines[l])) tracker->defDominates = false;
+    }
+  }
+
+  time_report.BeginPhase("optimize: local worklist");
+  mWorklist.clear();
+  mOnWorklist.assign(num_lines, false);
+  for (int i = num_lines - 1; i >= 0; i--) Revisit(i);
+  while (mWorklist.size() > 0) {
+    int line = mWorklist.back();
+    mWorklist.pop_back();
+    mOnWorklist[line] = false;
+    if (mICArray[line]->GetDelete()) continue;
+    OptimizeLine(line);
+  }
+
+  time_report.BeginPhase("optimize: sweep");
+  // Sweep out everything that was deleted (the entries themselves stay in the IC arena).
+  int kept = 0;
+  for (int i = 0; i < num_lines; i++) {
+    if (!mICArray[i]->GetDelete()) mICArray[kept++] = mICArray[i];
+  }
+  mICArray.resize(kept);
+  ClearVariables();
+}
+
+void ICArray::InsertEntries(const std::vector<std::pair<int, ICEntry *> > & entries)
+{
+  if (entries.size() == 0) return;
+  std::vector<ICEntry *> merged;
+  merged.reserve(mICArray.size() + entries.size());
+  int next = 0;
+  for (int i = 0; i <= (int) mICArray.size(); i++) {
+    while (next < (int) entries.size() && entries[next].first == i) merged.push_back(entries[next++].second);
+    if (i < (int) mICArray.size()) merged.push_back(mICArray[i]);
+  }
+  mICArray.swap(merged);
+}
+
+// Run the global passes in order, sweeping up with the local worklist after each one that
+// changes anything.  Constants and jumps go first, so the later passes see fewer blocks.  Each
+// pass's header says what it does.  With 'move_code' (-O2), lazy code motion runs last.  The
+// values it keeps live longer only pay off with the graph-coloring allocator.
+void ICArray::OptimizeIC(bool move_code)
+{
+  RunWorklist();
+
+  time_report.BeginPhase("optimize: constant propagation");
+  CConstantPropagation constants;
+  if (constants.Run(*this) > 0) RunWorklist();
+
+  time_report.BeginPhase("optimize: jump threading");
+  CJumpThreading jumps;
+  if (jumps.Run(*this) > 0) RunWorklist();
+
+  time_report.BeginPhase("optimize: value numbering");
+  CLocalValueNumbering value_numbering;
+  if (value_numbering.Run(*this) > 0) RunWorklist();
+
+  time_report.BeginPhase("optimize: load forwarding");
+  CLoadForwarding load_forwarding;
+  if (load_forwarding.Run(*this) > 0) RunWorklist();
+
+  time_report.BeginPhase("optimize: SSA form");
+  CSSAForm ssa;
+  if (ssa.Run(*this) > 0) RunWorklist();
+
+  time_report.BeginPhase("optimize: dead code elimination");
+  CDeadCodeElimination dead_code;
+  if (dead_code.Run(*this) > 0) RunWorklist();
+
+  // Moved lines are copied in front of their loops; the originals are only marked deleted.
+  time_report.BeginPhase("optimize: loop-invariant code motion");
+  CLoopInvariantMotion loop_motion;
+  if (loop_motion.Run(*this) > 0) RunWorklist();
+  if (!move_code) return;
+
+  // Moved expressions leave copies of their temporaries behind; numbering the blocks again
+  // sends reads straight to the temporaries so the copies die.
+  time_report.BeginPhase("optimize: lazy code motion");
+  CLazyCodeMotion code_motion;
+  if (code_motion.Run(*this) > 0) {
+    time_report.BeginPhase("optimize: value numbering");
+    value_numbering.Run(*this);
+    RunWorklist();
+  }
+}
+
+// The pointer instructions this adds are not IC that TubeIC (or CICInterpreter) can run, so it
+// only happens once the IC is on its way to TubeCode.  Replaced loop counters leave dead lines
+// behind, which the worklist sweeps out.
+void ICArray::ReduceStrength()
+{
+  CStrengthReduction reduction;
+  if (reduction.Run(*this) > 0) RunWorklist();
+}
+
 void ICArray::PrintTC(std::ostream & ofs)
 {
   //ofs << "# Tubecode Assembly ouput from checkpoint compiler." << std::endl;
   //ofs << "  store " << max_id+1 << " 0                         # Store next free memory at 0" << std::endl;
   // Convert each line of intermediate code, one at a time.
+  CTubeCode code;
   for (int i = 0; i < (int) mICArray.size(); i++) {
-    mICArray[i]->PrintTC(ofs);
+    mICArray[i]->PrintTC(code);
   }
+
+  time_report.BeginPhase("emit TubeCode: peephole");
+  CTCPeephole peephole;
+  peephole.Run(code);
+  for (int i = 0; i < peephole.GetNumRules(); i++) {
+    time_report.SetCount(std::string("peephole: ") + peephole.GetRuleName(i), peephole.GetHits(i));
+  }
+
+  time_report.BeginPhase("emit TubeCode: write");
+  code.Write(ofs);
 }
 
@@ -10,12 +10,14 @@
 //
 //  The ICArray class holds an array of ICEntries that make up the full intermediate code program.
 //
-//  The ICArg_* classes are private within ICEntry and hold information about the arguments
-//  associated with each instruction
-//    ICArg_Base is the base class that all of the others are derived from.
-//    ICArg_VarScalar holds info about scalar variables used as arguments (eg, s27).
-//    ICArg_VarConst holds info about literal numbers or chars used as arguments (eg 10 or 'Q').
-//    ICArg_VarArray holds info about array variables used as arguments (eg, a5).
+//  The ICOperand class holds a single argument of an instruction in 8 bytes: a kind plus a value.
+//    SCALAR - a scalar variable; the value is its variable ID (eg, s27).
+//    ARRAY  - an array variable; the value is its variable ID (eg, a5).
+//    INT    - a literal number; the value is the number itself (eg, 10).
+//    CHAR   - a literal char; the value is its character code (eg, 'Q').
+//    LABEL  - a code label; the value is an ID from a table of interned label names.
+//  Operands are stored inline in each ICEntry and compare as plain integers; they are only
+//  turned back into text when the IC or TubeCode is printed.
 //
 
 #include <iostream>
@@ -29,6 +31,11 @@
 #include <cstring>
 #include <cstdio>
 
+#include "arena.h"
+#include "emitter.h"
+#include "opcode.h"
+#include "tube_code.h"
+
 /* class CVariableTracker{
     private:
         int mFirstUsed;
@@ -57,173 +64,125 @@
 };*/
 
 
+// What OptimizeIC() knows about one scalar.  ICArray keeps these in a vector indexed by
+// variable ID; the counters sit together up front so a scan touches as few lines as possible.
 struct variableTracker{
-        int constantInt;
-        char constantChar;
-        int firstLine;
-        int lastLine;
+        int readCount;          // Live lines that read the variable.
+        int defCount;           // Live lines that write the variable.
+        int defLine;            // Line of the (last) write.
         int firstBlock;
         int lastBlock;
-        int usedCount;
-        bool local;
-        bool SSA;
-        std::string replace;
-        std::string simplify;
+        bool seen;              // Does the variable appear in the IC at all?
+        bool local;             // Is every occurrence inside a single basic block?
+        bool defDominates;      // Is there one write, and does it run before every read?
+        std::vector<int> lines; // Lines the variable was seen on (some may be stale).
+
+        variableTracker() : readCount(0), defCount(0), defLine(-1), firstBlock(-1), lastBlock(-1),
+                            seen(false), local(true), defDominates(false) { ; }
 };
 
 class ICArray ;
 
-class ICEntry {
+class ICOperand {
+public:
+  enum Kind { NONE=0, SCALAR, ARRAY, INT, CHAR, LABEL };
+
 private:
-  // Variables for converting to assembly
-
-  class ICArg_Base {
-  public:
-    ICArg_Base() { ; }
-    virtual ~ICArg_Base() { ; }
-
-    virtual void AssemblyRead(std::ostream & ofs, int lit, char reg) { }
-    virtual void AssemblyWrite(std::ostream & ofs, int lit, char reg) { }
-
-    virtual std::string AsString() = 0;
-    virtual std::string AsAssemblyString() = 0;
-    virtual std::string GetReg() = 0;
-    virtual void SetReg(char reg) = 0;
-    virtual int GetID() { return -1; }
-
-    virtual bool IsScalar() { return false; }
-    virtual bool IsConst() { return false; }
-    std::string As_String(char c){
-            std::stringstream temp;
-            temp << c;
-            return temp.str();
-    }
-  };
-
-  class ICArg_VarScalar : public ICArg_Base {
-  private:
-    int mVarID;
-    std::string mReg;
-  public:
-    ICArg_VarScalar(int _id) : mVarID(_id), mReg(""){ ; }
-    ~ICArg_VarScalar() { ; }
-
-    void AssemblyRead(std::ostream & ofs, int lit, char reg) {
-      mReg = "reg" + As_String(reg);
-      ofs << "  load " << lit << " reg" << As_String(reg) << std::endl;
-    }
-    void AssemblyWrite(std::ostream & ofs, int lit, char reg) {
-      ofs << "  store reg" << As_String(reg) << " " << lit << std::endl;
-    }
+  int mKind;
+  int mValue;
 
-    void SetReg(char reg) { mReg = "reg" + As_String(reg); }
+  static std::vector<std::string> mLabelNames;
+  static std::map<std::string, int> mLabelIDs;
 
-    std::string GetReg() {
-      return mReg;
-    }
+public:
+  ICOperand() : mKind(NONE), mValue(0) { ; }
+  ICOperand(int kind, int value) : mKind(kind), mValue(value) { ; }
+
+  static ICOperand Scalar(int id) { return ICOperand(SCALAR, id); }
+  static ICOperand Array(int id)  { return ICOperand(ARRAY, id); }
+  static ICOperand Int(int value) { return ICOperand(INT, value); }
+  static ICOperand Label(const std::string & name) { return ICOperand(LABEL, InternLabel(name)); }
+  // Build a constant from its lexeme: a number, a quoted char, or otherwise a label.
+  static ICOperand FromLexeme(const std::string & lexeme);
+
+  int GetKind() const { return mKind; }
+  int GetValue() const { return mValue; }
+  int GetID() const { return (mKind == SCALAR || mKind == ARRAY) ? mValue : -1; }
+  bool IsNone() const { return mKind == NONE; }
+  bool IsScalar() const { return mKind == SCALAR; }
+  bool IsArray() const { return mKind == ARRAY; }
+  bool IsConst() const { return mKind == INT || mKind == CHAR || mKind == LABEL; }
+  bool IsImmediate() const { return mKind == INT || mKind == CHAR; }  // Has a known number value.
+  bool IsLabel() const { return mKind == LABEL; }
+
+  bool operator==(const ICOperand & other) const {
+    return mKind == other.mKind && mValue == other.mValue;
+  }
+  bool operator!=(const ICOperand & other) const { return !(*this == other); }
 
-    std::string AsString() {
-      std::stringstream out_str;
-      out_str << "s" << mVarID;
-      return out_str.str();
-    }
-    std::string AsAssemblyString() {
-      return mReg;
-    }
-    int GetID() { return mVarID; }
-
-    bool IsScalar() { return true; }
-  };
-
-  // All constant values: int, char, or label.
-  class ICArg_Const : public ICArg_Base {
-  private:
-    std::string mValue;
-  public:
-    ICArg_Const(std::string val) : mValue(val) { ; }
-    ~ICArg_Const() { ; }
-
-    void AssemblyRead(std::ostream & ofs, int lit, char reg) { }
-    void AssemblyWrite(std::ostream & ofs, int lit, char reg) {  }
-    void SetReg(char reg) { }
-
-    std::string AsString() { return mValue; }
-    std::string AsAssemblyString() {
-      return mValue;
-    }
-    std::string GetReg() { return mValue; }
-
-    bool IsConst() { return true; }
-  };
-
-  // Hint: This is only useful starting in project 5!
-  class ICArg_VarArray : public ICArg_Base {
-  private:
-    int mVarID;
-  public:
-    ICArg_VarArray(int _id) : mVarID(_id) { ; }
-    ~ICArg_VarArray() { ; }
-
-    void AssemblyRead(std::ostream & ofs, int lit, char reg){}
-    void AssemblyWrite(std::ostream & ofs, int lit, char reg) {  }
-    void SetReg(char reg) { }
-
-    std::string AsString() {
-      std::stringstream out_str;
-      out_str << "a" << mVarID;
-      return out_str.str();
-    }
+  void Emit(CEmitter & out) const;
+  std::string AsString() const;
 
-    std::string AsAssemblyString() {
-      return std::string(""); // Place holder!
-    }
-    std::string GetReg() {
-      std::stringstream out_str;
-      out_str << "a" << mVarID;
-      return out_str.str();
-    }
-    int GetID() { return mVarID; }
+  static int InternLabel(const std::string & name);
+  static const std::string & GetLabelName(int id) { return mLabelNames[id]; }
+};
 
-    //virtual bool IsArray() { return true; }
-  };
+class ICEntry {
+private:
 
   ICArray * mArray;
-  std::string mInst;
+  int mOp;                 // Opcode::OpcodeNames
   std::string label;
   std::string comment;
-  std::vector<ICArg_Base*> mArgs;
+  ICOperand mArgs[3];
+  int mNumArgs;
   int mBlockID;
   int mLineNumber;
   bool mDelete;
-  bool mSimplify;
+
+  // Helpers for PrintTC(); 'reg' is the scratch register to use if an arg is not in one.
+  CTCArg ArgHome(int position) const;
+  CTCArg ReadArg(CTubeCode & code, int position, char reg) const;
+  void WriteArg(CTubeCode & code, int position, char reg) const;
+  CTCArg DestReg(int position, char reg) const;
+  CTCArg Address(int position) const { return CTCArg::Number(mArgs[position].GetID()); }
+  bool InRegister(int position) const { return ArgHome(position).mKind != CTCArg::NONE; }
+  void ResizeTC(CTubeCode & code, int position) const;
 
 // END OF PRIVATE ICEntry
 
 public:
-  ICEntry(std::string inInst, std::string in_label, ICArray * array)
-      : mInst(inInst)
+  ICEntry(int inOp, std::string in_label, ICArray * array)
+      : mArray(array)
+      , mOp(inOp)
       , label(in_label)
-      , mArray(array)
+      , mNumArgs(0)
       , mBlockID(0)
       , mLineNumber(0)
       , mDelete(false)
-      , mSimplify(false)
-    { ; }
+    { compile_context.GetICArena().OnRelease(this); }
   ~ICEntry() { ; }
 
-  const std::string & GetInstName() const { return mInst; }
+  // Entries live in the IC arena and are all freed together when it is released.
+  static void * operator new(size_t size) { return compile_context.GetICArena().Allocate(size); }
+  static void operator delete(void *) { ; }
+
+  int GetOpcode() const { return mOp; }
+  std::string GetInstName() const { return Opcode::AsString(mOp); }
   const std::string & GetLabel() const { return label; }
   const std::string & GetComment() const { return comment; }
-  unsigned int GetNumArgs() const { return mArgs.size(); }
-  std::string GetArg(int position) const { return mArgs[position]->AsString(); }
-  bool GetSimplify() const { return mSimplify; }
+  unsigned int GetNumArgs() const { return mNumArgs; }
+  const ICOperand & GetOperand(int position) const { return mArgs[position]; }
+  std::string GetArg(int position) const { return mArgs[position].AsString(); }
+  int GetArgID(int position) const { return mArgs[position].GetID(); }
+  bool IsScalarArg(int position) const { return mArgs[position].IsScalar(); }
+  bool IsConstArg(int position) const { return mArgs[position].IsConst(); }
   int GetBlockID() const { return mBlockID; }
   int GetLineNumber() const { return mLineNumber; }
   bool GetDelete() const { return mDelete; }
 
-  void AddArrayArg(int id)         { mArgs.push_back(new ICArg_VarArray(id)); }
-  void AddConstArg(std::string id) { mArgs.push_back(new ICArg_Const(id)); }
-  void AddScalarArg(int id)        { mArgs.push_back(new ICArg_VarScalar(id)); }
+  void AddArg(const ICOperand & arg) { mArgs[mNumArgs++] = arg; }
+  void SetOperand(int position, const ICOperand & arg) { mArgs[position] = arg; }
 
   void SetLabel(std::string in_lab) { label = in_lab; }
   void SetComment(std::string cmt) { comment = cmt; }
@@ -231,15 +190,20 @@ public:
   void SetLineNumber(int lineNumber) { mLineNumber = lineNumber;}
   void IncBlockID() { mBlockID++; }
   void SetDelete(bool in) { mDelete = in; }
-  void SetSimplify(bool in) { mSimplify = in; }
 
   //void EliminateDeadCode();
 
-  void PrintIC(std::ostream & ofs);
-  //void OptimizeIC(std::map<std::string, variableTracker> & trackerMap);
-  void TrackVariables();
-  bool OptimizeIC();
-  void PrintTC(std::ostream & ofs);
+  void PrintIC(CEmitter & out);
+  bool HasScalarArg(int id) const;
+  bool ReadsScalar(int id) const;
+
+  // Rewrite every use of scalar 'id' as 'value' (a constant or another scalar).
+  void ReplaceScalarArg(int id, const ICOperand & value);
+  // Turn this entry into "val_copy value <current output>".
+  void SetToCopy(const ICOperand & value);
+  // Turn this entry into a two-argument instruction.
+  void SetInstruction(int op, const ICOperand & arg0, const ICOperand & arg1);
+  void PrintTC(CTubeCode & code);
 };
 
 //END OF ICEntry
@@ -248,102 +212,61 @@ class ICArray {
 private:
   std::vector <ICEntry*> mICArray;
   std::map<std::string, int> mMemoryMap;
-  std::map<std::string, variableTracker *> mTrackerMap;
-  std::map<std::string, std::string> mReplaceArgs;
+  std::vector<variableTracker> mTrackers;   // Indexed by variable ID.
   std::map<int,std::string> mRegs;
-  int mBlockID;
+  std::vector<int> mWorklist;      // Lines OptimizeIC() still needs to look at.
+  std::vector<bool> mOnWorklist;
   int mMemPosition;
   bool mFirst;
 
-  // There are three types of argument requirements for instructions:
-  // * VALUE  - This arg is an input value: literal numbers or chars, scalars, labels, etc.
-  // * SCALAR - This arg is an output scalar variable that gets written to.
-  // * ARRAY  - This arg is an array that gets somehow manipulated
-
-
-  int GetBlockID() const { return mBlockID; }
-  int IncBlockID() { return mBlockID++; }
-
-  struct ArgType {
-    enum type { NONE=0, VALUE, SCALAR, ARRAY };
-  };
-
-  std::map<std::string, std::vector<ArgType::type> > mArgTypeMap;
-
-  // Helper method to identify types of arguments expected with each nstruction
-  void SetupArgs(std::string inst_name, ArgType::type type1, ArgType::type type2, ArgType::type type3) {
-    std::vector<ArgType::type> & arg_types = mArgTypeMap[inst_name];
-    arg_types.push_back(type1);
-    arg_types.push_back(type2);
-    arg_types.push_back(type3);
-  }
+  // Helper methods for OptimizeIC()
+  void RunWorklist();
+  void Revisit(int line);
+  void TrackLine(int line, int block);
+  void UntrackLine(int line);
+  void DeleteLine(int line);
+  void RewriteLine(int line, int id, const ICOperand & value);
+  bool OptimizeLine(int line);
 
   // Helper methods to add arguments to mInstructions, while verifying their types.
-  void AddArg(ICEntry * entry, int in_arg, ArgType::type expected_type);
-  void AddArg(ICEntry * entry, const std::string & in_arg, ArgType::type expected_type);
+  void AddArg(ICEntry * entry, int in_arg, Opcode::ArgKind expected_type);
+  void AddArg(ICEntry * entry, const std::string & in_arg, Opcode::ArgKind expected_type);
 
 public:
 
 
   int static_memory_size;
-  ICArray() : mMemPosition(1), mFirst(true) {
-    // Fill out the arg types for each mInstruction
-    SetupArgs("val_copy",    ArgType::VALUE,  ArgType::SCALAR, ArgType::NONE);
-    SetupArgs("add",         ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("sub",         ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("mult",        ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("div",         ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("mod",         ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("test_less",   ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("test_gtr",    ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("test_equ",    ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("test_nequ",   ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("test_lte",    ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("test_gte",    ArgType::VALUE,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("jump",        ArgType::VALUE,  ArgType::NONE,   ArgType::NONE);
-    SetupArgs("jump_if_0",   ArgType::VALUE,  ArgType::VALUE,  ArgType::NONE);
-    SetupArgs("jump_if_n0",  ArgType::VALUE,  ArgType::VALUE,  ArgType::NONE);
-    SetupArgs("random",      ArgType::VALUE,  ArgType::SCALAR, ArgType::NONE);
-    SetupArgs("out_int",     ArgType::VALUE,  ArgType::NONE,   ArgType::NONE);
-    SetupArgs("out_char",    ArgType::VALUE,  ArgType::NONE,   ArgType::NONE);
-    SetupArgs("nop",         ArgType::NONE,   ArgType::NONE,   ArgType::NONE);
-    SetupArgs("push",        ArgType::VALUE,  ArgType::NONE,   ArgType::NONE);
-    SetupArgs("pop",         ArgType::SCALAR, ArgType::NONE,   ArgType::NONE);
-    SetupArgs("ar_get_idx",  ArgType::ARRAY,  ArgType::VALUE,  ArgType::SCALAR);
-    SetupArgs("ar_set_idx",  ArgType::ARRAY,  ArgType::VALUE,  ArgType::VALUE);
-    SetupArgs("ar_get_size", ArgType::ARRAY,  ArgType::SCALAR, ArgType::NONE);
-    SetupArgs("ar_set_size", ArgType::ARRAY,  ArgType::VALUE,  ArgType::NONE);
-    SetupArgs("ar_copy",     ArgType::ARRAY,  ArgType::ARRAY,  ArgType::NONE);
-    SetupArgs("ar_push",     ArgType::ARRAY,  ArgType::NONE,   ArgType::NONE);
-    SetupArgs("ar_pop",      ArgType::ARRAY,  ArgType::NONE,   ArgType::NONE);
-  }
+  ICArray() : mMemPosition(1), mFirst(true) { ; }
   ~ICArray() { ; }
 
   ICEntry& AddLabel(std::string label_id, std::string cmt="");
 
-  void AddVariable(std::string name, variableTracker * tracker)
-  {
-      mTrackerMap[name] = tracker;
-  }
-
-  variableTracker * FindVariable(std::string name){
-   if( mTrackerMap.find(name) != mTrackerMap.end()){
-       return mTrackerMap[name];
-   }
-   else return NULL;
+  variableTracker * FindVariable(int id){
+   if (id < 0 || id >= (int) mTrackers.size() || !mTrackers[id].seen) return NULL;
+   return &mTrackers[id];
    }
 
-  void RemoveVariable(std::string name){
-     if( mTrackerMap.find(name) != mTrackerMap.end()){
-         mTrackerMap.erase(name);
-     }
+  // Start tracking over, with room for variable IDs below num_vars.  Trackers are then
+  // kept up to date line by line (TrackLine/UntrackLine) as the IC is rewritten.
+  void ResetVariables(int num_vars) {
+    mTrackers.clear();
+    mTrackers.resize(num_vars);
   }
+  void ClearVariables() { std::vector<variableTracker>().swap(mTrackers); }
 
   void AddEntry(std::string key){
     mMemoryMap[key] = mMemPosition;
     mMemPosition = mMemPosition + 1;
   }
 
+  int GetNumEntries() const { return mICArray.size(); }
+  ICEntry * GetEntry(int line) const { return mICArray[line]; }
+  // Put each entry in front of the line paired with it (the pairs must be sorted by line).
+  void InsertEntries(const std::vector<std::pair<int, ICEntry *> > & entries);
+
+  // Is the argument at this position written to (rather than read) by the instruction?
+  static bool IsArgWritten(int op, int position) { return Opcode::IsArgWritten(op, position); }
+
   bool GetFirst() const { return mFirst; }
   void SetFirst(bool in) { mFirst = in; }
   void AddReg( int value, std::string name) { mRegs[value] = name; }
@@ -366,32 +289,34 @@ public:
   // All forms of Add() method.
   // Arguments can either be variables (where an int represents the variable ID) or
   // constant values (where a string holds the constant's lexeme).  And 'a' or 's' will
-  // automatically be prepended to an int for a variable based on the mInstruction used.
-  ICEntry& Add(std::string mInst, int arg1=-1, int arg2=-1, int arg3=-1,
+  // automatically be prepended to an int for a variable based on the instruction used.
+  ICEntry& Add(Opcode::OpcodeNames op, int arg1=-1, int arg2=-1, int arg3=-1,
                                                     std::string cmt="");
 
-  ICEntry& Add(std::string mInst, std::string arg1, int arg2=-1, int arg3=-1,
+  ICEntry& Add(Opcode::OpcodeNames op, std::string arg1, int arg2=-1, int arg3=-1,
                                                          std::string cmt="");
 
-  ICEntry& Add(std::string mInst, int arg1, std::string arg2, int arg3=-1,
+  ICEntry& Add(Opcode::OpcodeNames op, int arg1, std::string arg2, int arg3=-1,
                                                       std::string cmt="");
 
-  ICEntry& Add(std::string mInst, std::string arg1, std::string arg2,
+  ICEntry& Add(Opcode::OpcodeNames op, std::string arg1, std::string arg2,
                                     int arg3=-1, std::string cmt="");
 
-  ICEntry& Add(std::string mInst, int arg1, int arg2, std::string arg3,
+  ICEntry& Add(Opcode::OpcodeNames op, int arg1, int arg2, std::string arg3,
                                                    std::string cmt="");
 
-  ICEntry& Add(std::string mInst, std::string arg1, int arg2, std::string arg3,
+  ICEntry& Add(Opcode::OpcodeNames op, std::string arg1, int arg2, std::string arg3,
                                                            std::string cmt="");
 
-  ICEntry& Add(std::string mInst, int arg1, std::string arg2, std::string arg3,
+  ICEntry& Add(Opcode::OpcodeNames op, int arg1, std::string arg2, std::string arg3,
                                                            std::string cmt="");
-  ICEntry& Add(std::string mInst, std::string arg1, std::string arg2,
+  ICEntry& Add(Opcode::OpcodeNames op, std::string arg1, std::string arg2,
                                std::string arg3, std::string cmt="");
 
   void PrintIC(std::ostream & ofs);
-  void OptimizeIC();
+  void OptimizeIC(bool move_code = false);
+  // TubeCode only: step pointers through arrays in loops (see strength_reduction.h).
+  void ReduceStrength();
   void PrintTC(std::ostream & ofs);
 };
 
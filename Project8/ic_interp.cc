@@ -0,0 +1,251 @@
+#include "ic_interp.h"
+#include "emitter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+/******************************************
+ * BEGIN CICInterpreter
+ *****************************************/
+
+CICInterpreter::CICInterpreter(const ICArray & ic_array)
+  : mNumScalars(0), mNumArrays(0), mNumExecuted(0)
+{
+  // Find how many scalar and array IDs there are, and where each label points.
+  std::map<int, int> label_pos;            // Interned label ID -> instruction index.
+  int num_insts = 0;
+  for (int line = 0; line < ic_array.GetNumEntries(); line++) {
+    const ICEntry * entry = ic_array.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    if (entry->GetLabel() != "") label_pos[ICOperand::InternLabel(entry->GetLabel())] = num_insts;
+    if (entry->GetOpcode() == Opcode::NONE) continue;
+    num_insts++;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      const ICOperand & arg = entry->GetOperand(i);
+      if (arg.IsScalar() && arg.GetID() >= mNumScalars) mNumScalars = arg.GetID() + 1;
+      if (arg.IsArray() && arg.GetID() >= mNumArrays) mNumArrays = arg.GetID() + 1;
+    }
+  }
+
+  // Scalars take the first slots; each distinct constant gets one more.
+  mSlots.assign(mNumScalars, -1);
+  std::map<int, int> const_slots;
+  mCode.reserve(num_insts + 1);
+  for (int line = 0; line < ic_array.GetNumEntries(); line++) {
+    const ICEntry * entry = ic_array.GetEntry(line);
+    if (entry->GetDelete() || entry->GetOpcode() == Opcode::NONE) continue;
+
+    CICInst inst;
+    inst.mOp = entry->GetOpcode();
+    inst.mArg[0] = inst.mArg[1] = inst.mArg[2] = 0;
+    inst.mLine = line;
+    inst.mCount = 0;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      const ICOperand & arg = entry->GetOperand(i);
+      if (arg.IsScalar() || arg.IsArray()) {
+        inst.mArg[i] = arg.GetID();
+        continue;
+      }
+      if (Opcode::IsArgWritten(inst.mOp, i)) {
+        std::cerr << "INTERNAL ERROR: IC line " << line + 1 << " writes to a constant." << std::endl;
+        exit(1);
+      }
+      int value = arg.GetValue();
+      if (arg.IsLabel()) {
+        std::map<int, int>::iterator it = label_pos.find(value);
+        if (it == label_pos.end()) {
+          std::cerr << "INTERNAL ERROR: Unknown label '" << ICOperand::GetLabelName(value)
+                    << "' on IC line " << line + 1 << "." << std::endl;
+          exit(1);
+        }
+        value = it->second;
+      }
+      if (const_slots.find(value) == const_slots.end()) {
+        const_slots[value] = mSlots.size();
+        mSlots.push_back(value);
+      }
+      inst.mArg[i] = const_slots[value];
+    }
+    mCode.push_back(inst);
+  }
+
+  if (mSlots.size() == 0) mSlots.push_back(0);
+
+  // Finish with a NONE, which ends the program.
+  CICInst halt;
+  halt.mOp = Opcode::NONE;
+  halt.mArg[0] = halt.mArg[1] = halt.mArg[2] = 0;
+  halt.mLine = ic_array.GetNumEntries();
+  halt.mCount = 0;
+  mCode.push_back(halt);
+}
+
+CICInterpreter::RunStatus CICInterpreter::Run(std::ostream & os, long inst_limit)
+{
+  for (int i = 0; i < mNumScalars; i++) mSlots[i] = -1;
+  mArrays.assign(mNumArrays, std::vector<int>());
+  mStack.clear();
+  mArrayStack.clear();
+  mRandom.Seed(1);
+  for (int id = 0; id < (int) mCode.size(); id++) mCode[id].mCount = 0;
+
+  CEmitter out(1 << 16);
+  const unsigned int num_insts = mCode.size() - 1;
+  int * const slots = &mSlots[0];
+  const long limit = (inst_limit > 0) ? inst_limit : -1;
+  long executed = 0;
+  RunStatus status = RUN_DONE;
+  unsigned int pos = 0;
+
+#define ARG0 (slots[inst.mArg[0]])
+#define ARG1 (slots[inst.mArg[1]])
+#define ARG2 (slots[inst.mArg[2]])
+#define JUMP_TO(target) { unsigned int next = (target); pos = (next < num_insts) ? next : num_insts; continue; }
+
+  while (true) {
+    CICInst & inst = mCode[pos];
+    if (inst.mOp == Opcode::NONE) break;
+    if (executed == limit) {
+      out << "Reached execution count limit of " << (int) limit << ".  Halting.\n";
+      status = RUN_LIMIT;
+      break;
+    }
+    executed++;
+    inst.mCount++;
+    pos++;
+
+    switch (inst.mOp) {
+    case Opcode::VAL_COPY:  ARG1 = ARG0; break;
+    case Opcode::ADD:       ARG2 = (int) ((unsigned int) ARG0 + (unsigned int) ARG1); break;
+    case Opcode::SUB:       ARG2 = (int) ((unsigned int) ARG0 - (unsigned int) ARG1); break;
+    case Opcode::MULT:      ARG2 = (int) ((unsigned int) ARG0 * (unsigned int) ARG1); break;
+    case Opcode::DIV:
+      if (ARG1 == 0) out << "ERROR: div: Division by Zero\n";
+      else if (ARG1 == -1) ARG2 = (int) (0u - (unsigned int) ARG0);
+      else ARG2 = ARG0 / ARG1;
+      break;
+    case Opcode::MOD:
+      if (ARG1 == 0) out << "ERROR: mod: Division by Zero\n";
+      else if (ARG1 == -1) ARG2 = 0;
+      else ARG2 = ARG0 % ARG1;
+      break;
+    case Opcode::TEST_LESS: ARG2 = ARG0 < ARG1;  break;
+    case Opcode::TEST_GTR:  ARG2 = ARG0 > ARG1;  break;
+    case Opcode::TEST_EQU:  ARG2 = ARG0 == ARG1; break;
+    case Opcode::TEST_NEQU: ARG2 = ARG0 != ARG1; break;
+    case Opcode::TEST_LTE:  ARG2 = ARG0 <= ARG1; break;
+    case Opcode::TEST_GTE:  ARG2 = ARG0 >= ARG1; break;
+    case Opcode::JUMP:       JUMP_TO(ARG0);
+    case Opcode::JUMP_IF_0:  if (ARG0 == 0) JUMP_TO(ARG1); break;
+    case Opcode::JUMP_IF_N0: if (ARG0 != 0) JUMP_TO(ARG1); break;
+    case Opcode::RANDOM:
+      if (ARG0 <= 0) out << "ERROR: random: must have a positive upper limit\n";
+      else ARG1 = mRandom.Next() % ARG0;
+      break;
+    case Opcode::OUT_INT:   out << ARG0; break;
+    case Opcode::OUT_CHAR:  out << (char) ARG0; break;
+    case Opcode::NOP:       break;
+    case Opcode::PUSH:      mStack.push_back(ARG0); break;
+    case Opcode::POP:
+      if (mStack.size() == 0) {
+        out << "ERROR: Attempting to pop off an empty stack.\n";
+        ARG0 = 0;
+      } else {
+        ARG0 = mStack.back();
+        mStack.pop_back();
+      }
+      break;
+    case Opcode::AR_GET_IDX:
+    case Opcode::AR_SET_IDX: {
+      std::vector<int> & array = mArrays[inst.mArg[0]];
+      if ((unsigned int) ARG1 >= array.size()) {
+        out << "ERROR(line " << inst.mLine + 1 << "): " << Opcode::AsString(inst.mOp)
+            << ": Array index out of bounds (idx=" << ARG1 << " array_size="
+            << (int) array.size() << ").\n";
+      }
+      else if (inst.mOp == Opcode::AR_GET_IDX) ARG2 = array[ARG1];
+      else array[ARG1] = ARG2;
+      break;
+    }
+    case Opcode::AR_GET_SIZE: ARG1 = mArrays[inst.mArg[0]].size(); break;
+    case Opcode::AR_SET_SIZE:
+      if (ARG1 < 0) out << "ERROR: ar_set_siz: Cannot set array size to a negative value\n";
+      else mArrays[inst.mArg[0]].resize(ARG1, -1);
+      break;
+    case Opcode::AR_COPY:
+      if (inst.mArg[0] != inst.mArg[1]) mArrays[inst.mArg[1]] = mArrays[inst.mArg[0]];
+      break;
+    case Opcode::AR_PUSH:   mArrayStack.push_back(mArrays[inst.mArg[0]]); break;
+    case Opcode::AR_POP:
+      if (mArrayStack.size() == 0) {
+        out << "ERROR: Attempting to pop off an empty stack.\n";
+      } else {
+        mArrays[inst.mArg[0]].swap(mArrayStack.back());
+        mArrayStack.pop_back();
+      }
+      break;
+    default:
+      std::cerr << "INTERNAL ERROR: Unknown opcode " << inst.mOp << " on IC line "
+                << inst.mLine + 1 << "." << std::endl;
+      status = RUN_ERROR;
+      pos = num_insts;
+      break;
+    }
+    if (out.GetSize() > (1 << 16)) out.WriteTo(os);
+  }
+
+#undef ARG0
+#undef ARG1
+#undef ARG2
+#undef JUMP_TO
+
+  out.WriteTo(os);
+  mNumExecuted = executed;
+  return status;
+}
+
+long CICInterpreter::GetOpCount(int op) const
+{
+  long count = 0;
+  for (int id = 0; id < (int) mCode.size(); id++) {
+    if (mCode[id].mOp == op) count += mCode[id].mCount;
+  }
+  return count;
+}
+
+void CICInterpreter::PrintOpCounts(std::ostream & os) const
+{
+  CEmitter out;
+  char line[64];
+  for (int op = Opcode::NONE + 1; op < Opcode::NUM_OPCODES; op++) {
+    long count = GetOpCount(op);
+    if (count == 0) continue;
+    snprintf(line, sizeof(line), "%-14s %12ld\n", Opcode::AsString(op), count);
+    out << line;
+  }
+  snprintf(line, sizeof(line), "%-14s %12ld\n", "total", mNumExecuted);
+  out << line;
+  out.WriteTo(os);
+}
+
+void CICInterpreter::PrintComparison(const CICInterpreter & before, const CICInterpreter & after,
+                                     std::ostream & os)
+{
+  CEmitter out;
+  char line[80];
+  snprintf(line, sizeof(line), "%-14s %12s %12s %12s\n", "opcode", "before", "after", "saved");
+  out << line;
+  for (int op = Opcode::NONE + 1; op < Opcode::NUM_OPCODES; op++) {
+    long count_before = before.GetOpCount(op);
+    long count_after = after.GetOpCount(op);
+    if (count_before == 0 && count_after == 0) continue;
+    snprintf(line, sizeof(line), "%-14s %12ld %12ld %12ld\n", Opcode::AsString(op),
+             count_before, count_after, count_before - count_after);
+    out << line;
+  }
+  snprintf(line, sizeof(line), "%-14s %12ld %12ld %12ld\n", "total", before.mNumExecuted,
+           after.mNumExecuted, before.mNumExecuted - after.mNumExecuted);
+  out << line;
+  out.WriteTo(os);
+}
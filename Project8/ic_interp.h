@@ -0,0 +1,73 @@
+#ifndef IC_INTERP_H
+#define IC_INTERP_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CICInterpreter executes an ICArray straight from memory, the way Test_Suite/TubeIC runs a
+//  printed .ic file, so the IC can be checked and measured without lowering it to TubeCode.
+//
+//  The constructor decodes the IC into a flat list of CICInst: label-only entries disappear,
+//  labels become instruction indices, and scalar arguments become slots in a value file that
+//  holds every scalar followed by the constants.  Arrays are kept in their own table by ID.
+//
+//  Machine model (matching TubeIC):
+//    * Scalars start at -1, and arrays start out empty.  Growing an array fills it with -1.
+//    * push/pop and ar_push/ar_pop use two separate stacks.
+//    * Runtime errors (bad array index, division by zero, empty stack, ...) are reported in
+//      the output and execution goes on.
+//    * A jump to a position outside of the program ends it.
+//
+//  Every run counts how many times each instruction executed; GetOpCount() sums those per
+//  opcode, which is how the -run-ic and -check-ic flags report what the optimizer saved.
+//
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ic.h"
+#include "opcode.h"
+#include "tube_random.h"
+
+struct CICInst {
+  int mOp;                   // Opcode::OpcodeNames
+  int mArg[3];               // Value-file slot (values), or array ID (arrays).
+  int mLine;                 // Index of the entry in the ICArray.
+  long mCount;               // Times executed during the last Run().
+};
+
+class CICInterpreter {
+public:
+  enum RunStatus { RUN_DONE=0, RUN_LIMIT, RUN_ERROR };
+
+private:
+  std::vector<CICInst> mCode;
+  std::vector<int> mSlots;                  // Value file: scalars by ID, then constants.
+  int mNumScalars;
+  int mNumArrays;
+  std::vector< std::vector<int> > mArrays;  // Indexed by array ID.
+  std::vector<int> mStack;                  // For push / pop.
+  std::vector< std::vector<int> > mArrayStack;  // For ar_push / ar_pop.
+  CTubeRandom mRandom;
+  long mNumExecuted;
+
+public:
+  CICInterpreter(const ICArray & ic_array);
+  ~CICInterpreter() { ; }
+
+  // Execute from the top, writing the program's output to 'out'.  A limit of 0 lets the
+  // program run until it ends; otherwise it halts after that many instructions.
+  RunStatus Run(std::ostream & out, long inst_limit = 0);
+
+  long GetNumExecuted() const { return mNumExecuted; }
+  long GetOpCount(int op) const;
+
+  // Write one line per opcode executed: how often it ran during the last Run().
+  void PrintOpCounts(std::ostream & out) const;
+
+  // Write the same table for two runs side by side (eg, before and after OptimizeIC).
+  static void PrintComparison(const CICInterpreter & before, const CICInterpreter & after,
+                              std::ostream & out);
+};
+
+#endif
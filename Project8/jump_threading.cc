@@ -0,0 +1,318 @@
+#include "jump_threading.h"
+#include "cfg.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN CJumpThreading
+ *****************************************/
+
+namespace {
+  const int MAX_ROUNDS = 16;     // Rounds of clean-up before giving up on reaching a fixed point.
+
+  bool CompareNewLabels(const std::pair<int, ICEntry *> & label1, const std::pair<int, ICEntry *> & label2)
+  {
+    return label1.first < label2.first;
+  }
+}
+
+// The first line at or after 'line' that has not been deleted (or the end of the IC).
+int CJumpThreading::NextLive(ICArray & ica, int line) const
+{
+  while (line < ica.GetNumEntries() && ica.GetEntry(line)->GetDelete()) line++;
+  return line;
+}
+
+// The first instruction that runs once control reaches 'line' (or the end of the IC).
+int CJumpThreading::Landing(ICArray & ica, int line) const
+{
+  while (line < ica.GetNumEntries() &&
+         (ica.GetEntry(line)->GetDelete() || ica.GetEntry(line)->GetOpcode() == Opcode::NONE)) {
+    line++;
+  }
+  return line;
+}
+
+// A label that control can go to in order to land where 'line' does.  One is made (and put
+// in front of that line at the end of Run()) if there is none yet.
+int CJumpThreading::LabelAt(ICArray & ica, int line)
+{
+  int landing = Landing(ica, line);
+  for (int cur = line; cur <= landing && cur < ica.GetNumEntries(); cur++) {
+    const ICEntry * entry = ica.GetEntry(cur);
+    if (!entry->GetDelete() && entry->GetLabel() != "") return ICOperand::InternLabel(entry->GetLabel());
+  }
+  std::map<int, int>::iterator made = mNewLabelAt.find(landing);
+  if (made != mNewLabelAt.end()) return made->second;
+
+  int id;
+  std::string name;
+  do {
+    name = "thread_" + std::to_string(mNextLabel++);
+    id = ICOperand::InternLabel(name);
+  } while (mLabelLine.count(id) > 0);
+  ICEntry * entry = new ICEntry(Opcode::NONE, "", &ica);
+  entry->SetLabel(name);
+  mNewLabels.push_back(std::make_pair(landing, entry));
+  mNewLabelAt[landing] = id;
+  mLabelLine[id] = landing;
+  return id;
+}
+
+// Where the jump on 'line' can go instead of 'label', following jumps that only lead on to
+// other jumps.  Returns 'label' itself if there is nowhere better (or the jumps go round in
+// a loop).
+int CJumpThreading::ResolveTarget(ICArray & ica, int line, int label)
+{
+  const ICEntry * jump = ica.GetEntry(line);
+  int op = jump->GetOpcode();
+  bool conditional = (op != Opcode::JUMP);
+  bool zero = (op == Opcode::JUMP_IF_0);     // Is the tested value 0 when this jump is taken?
+  std::vector<int> visited(1, label);
+  int target = label;
+  while (true) {
+    std::map<int, int>::iterator it = mLabelLine.find(target);
+    if (it == mLabelLine.end()) break;
+    int landing = Landing(ica, it->second);
+    if (landing >= ica.GetNumEntries() || landing == line) break;
+
+    const ICEntry * entry = ica.GetEntry(landing);
+    int next_op = entry->GetOpcode();
+    int next;
+    if (next_op == Opcode::JUMP && entry->GetOperand(0).IsLabel()) {
+      next = entry->GetOperand(0).GetValue();
+    }
+    else if (conditional && (next_op == Opcode::JUMP_IF_0 || next_op == Opcode::JUMP_IF_N0) &&
+             entry->GetOperand(0) == jump->GetOperand(0) && entry->GetOperand(1).IsLabel()) {
+      bool taken = (next_op == Opcode::JUMP_IF_0) == zero;
+      next = taken ? entry->GetOperand(1).GetValue() : LabelAt(ica, landing + 1);
+    }
+    else break;
+
+    if (std::find(visited.begin(), visited.end(), next) != visited.end()) return label;
+    visited.push_back(next);
+    target = next;
+  }
+  return target;
+}
+
+bool CJumpThreading::ThreadJumps(ICArray & ica)
+{
+  bool changed = false;
+  for (int i = 0; i < (int) mJumps.size(); i++) {
+    int line = mJumps[i];
+    ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    int target_arg = CControlFlowGraph::JumpTargetArg(entry->GetOpcode());
+    if (!entry->GetOperand(target_arg).IsLabel()) continue;
+    int label = entry->GetOperand(target_arg).GetValue();
+    int target = ResolveTarget(ica, line, label);
+    if (target == label) continue;
+    entry->SetOperand(target_arg, ICOperand(ICOperand::LABEL, target));
+    mNumChanged++;
+    changed = true;
+  }
+  return changed;
+}
+
+// Nothing runs the lines after an unconditional jump until the next label.
+bool CJumpThreading::RemoveUnreachable(ICArray & ica)
+{
+  bool changed = false;
+  for (int i = 0; i < (int) mJumps.size(); i++) {
+    ICEntry * entry = ica.GetEntry(mJumps[i]);
+    if (entry->GetDelete() || entry->GetOpcode() != Opcode::JUMP) continue;
+    for (int next = mJumps[i] + 1; next < ica.GetNumEntries(); next++) {
+      ICEntry * cur = ica.GetEntry(next);
+      if (cur->GetDelete()) continue;
+      if (cur->GetLabel() != "" || mNewLabelAt.count(next) > 0) break;
+      cur->SetDelete(true);
+      mNumChanged++;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// jump_if_0 x L; jump M; L:  ->  jump_if_n0 x M; L:  (and the same the other way round)
+bool CJumpThreading::InvertBranches(ICArray & ica)
+{
+  bool changed = false;
+  for (int i = 0; i < (int) mJumps.size(); i++) {
+    int line = mJumps[i];
+    ICEntry * branch = ica.GetEntry(line);
+    int op = branch->GetOpcode();
+    if (branch->GetDelete() || (op != Opcode::JUMP_IF_0 && op != Opcode::JUMP_IF_N0)) continue;
+    if (!branch->GetOperand(1).IsLabel()) continue;
+    int next = NextLive(ica, line + 1);
+    if (next >= ica.GetNumEntries() || mNewLabelAt.count(next) > 0) continue;
+    ICEntry * jump = ica.GetEntry(next);
+    if (jump->GetOpcode() != Opcode::JUMP || jump->GetLabel() != "" || !jump->GetOperand(0).IsLabel()) continue;
+    std::map<int, int>::iterator target = mLabelLine.find(branch->GetOperand(1).GetValue());
+    if (target == mLabelLine.end() || Landing(ica, target->second) != Landing(ica, next + 1)) continue;
+
+    int inverse = (op == Opcode::JUMP_IF_0) ? Opcode::JUMP_IF_N0 : Opcode::JUMP_IF_0;
+    branch->SetInstruction(inverse, branch->GetOperand(0), jump->GetOperand(0));
+    jump->SetDelete(true);
+    mNumChanged++;
+    changed = true;
+  }
+  return changed;
+}
+
+// A jump to where control would go next anyway does nothing.
+bool CJumpThreading::RemoveFallThroughs(ICArray & ica)
+{
+  bool changed = false;
+  for (int i = 0; i < (int) mJumps.size(); i++) {
+    int line = mJumps[i];
+    ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    const ICOperand & target = entry->GetOperand(CControlFlowGraph::JumpTargetArg(entry->GetOpcode()));
+    if (!target.IsLabel()) continue;
+    std::map<int, int>::iterator it = mLabelLine.find(target.GetValue());
+    if (it == mLabelLine.end() || Landing(ica, it->second) != Landing(ica, line + 1)) continue;
+    entry->SetDelete(true);
+    mNumChanged++;
+    changed = true;
+  }
+  return changed;
+}
+
+// Find the live jumps and labels, where each label is, and which labels are named by more
+// than the target of a jump.
+void CJumpThreading::FindLines(ICArray & ica)
+{
+  mJumps.clear();
+  mLabeled.clear();
+  mAddressTaken.clear();
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    int op = entry->GetOpcode();
+    if (entry->GetLabel() != "") {
+      mLabeled.push_back(line);
+      mLabelLine[ICOperand::InternLabel(entry->GetLabel())] = line;
+    }
+    if (Opcode::IsJump(op)) mJumps.push_back(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!entry->GetOperand(i).IsLabel()) continue;
+      if (!Opcode::IsJump(op) || i != CControlFlowGraph::JumpTargetArg(op)) {
+        mAddressTaken[entry->GetOperand(i).GetValue()] = true;
+      }
+    }
+  }
+}
+
+// Count the live jumps to each label.
+void CJumpThreading::CountRefs(ICArray & ica)
+{
+  mRefs.clear();
+  for (int i = 0; i < (int) mJumps.size(); i++) {
+    const ICEntry * entry = ica.GetEntry(mJumps[i]);
+    if (entry->GetDelete()) continue;
+    const ICOperand & target = entry->GetOperand(CControlFlowGraph::JumpTargetArg(entry->GetOpcode()));
+    if (target.IsLabel()) mRefs[target.GetValue()]++;
+  }
+}
+
+// Labels on the same line all lead to the same place: send every jump to one of them (one a
+// val_copy names, if there is one, since that one has to stay).
+bool CJumpThreading::MergeLabels(ICArray & ica)
+{
+  std::map<int, int> merged;   // Label ID -> label to jump to instead.
+  int group_end = -1;
+  for (int i = 0; i < (int) mLabeled.size(); i++) {
+    int line = mLabeled[i];
+    if (line <= group_end) continue;
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete() || entry->GetLabel() == "") continue;
+
+    std::vector<int> group;
+    while (true) {
+      group.push_back(ICOperand::InternLabel(entry->GetLabel()));
+      if (entry->GetOpcode() != Opcode::NONE) break;
+      int next = NextLive(ica, line + 1);
+      if (next >= ica.GetNumEntries() || ica.GetEntry(next)->GetLabel() == "") break;
+      line = next;
+      entry = ica.GetEntry(line);
+    }
+    group_end = line;
+    if (group.size() < 2) continue;
+    int keep = group[0];
+    for (int j = 0; j < (int) group.size(); j++) {
+      if (mAddressTaken.count(group[j]) > 0) { keep = group[j]; break; }
+    }
+    for (int j = 0; j < (int) group.size(); j++) {
+      if (group[j] != keep && mAddressTaken.count(group[j]) == 0) merged[group[j]] = keep;
+    }
+  }
+  if (merged.size() == 0) return false;
+
+  bool changed = false;
+  for (int i = 0; i < (int) mJumps.size(); i++) {
+    ICEntry * entry = ica.GetEntry(mJumps[i]);
+    if (entry->GetDelete()) continue;
+    int target_arg = CControlFlowGraph::JumpTargetArg(entry->GetOpcode());
+    if (!entry->GetOperand(target_arg).IsLabel()) continue;
+    std::map<int, int>::iterator it = merged.find(entry->GetOperand(target_arg).GetValue());
+    if (it == merged.end()) continue;
+    entry->SetOperand(target_arg, ICOperand(ICOperand::LABEL, it->second));
+    mNumChanged++;
+    changed = true;
+  }
+  return changed;
+}
+
+// Drop the labels that nothing names.
+bool CJumpThreading::RemoveLabels(ICArray & ica)
+{
+  bool changed = false;
+  for (int i = 0; i < (int) mLabeled.size(); i++) {
+    ICEntry * entry = ica.GetEntry(mLabeled[i]);
+    if (entry->GetDelete() || entry->GetLabel() == "") continue;
+    int id = ICOperand::InternLabel(entry->GetLabel());
+    if (mRefs.count(id) > 0 || mAddressTaken.count(id) > 0) continue;
+    if (entry->GetOpcode() == Opcode::NONE) entry->SetDelete(true);
+    else entry->SetLabel("");
+    mNumChanged++;
+    changed = true;
+  }
+  for (int i = 0; i < (int) mNewLabels.size(); i++) {
+    ICEntry * entry = mNewLabels[i].second;
+    int id = ICOperand::InternLabel(entry->GetLabel());
+    if (entry->GetDelete() || mRefs.count(id) > 0) continue;
+    entry->SetDelete(true);
+    mNewLabelAt.erase(mNewLabels[i].first);
+    mLabelLine.erase(id);
+    changed = true;
+  }
+  return changed;
+}
+
+int CJumpThreading::Run(ICArray & ica)
+{
+  mNumChanged = 0;
+  mLabelLine.clear();
+  mNewLabels.clear();
+  mNewLabelAt.clear();
+
+  for (int round = 0; round < MAX_ROUNDS; round++) {
+    FindLines(ica);
+    bool changed = ThreadJumps(ica);
+    changed |= RemoveUnreachable(ica);
+    changed |= InvertBranches(ica);
+    changed |= RemoveFallThroughs(ica);
+    CountRefs(ica);
+    if (MergeLabels(ica)) {
+      changed = true;
+      CountRefs(ica);
+    }
+    changed |= RemoveLabels(ica);
+    if (!changed) break;
+  }
+
+  std::stable_sort(mNewLabels.begin(), mNewLabels.end(), CompareNewLabels);
+  ica.InsertEntries(mNewLabels);
+  return mNumChanged;
+}
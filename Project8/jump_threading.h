@@ -0,0 +1,67 @@
+#ifndef JUMP_THREADING_H
+#define JUMP_THREADING_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CJumpThreading straightens out the control flow of an ICArray: the jumps that ASTNodeIf,
+//  ASTNodeWhile and the short-circuit operators leave behind, and the ones that constant
+//  propagation leaves pointing at the very next line.
+//    * A jump whose target starts with another jump goes straight to where that one goes.  A
+//      conditional jump that lands on another test of the same value already knows which way
+//      that test goes, so it goes there too (to the line after it if it falls through, which
+//      is given a label if it has none).
+//    * A jump to the line it would fall through to anyway is removed, and a conditional jump
+//      over a lone "jump M" becomes the opposite test jumping to M.
+//    * Lines after an unconditional jump that no label leads to can never run, and go.
+//    * Labels that mark the same line are merged (jumps are sent to one of them), and labels
+//      that nothing names any more are removed, so empty blocks disappear and their
+//      neighbours join up into longer blocks.
+//  These are repeated until nothing changes, since each can open the way for the others.
+//  Labels a val_copy names (return points) are never merged away or removed.
+//
+//  It works on the lines directly rather than on a CControlFlowGraph, so every step sees what
+//  the previous one changed without the graph being rebuilt; deleted lines are skipped, and
+//  RunWorklist() sweeps them out afterwards.
+//
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "ic.h"
+
+class CJumpThreading {
+private:
+  std::map<int, int> mLabelLine;                   // Label ID -> line it is on.
+  std::map<int, int> mRefs;                        // Label ID -> live jumps to it.
+  std::map<int, bool> mAddressTaken;               // Label ID -> named other than as a jump target?
+  std::vector<std::pair<int, ICEntry *> > mNewLabels;  // Labels to insert, and the line each goes before.
+  std::map<int, int> mNewLabelAt;                  // Line -> label ID to be inserted before it.
+  std::vector<int> mJumps;                         // Lines with live jumps (this round).
+  std::vector<int> mLabeled;                       // Lines with live labels (this round).
+  int mNextLabel;
+  int mNumChanged;
+
+  int NextLive(ICArray & ica, int line) const;
+  int Landing(ICArray & ica, int line) const;
+  int LabelAt(ICArray & ica, int line);
+  int ResolveTarget(ICArray & ica, int line, int label);
+
+  bool ThreadJumps(ICArray & ica);
+  bool RemoveUnreachable(ICArray & ica);
+  bool InvertBranches(ICArray & ica);
+  bool RemoveFallThroughs(ICArray & ica);
+  void FindLines(ICArray & ica);
+  void CountRefs(ICArray & ica);
+  bool MergeLabels(ICArray & ica);
+  bool RemoveLabels(ICArray & ica);
+
+public:
+  CJumpThreading() : mNextLabel(0), mNumChanged(0) { ; }
+  ~CJumpThreading() { ; }
+
+  // Thread jumps and clean up labels; returns how many lines were changed.
+  int Run(ICArray & ica);
+};
+
+#endif
@@ -0,0 +1,479 @@
+#include "lazy_code_motion.h"
+#include "cfg.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN CLazyCodeMotion
+ *****************************************/
+
+namespace {
+  // TubeCode cycles for one evaluation: array reads lower to two memory accesses, math to a
+  // single instruction, as does the val_copy that keeps a result in its temporary.
+  const double ARRAY_READ_COST = 200.0;
+  const double MATH_COST = 1.0;
+  const double COPY_COST = 1.0;
+
+  // How often a block runs, guessed from its loop depth the way the graph-coloring allocator
+  // weights spill costs.
+  double LoopWeight(const CControlFlowGraph & cfg, int block)
+  {
+    double weight = 1.0;
+    for (int depth = 0; depth < cfg.GetBlock(block).mLoopDepth && depth < 6; depth++) weight *= 10.0;
+    return weight;
+  }
+}
+
+double CLazyCodeMotion::EvalCost(int expr) const
+{
+  int op = mExprs[expr].mOp;
+  return (op == Opcode::AR_GET_IDX || op == Opcode::AR_GET_SIZE) ? ARRAY_READ_COST : MATH_COST;
+}
+
+// Is this line a pure expression that can be moved?  If so, fill in what it computes.
+bool CLazyCodeMotion::FindExpression(const ICEntry * entry, CExpression & expr) const
+{
+  int op = entry->GetOpcode();
+  if (entry->GetDelete()) return false;
+  expr.mOp = op;
+  expr.mArg0 = entry->GetOperand(0);
+  expr.mArg1 = ICOperand();
+
+  if (Opcode::IsMath(op)) {
+    expr.mArg1 = entry->GetOperand(1);
+    if (expr.mArg0.IsImmediate() && expr.mArg1.IsImmediate()) return false;  // Left to folding.
+    if ((op == Opcode::DIV || op == Opcode::MOD)
+        && !(expr.mArg1.IsImmediate() && expr.mArg1.GetValue() != 0)) return false;
+    if (Opcode::IsCommutative(op)) {
+      CExpression swapped = { op, expr.mArg1, expr.mArg0 };
+      CExpression plain = { op, expr.mArg0, expr.mArg1 };
+      if (swapped < plain) std::swap(expr.mArg0, expr.mArg1);
+    }
+    return true;
+  }
+  if (op == Opcode::AR_GET_IDX) {
+    expr.mArg1 = entry->GetOperand(1);
+    return true;
+  }
+  return op == Opcode::AR_GET_SIZE;
+}
+
+// Number the expressions that are evaluated in at least two different blocks.
+void CLazyCodeMotion::FindExpressions(ICArray & ica, const CControlFlowGraph & cfg)
+{
+  int num_lines = ica.GetNumEntries();
+  std::map<CExpression, int> expr_ids;
+  std::vector<CExpression> exprs;
+  std::vector<int> last_block, num_blocks;
+  std::vector<int> line_expr(num_lines, -1);
+
+  for (int line = 0; line < num_lines; line++) {
+    CExpression expr;
+    if (!cfg.IsReachable(cfg.GetBlockOf(line))) continue;
+    if (!FindExpression(ica.GetEntry(line), expr)) continue;
+    std::map<CExpression, int>::iterator it = expr_ids.find(expr);
+    int id;
+    if (it == expr_ids.end()) {
+      id = exprs.size();
+      expr_ids[expr] = id;
+      exprs.push_back(expr);
+      last_block.push_back(-1);
+      num_blocks.push_back(0);
+    }
+    else id = it->second;
+    line_expr[line] = id;
+    if (last_block[id] != cfg.GetBlockOf(line)) {
+      last_block[id] = cfg.GetBlockOf(line);
+      num_blocks[id]++;
+    }
+  }
+
+  std::vector<int> renumber(exprs.size(), -1);
+  mExprs.clear();
+  for (int id = 0; id < (int) exprs.size(); id++) {
+    if (num_blocks[id] < 2) continue;
+    renumber[id] = mExprs.size();
+    mExprs.push_back(exprs[id]);
+  }
+  mLineExpr.assign(num_lines, -1);
+  for (int line = 0; line < num_lines; line++) {
+    if (line_expr[line] != -1) mLineExpr[line] = renumber[line_expr[line]];
+  }
+  mTemp.assign(mExprs.size(), -1);
+}
+
+// Edges run between reachable blocks, plus one from nowhere into the entry block.
+void CLazyCodeMotion::FindEdges(const CControlFlowGraph & cfg)
+{
+  int num_blocks = cfg.GetNumBlocks();
+  mEdges.clear();
+  mInEdges.assign(num_blocks, std::vector<int>());
+  mOutEdges.assign(num_blocks, std::vector<int>());
+  if (num_blocks == 0) return;
+
+  CEdge entry = { -1, 0 };
+  mEdges.push_back(entry);
+  mInEdges[0].push_back(0);
+  for (int b = 0; b < num_blocks; b++) {
+    if (!cfg.IsReachable(b)) continue;
+    const std::vector<int> & succs = cfg.GetBlock(b).mSuccs;
+    for (int i = 0; i < (int) succs.size(); i++) {
+      if (!cfg.IsReachable(succs[i])) continue;
+      CEdge edge = { b, succs[i] };
+      mOutEdges[b].push_back(mEdges.size());
+      mInEdges[succs[i]].push_back(mEdges.size());
+      mEdges.push_back(edge);
+    }
+  }
+}
+
+// Insertions on an edge go at the top of its target if control only gets there along this
+// edge, and otherwise at the bottom of its source (before its jump, if it ends with one).
+int CLazyCodeMotion::InsertBlock(const CEdge & edge) const
+{
+  if (edge.mFrom == -1 || mInEdges[edge.mTo].size() == 1) return edge.mTo;
+  return edge.mFrom;
+}
+
+// Which expressions of the current chunk does this line change an input of?
+CLazyCodeMotion::Bits CLazyCodeMotion::LineKills(const ICEntry * entry) const
+{
+  int op = entry->GetOpcode();
+  Bits kills = 0;
+  for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+    if (Opcode::IsArgWritten(op, i)) kills |= mScalarMask[entry->GetArgID(i)];
+  }
+  switch (op) {
+  case Opcode::AR_SET_IDX:
+    kills |= mArrayMask[entry->GetArgID(0)];
+    break;
+  case Opcode::AR_SET_SIZE:
+  case Opcode::AR_PUSH:
+  case Opcode::AR_POP:
+    kills |= mArrayMask[entry->GetArgID(0)] | mSizeMask[entry->GetArgID(0)];
+    break;
+  case Opcode::AR_COPY:
+    kills |= mArrayMask[entry->GetArgID(1)] | mSizeMask[entry->GetArgID(1)];
+    break;
+  }
+  return kills;
+}
+
+// Find the local sets of one block for the current chunk, and the lines of its upward and
+// downward exposed evaluations (in mUpLine and mDownLine).
+void CLazyCodeMotion::ScanBlock(ICArray & ica, const CControlFlowGraph & cfg, int block,
+                                int first_expr, Bits all)
+{
+  const CBasicBlock & info = cfg.GetBlock(block);
+  Bits up = 0, down = 0, kill = 0;
+  for (int line = info.mFirstLine; line <= info.mLastLine; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    int expr = mLineExpr[line] - first_expr;
+    if (expr >= 0 && expr < BitChunk::SIZE) {
+      Bits bit = 1ULL << expr;
+      if (!(kill & bit) && !(up & bit)) {
+        up |= bit;
+        mUpLine[expr] = line;
+      }
+      down |= bit;
+      mDownLine[expr] = line;
+    }
+    Bits line_kills = LineKills(entry) & all;
+    kill |= line_kills;
+    down &= ~line_kills;
+  }
+
+  Bits same = 0;
+  for (int expr = 0; expr < BitChunk::SIZE; expr++) {
+    Bits bit = 1ULL << expr;
+    if ((up & down & bit) && mUpLine[expr] == mDownLine[expr]) same |= bit;
+  }
+  mUpExposed[block] = up;
+  mDownExposed[block] = down;
+  mKill[block] = kill;
+  mSameLine[block] = same;
+}
+
+int CLazyCodeMotion::GetTemp(ICArray & ica, int expr)
+{
+  if (mTemp[expr] == -1) mTemp[expr] = ica.static_memory_size++;
+  return mTemp[expr];
+}
+
+// Solve lazy code motion for expressions first_expr .. first_expr + 63, and record the changes.
+void CLazyCodeMotion::SolveChunk(ICArray & ica, const CControlFlowGraph & cfg, int first_expr)
+{
+  int num_blocks = cfg.GetNumBlocks();
+  int num_edges = mEdges.size();
+  int chunk_size = std::min(BitChunk::SIZE, (int) mExprs.size() - first_expr);
+  Bits all = BitChunk::Mask(first_expr, mExprs.size());
+  const std::vector<int> & order = cfg.GetDomOrder();
+
+  // Kill masks, set from each expression's inputs.
+  for (int i = 0; i < chunk_size; i++) {
+    const CExpression & expr = mExprs[first_expr + i];
+    Bits bit = 1ULL << i;
+    if (expr.mOp == Opcode::AR_GET_IDX) mArrayMask[expr.mArg0.GetID()] |= bit;
+    else if (expr.mOp == Opcode::AR_GET_SIZE) mSizeMask[expr.mArg0.GetID()] |= bit;
+    else if (expr.mArg0.IsScalar()) mScalarMask[expr.mArg0.GetID()] |= bit;
+    if (expr.mArg1.IsScalar()) mScalarMask[expr.mArg1.GetID()] |= bit;
+  }
+  for (int b = 0; b < num_blocks; b++) {
+    if (cfg.IsReachable(b)) ScanBlock(ica, cfg, b, first_expr, all);
+  }
+
+  // Available: computed on every path into the block, with no input changed since.
+  std::vector<Bits> avail_out(num_blocks, all);
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = 0; i < (int) order.size(); i++) {
+      int b = order[i];
+      Bits in = all;
+      for (int e = 0; e < (int) mInEdges[b].size(); e++) {
+        const CEdge & edge = mEdges[mInEdges[b][e]];
+        in &= (edge.mFrom == -1) ? 0 : avail_out[edge.mFrom];
+      }
+      Bits out = mDownExposed[b] | (in & ~mKill[b]);
+      if (out != avail_out[b]) { avail_out[b] = out; changed = true; }
+    }
+  }
+
+  // Anticipated: computed on every path out of the block, before any input changes.
+  std::vector<Bits> ant_in(num_blocks, all), ant_out(num_blocks, 0);
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = order.size() - 1; i >= 0; i--) {
+      int b = order[i];
+      Bits out = mOutEdges[b].size() ? all : 0;
+      for (int e = 0; e < (int) mOutEdges[b].size(); e++) out &= ant_in[mEdges[mOutEdges[b][e]].mTo];
+      ant_out[b] = out;
+      Bits in = mUpExposed[b] | (out & ~mKill[b]);
+      if (in != ant_in[b]) { ant_in[b] = in; changed = true; }
+    }
+  }
+
+  // Earliest: the edges where an expression first becomes anticipated but not available.
+  std::vector<Bits> earliest(num_edges);
+  for (int e = 0; e < num_edges; e++) {
+    const CEdge & edge = mEdges[e];
+    earliest[e] = ant_in[edge.mTo];
+    if (edge.mFrom != -1) {
+      earliest[e] &= ~avail_out[edge.mFrom] & (mKill[edge.mFrom] | ~ant_out[edge.mFrom]);
+    }
+  }
+
+  // Later: an insertion can be pushed down past blocks that do not evaluate the expression.
+  std::vector<Bits> later(num_edges, all), later_in(num_blocks, all);
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = 0; i < (int) order.size(); i++) {
+      int b = order[i];
+      Bits in = all;
+      for (int e = 0; e < (int) mInEdges[b].size(); e++) {
+        int id = mInEdges[b][e];
+        const CEdge & edge = mEdges[id];
+        later[id] = earliest[id];
+        if (edge.mFrom != -1) later[id] |= later_in[edge.mFrom] & ~mUpExposed[edge.mFrom];
+        in &= later[id];
+      }
+      if (in != later_in[b]) { later_in[b] = in; changed = true; }
+    }
+  }
+
+  // Insert on edges where "later" stops; an edge that would need a block of its own to hold
+  // the insertion (its source branches and its target is joined) leaves that expression alone.
+  std::vector<Bits> insert(num_edges);
+  Bits blocked = 0;
+  for (int e = 0; e < num_edges; e++) {
+    const CEdge & edge = mEdges[e];
+    insert[e] = later[e] & ~later_in[edge.mTo];
+    if (insert[e] && edge.mFrom != -1 && mInEdges[edge.mTo].size() > 1
+        && mOutEdges[edge.mFrom].size() > 1) blocked |= insert[e];
+  }
+  Bits active = all & ~blocked;
+
+  // Which evaluations need to leave their result in the temporary: a backward liveness pass
+  // where removed evaluations read it and the evaluations that stay write it.
+  std::vector<Bits> remove(num_blocks, 0), writes(num_blocks, 0);
+  std::vector<Bits> live_in(num_blocks, 0), live_out(num_blocks, 0);
+  for (int i = 0; i < (int) order.size(); i++) {
+    int b = order[i];
+    remove[b] = mUpExposed[b] & ~later_in[b] & active;
+    writes[b] = mDownExposed[b] & ~(remove[b] & mSameLine[b]);
+  }
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = order.size() - 1; i >= 0; i--) {
+      int b = order[i];
+      Bits out = 0;
+      for (int e = 0; e < (int) mOutEdges[b].size(); e++) {
+        int id = mOutEdges[b][e];
+        out |= live_in[mEdges[id].mTo] & ~insert[id];
+      }
+      live_out[b] = out;
+      Bits in = remove[b] | (out & ~writes[b] & ~mKill[b]);
+      if (in != live_in[b]) { live_in[b] = in; changed = true; }
+    }
+  }
+
+  // Only move an expression if that saves cycles: the removed evaluations, weighted by loop
+  // depth, must cost more than the evaluations inserted plus the copies into the temporary.
+  // Otherwise all the motion buys is a temporary that is live for longer.  Each expression's
+  // bits are independent in every problem above, so dropping one changes nothing for the rest.
+  std::vector<double> gain(chunk_size, 0.0);
+  for (int i = 0; i < (int) order.size(); i++) {
+    int b = order[i];
+    double weight = LoopWeight(cfg, b);
+    for (int expr = 0; expr < chunk_size; expr++) {
+      Bits bit = 1ULL << expr;
+      if (remove[b] & bit) gain[expr] += weight * EvalCost(first_expr + expr);
+      if (writes[b] & live_out[b] & bit) gain[expr] -= weight * COPY_COST;
+    }
+  }
+  for (int e = 0; e < num_edges; e++) {
+    const CEdge & edge = mEdges[e];
+    Bits bits = insert[e] & active & live_in[edge.mTo];
+    if (!bits) continue;
+    double weight = LoopWeight(cfg, InsertBlock(edge));
+    for (int expr = 0; expr < chunk_size; expr++) {
+      if (bits & (1ULL << expr)) gain[expr] -= weight * EvalCost(first_expr + expr);
+    }
+  }
+  for (int expr = 0; expr < chunk_size; expr++) {
+    if (gain[expr] <= 0.0) active &= ~(1ULL << expr);
+  }
+
+  // Record the changes.
+  for (int i = 0; i < (int) order.size(); i++) {
+    int b = order[i];
+    if (!((remove[b] | (writes[b] & live_out[b])) & active)) continue;
+    ScanBlock(ica, cfg, b, first_expr, all);
+    for (int expr = 0; expr < chunk_size; expr++) {
+      Bits bit = 1ULL << expr;
+      if (remove[b] & active & bit) {
+        GetTemp(ica, first_expr + expr);
+        mCopyLines.push_back(mUpLine[expr]);
+        mNumRemoved++;
+      }
+      if (writes[b] & live_out[b] & active & bit) {
+        GetTemp(ica, first_expr + expr);
+        mRewriteLines.push_back(mDownLine[expr]);
+      }
+    }
+  }
+  for (int e = 0; e < num_edges; e++) {
+    const CEdge & edge = mEdges[e];
+    Bits bits = insert[e] & active & live_in[edge.mTo];
+    if (!bits) continue;
+
+    int line;
+    if (InsertBlock(edge) == edge.mTo) {
+      line = cfg.GetBlock(edge.mTo).mFirstLine;
+      if (ica.GetEntry(line)->GetOpcode() == Opcode::NONE) line++;
+    }
+    else {
+      line = cfg.GetBlock(edge.mFrom).mLastLine;
+      if (!Opcode::IsJump(ica.GetEntry(line)->GetOpcode())) line++;
+    }
+    for (int expr = 0; expr < chunk_size; expr++) {
+      if (!(bits & (1ULL << expr))) continue;
+      CInsertion insertion = { line, 1, first_expr + expr, GetTemp(ica, first_expr + expr), ICOperand() };
+      mInsertions.push_back(insertion);
+      mNumMoved++;
+    }
+  }
+
+  // Clear the kill masks for the next chunk.
+  for (int i = 0; i < chunk_size; i++) {
+    const CExpression & expr = mExprs[first_expr + i];
+    if (expr.mOp == Opcode::AR_GET_IDX) mArrayMask[expr.mArg0.GetID()] = 0;
+    else if (expr.mOp == Opcode::AR_GET_SIZE) mSizeMask[expr.mArg0.GetID()] = 0;
+    else if (expr.mArg0.IsScalar()) mScalarMask[expr.mArg0.GetID()] = 0;
+    if (expr.mArg1.IsScalar()) mScalarMask[expr.mArg1.GetID()] = 0;
+  }
+}
+
+// Rewrite the lines and add the new ones, now that every chunk has been solved.
+void CLazyCodeMotion::ApplyChanges(ICArray & ica)
+{
+  for (int i = 0; i < (int) mCopyLines.size(); i++) {
+    int line = mCopyLines[i];
+    ica.GetEntry(line)->SetToCopy(ICOperand::Scalar(mTemp[mLineExpr[line]]));
+  }
+  for (int i = 0; i < (int) mRewriteLines.size(); i++) {
+    int line = mRewriteLines[i];
+    ICEntry * entry = ica.GetEntry(line);
+    int out_arg = entry->GetNumArgs() - 1;
+    int temp = mTemp[mLineExpr[line]];
+    CInsertion insertion = { line + 1, 0, -1, temp, entry->GetOperand(out_arg) };
+    mInsertions.push_back(insertion);
+    entry->SetOperand(out_arg, ICOperand::Scalar(temp));
+  }
+
+  // Sort by line, copies first, keeping the order they were found in otherwise.
+  std::vector<std::pair<int, int> > order;
+  for (int i = 0; i < (int) mInsertions.size(); i++) {
+    order.push_back(std::make_pair(mInsertions[i].mLine * 2 + mInsertions[i].mOrder, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<std::pair<int, ICEntry *> > entries;
+  for (int i = 0; i < (int) order.size(); i++) {
+    const CInsertion & insertion = mInsertions[order[i].second];
+    ICEntry * entry;
+    if (insertion.mExpr == -1) {
+      entry = new ICEntry(Opcode::VAL_COPY, "", &ica);
+      entry->AddArg(ICOperand::Scalar(insertion.mTemp));
+      entry->AddArg(insertion.mCopyTo);
+    }
+    else {
+      const CExpression & expr = mExprs[insertion.mExpr];
+      entry = new ICEntry(expr.mOp, "", &ica);
+      entry->AddArg(expr.mArg0);
+      if (!expr.mArg1.IsNone()) entry->AddArg(expr.mArg1);
+      entry->AddArg(ICOperand::Scalar(insertion.mTemp));
+    }
+    entries.push_back(std::make_pair(insertion.mLine, entry));
+  }
+  ica.InsertEntries(entries);
+}
+
+int CLazyCodeMotion::Run(ICArray & ica)
+{
+  mNumMoved = 0;
+  mNumRemoved = 0;
+  mCopyLines.clear();
+  mRewriteLines.clear();
+  mInsertions.clear();
+
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  FindExpressions(ica, cfg);
+  if (mExprs.size() == 0) return 0;
+  FindEdges(cfg);
+
+  int num_blocks = cfg.GetNumBlocks();
+  int num_scalars = 0, num_arrays = 0;
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      const ICOperand & arg = entry->GetOperand(i);
+      if (arg.IsScalar()) num_scalars = std::max(num_scalars, arg.GetID() + 1);
+      if (arg.IsArray()) num_arrays = std::max(num_arrays, arg.GetID() + 1);
+    }
+  }
+  mScalarMask.assign(num_scalars, 0);
+  mArrayMask.assign(std::max(num_arrays, 1), 0);
+  mSizeMask.assign(std::max(num_arrays, 1), 0);
+  mUpExposed.assign(num_blocks, 0);
+  mDownExposed.assign(num_blocks, 0);
+  mKill.assign(num_blocks, 0);
+  mSameLine.assign(num_blocks, 0);
+
+  for (int first = 0; first < (int) mExprs.size(); first += BitChunk::SIZE) {
+    SolveChunk(ica, cfg, first);
+  }
+  ApplyChanges(ica);
+  return mNumRemoved;
+}
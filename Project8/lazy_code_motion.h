@@ -0,0 +1,124 @@
+#ifndef LAZY_CODE_MOTION_H
+#define LAZY_CODE_MOTION_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CLazyCodeMotion removes computations that are redundant across basic blocks of an ICArray,
+//  fully (already computed on every path that reaches them) or partially (computed on only some
+//  of those paths).  It is the lazy code motion of Knoop, Ruthing and Steffen:
+//    * Four bit-vector dataflow problems over the CFG (available, anticipated, earliest and
+//      later) pick the edges where inserting an expression makes every later evaluation of it
+//      redundant, as late as possible so the result is held for as short a time as it can be.
+//    * Nothing is ever computed on a path that did not compute it before, so no path gets
+//      slower; a partial redundancy is only removed by moving a copy onto the other paths.
+//    * Each moved expression gets a new temporary scalar.  Evaluations that are still needed
+//      write it, and the redundant ones become "val_copy <temporary> <output>".
+//    * An expression is only moved when that is estimated to save cycles, with each block
+//      weighted by its loop depth: a math instruction costs no more than the copies it takes
+//      to keep its result, so math mostly moves when that takes it out of a loop, while array
+//      reads (two memory accesses each) are nearly always worth moving.
+//
+//  Expressions are the same ones CLocalValueNumbering numbers: math, plus ar_get_idx and
+//  ar_get_size, with commutative inputs in a fixed order.  They are matched by their operands
+//  rather than by value, so this runs after value numbering has rewritten each block's reads to
+//  one canonical scalar.  div and mod are only moved with a nonzero constant divisor.
+//
+//  There is no separate global value numbering pass.  One run over CSSAForm's renamed scalars,
+//  turning each line that a dominating line already computes into a copy, made -O2 code about
+//  1% slower on generated programs: the longer-lived values spilled, and indices computed in
+//  another block no longer matched CStrengthReduction's pointer patterns.
+//
+//  Only expressions evaluated in two or more blocks are considered; the vectors are 64 bits
+//  wide and the problems are solved for 64 expressions at a time.
+//
+
+#include <map>
+#include <vector>
+
+#include "bit_chunk.h"
+#include "ic.h"
+
+class CControlFlowGraph;
+
+class CLazyCodeMotion {
+private:
+  typedef BitChunk::Bits Bits;
+
+  // An expression: opcode plus its (at most two) input operands.
+  struct CExpression {
+    int mOp;
+    ICOperand mArg0;
+    ICOperand mArg1;
+
+    bool operator<(const CExpression & other) const {
+      if (mOp != other.mOp) return mOp < other.mOp;
+      if (mArg0.GetKind() != other.mArg0.GetKind()) return mArg0.GetKind() < other.mArg0.GetKind();
+      if (mArg0.GetValue() != other.mArg0.GetValue()) return mArg0.GetValue() < other.mArg0.GetValue();
+      if (mArg1.GetKind() != other.mArg1.GetKind()) return mArg1.GetKind() < other.mArg1.GetKind();
+      return mArg1.GetValue() < other.mArg1.GetValue();
+    }
+  };
+
+  // A control-flow edge; mFrom is -1 for the edge into the entry block.
+  struct CEdge {
+    int mFrom;
+    int mTo;
+  };
+
+  // An entry to add in front of line mLine once every chunk is done.
+  struct CInsertion {
+    int mLine;
+    int mOrder;            // Copies out of a rewritten evaluation go before moved expressions.
+    int mExpr;             // Expression to compute into mTemp, or -1 for a copy.
+    int mTemp;
+    ICOperand mCopyTo;
+  };
+
+  std::vector<CExpression> mExprs;     // Expressions evaluated in two or more blocks.
+  std::vector<int> mLineExpr;          // IC line -> expression it evaluates (-1 if none).
+  std::vector<int> mTemp;              // Expression -> its temporary scalar (-1 if unused).
+  std::vector<CEdge> mEdges;           // Every edge between reachable blocks.
+  std::vector<std::vector<int> > mInEdges;   // Block -> edges into it.
+  std::vector<std::vector<int> > mOutEdges;  // Block -> edges out of it.
+
+  // Kill masks for the current chunk: which of its expressions read each scalar, or depend
+  // on each array's contents or size.
+  std::vector<Bits> mScalarMask;
+  std::vector<Bits> mArrayMask;
+  std::vector<Bits> mSizeMask;
+
+  // Per block, for the current chunk.
+  std::vector<Bits> mUpExposed;        // Evaluated before any of its inputs change.
+  std::vector<Bits> mDownExposed;      // Evaluated after its inputs last change.
+  std::vector<Bits> mKill;             // Some input changes.
+  std::vector<Bits> mSameLine;         // Upward and downward exposed on the same line.
+  int mUpLine[BitChunk::SIZE];         // While scanning a block: the line of each of those.
+  int mDownLine[BitChunk::SIZE];
+
+  std::vector<int> mCopyLines;         // Redundant evaluations to turn into copies.
+  std::vector<int> mRewriteLines;      // Evaluations whose result must also go to the temp.
+  std::vector<CInsertion> mInsertions;
+  int mNumMoved;
+  int mNumRemoved;
+
+  bool FindExpression(const ICEntry * entry, CExpression & expr) const;
+  void FindExpressions(ICArray & ica, const CControlFlowGraph & cfg);
+  Bits LineKills(const ICEntry * entry) const;
+  double EvalCost(int expr) const;
+  void FindEdges(const CControlFlowGraph & cfg);
+  int InsertBlock(const CEdge & edge) const;
+  void ScanBlock(ICArray & ica, const CControlFlowGraph & cfg, int block, int first_expr, Bits all);
+  void SolveChunk(ICArray & ica, const CControlFlowGraph & cfg, int first_expr);
+  int GetTemp(ICArray & ica, int expr);
+  void ApplyChanges(ICArray & ica);
+
+public:
+  CLazyCodeMotion() : mNumMoved(0), mNumRemoved(0) { ; }
+  ~CLazyCodeMotion() { ; }
+
+  // Move and remove redundant expressions; returns how many evaluations were removed.
+  int Run(ICArray & ica);
+  int GetNumMoved() const { return mNumMoved; }
+};
+
+#endif
@@ -0,0 +1,303 @@
+#include "load_forwarding.h"
+#include "cfg.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN CLoadForwarding
+ *****************************************/
+
+// Number the elements worth tracking and the facts about them, and index which lines use
+// each array and write each scalar.
+void CLoadForwarding::FindFacts(ICArray & ica, int num_ids)
+{
+  int num_lines = ica.GetNumEntries();
+  mArrayLines.assign(num_ids, std::vector<int>());
+  mScalarWrites.assign(num_ids, std::vector<int>());
+  mPointerStores.clear();
+  // Array -> the index (kind and value) and line of each load or store of one of its elements.
+  std::vector<std::vector<std::pair<std::pair<int, int>, int> > > accesses(num_ids);
+
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete() || !mCFG->IsReachable(mCFG->GetBlockOf(line))) continue;
+    int op = entry->GetOpcode();
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (Opcode::IsArgWritten(op, i)) mScalarWrites[entry->GetArgID(i)].push_back(line);
+      else if (entry->GetOperand(i).IsArray()) mArrayLines[entry->GetArgID(i)].push_back(line);
+    }
+    if (op == Opcode::PTR_SET) mPointerStores.push_back(line);
+    if (op != Opcode::AR_GET_IDX && op != Opcode::AR_SET_IDX) continue;
+    ICOperand index = entry->GetOperand(1);
+    if (index.IsImmediate()) index = ICOperand::Int(index.GetValue());
+    accesses[entry->GetArgID(0)].push_back(
+        std::make_pair(std::make_pair(index.GetKind(), index.GetValue()), line));
+  }
+
+  mFacts.clear();
+  mLineElement.assign(num_lines, -1);
+  mLineFact.assign(num_lines, -1);
+  int num_elements = 0;
+  for (int array = 0; array < num_ids; array++) {
+    std::vector<std::pair<std::pair<int, int>, int> > & lines = accesses[array];
+    std::sort(lines.begin(), lines.end());
+    for (int first = 0, last; first < (int) lines.size(); first = last) {
+      bool loaded = false;
+      for (last = first; last < (int) lines.size() && lines[last].first == lines[first].first; last++) {
+        if (ica.GetEntry(lines[last].second)->GetOpcode() == Opcode::AR_GET_IDX) loaded = true;
+      }
+      if (last - first < 2 || !loaded) continue;
+      int element = num_elements++;
+      ICOperand index(lines[first].first.first, lines[first].first.second);
+
+      // The value (kind and value) each line leaves in the element, and the line.
+      std::vector<std::pair<std::pair<int, int>, int> > values;
+      for (int i = first; i < last; i++) {
+        int line = lines[i].second;
+        mLineElement[line] = element;
+        const ICOperand & value = ica.GetEntry(line)->GetOperand(2);
+        if (value == index) continue;  // A load into its own index.
+        values.push_back(std::make_pair(std::make_pair(value.GetKind(), value.GetValue()), line));
+      }
+      std::sort(values.begin(), values.end());
+      for (int i = 0; i < (int) values.size(); i++) {
+        if (i == 0 || values[i].first != values[i - 1].first) {
+          CFact fact = { array, element, index, ICOperand(values[i].first.first, values[i].first.second) };
+          mFacts.push_back(fact);
+        }
+        mLineFact[values[i].second] = mFacts.size() - 1;
+      }
+    }
+  }
+  mElementMask.assign(num_elements, 0);
+}
+
+// Which facts of the current chunk could this line make false?
+CLoadForwarding::Bits CLoadForwarding::LineKills(const ICEntry * entry, int line, Bits all) const
+{
+  int op = entry->GetOpcode();
+  Bits kills = 0;
+  for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+    if (Opcode::IsArgWritten(op, i)) kills |= mScalarMask[entry->GetArgID(i)];
+  }
+  switch (op) {
+  case Opcode::AR_SET_IDX:
+    if (!entry->GetOperand(1).IsImmediate()) kills |= mArrayMask[entry->GetArgID(0)];
+    else {
+      kills |= mArrayVarMask[entry->GetArgID(0)];
+      if (mLineElement[line] != -1) kills |= mElementMask[mLineElement[line]];
+    }
+    break;
+  case Opcode::AR_SET_SIZE:
+  case Opcode::AR_PUSH:
+  case Opcode::AR_POP:
+    kills |= mArrayMask[entry->GetArgID(0)];
+    break;
+  case Opcode::AR_COPY:
+    kills |= mArrayMask[entry->GetArgID(1)];
+    break;
+  case Opcode::PTR_SET:
+    kills = all;  // Could be any element of any array.
+    break;
+  }
+  return kills;
+}
+
+// Set up for facts first_fact .. first_fact + 63: their kill masks, the lines that can change
+// them, and each block's local sets.  Returns the facts still true at the end of some block.
+CLoadForwarding::Bits CLoadForwarding::StartChunk(ICArray & ica, int first_fact)
+{
+  Bits all = BitChunk::Mask(first_fact, mFacts.size());
+  std::vector<int> arrays, scalars;
+  for (int i = 0; first_fact + i < (int) mFacts.size() && i < BitChunk::SIZE; i++) {
+    const CFact & fact = mFacts[first_fact + i];
+    Bits bit = 1ULL << i;
+    arrays.push_back(fact.mArray);
+    mArrayMask[fact.mArray] |= bit;
+    mElementMask[fact.mElement] |= bit;
+    if (fact.mIndex.IsScalar()) {
+      mArrayVarMask[fact.mArray] |= bit;
+      mScalarMask[fact.mIndex.GetID()] |= bit;
+      scalars.push_back(fact.mIndex.GetID());
+    }
+    if (fact.mValue.IsScalar()) {
+      mScalarMask[fact.mValue.GetID()] |= bit;
+      scalars.push_back(fact.mValue.GetID());
+    }
+  }
+
+  // Only lines that use those arrays or write those scalars can change a fact.
+  std::sort(arrays.begin(), arrays.end());
+  arrays.erase(std::unique(arrays.begin(), arrays.end()), arrays.end());
+  std::sort(scalars.begin(), scalars.end());
+  scalars.erase(std::unique(scalars.begin(), scalars.end()), scalars.end());
+  mLines = mPointerStores;
+  for (int i = 0; i < (int) arrays.size(); i++) {
+    mLines.insert(mLines.end(), mArrayLines[arrays[i]].begin(), mArrayLines[arrays[i]].end());
+  }
+  for (int i = 0; i < (int) scalars.size(); i++) {
+    mLines.insert(mLines.end(), mScalarWrites[scalars[i]].begin(), mScalarWrites[scalars[i]].end());
+  }
+  std::sort(mLines.begin(), mLines.end());
+  mLines.erase(std::unique(mLines.begin(), mLines.end()), mLines.end());
+
+  for (int l = 0; l < (int) mLines.size(); l++) {
+    int line = mLines[l], block = mCFG->GetBlockOf(line);
+    Bits line_kills = LineKills(ica.GetEntry(line), line, all);
+    mKill[block] |= line_kills;
+    mGen[block] &= ~line_kills;
+    int fact = mLineFact[line] - first_fact;
+    if (fact >= 0 && fact < BitChunk::SIZE) mGen[block] |= 1ULL << fact;
+  }
+  Bits escapes = 0;
+  for (int l = 0; l < (int) mLines.size(); l++) escapes |= mGen[mCFG->GetBlockOf(mLines[l])];
+  return escapes;
+}
+
+// Clear everything StartChunk() set.
+void CLoadForwarding::EndChunk(int first_fact)
+{
+  for (int l = 0; l < (int) mLines.size(); l++) {
+    mGen[mCFG->GetBlockOf(mLines[l])] = 0;
+    mKill[mCFG->GetBlockOf(mLines[l])] = 0;
+  }
+  for (int i = 0; first_fact + i < (int) mFacts.size() && i < BitChunk::SIZE; i++) {
+    const CFact & fact = mFacts[first_fact + i];
+    mArrayMask[fact.mArray] = 0;
+    mArrayVarMask[fact.mArray] = 0;
+    mElementMask[fact.mElement] = 0;
+    if (fact.mIndex.IsScalar()) mScalarMask[fact.mIndex.GetID()] = 0;
+    if (fact.mValue.IsScalar()) mScalarMask[fact.mValue.GetID()] = 0;
+  }
+}
+
+// Put the facts that outlive the block making them true first, so that a chunk either needs
+// the dataflow or needs none at all.
+void CLoadForwarding::SortFacts(ICArray & ica)
+{
+  std::vector<bool> escapes(mFacts.size(), false);
+  for (int first = 0; first < (int) mFacts.size(); first += BitChunk::SIZE) {
+    Bits chunk_escapes = StartChunk(ica, first);
+    for (int i = 0; first + i < (int) mFacts.size() && i < BitChunk::SIZE; i++) {
+      escapes[first + i] = (chunk_escapes >> i) & 1;
+    }
+    EndChunk(first);
+  }
+
+  std::vector<int> renumber(mFacts.size());
+  std::vector<CFact> facts;
+  for (int f = 0; f < (int) mFacts.size(); f++) {
+    if (!escapes[f]) continue;
+    renumber[f] = facts.size();
+    facts.push_back(mFacts[f]);
+  }
+  for (int f = 0; f < (int) mFacts.size(); f++) {
+    if (escapes[f]) continue;
+    renumber[f] = facts.size();
+    facts.push_back(mFacts[f]);
+  }
+  mFacts.swap(facts);
+  for (int line = 0; line < (int) mLineFact.size(); line++) {
+    if (mLineFact[line] != -1) mLineFact[line] = renumber[mLineFact[line]];
+  }
+}
+
+// Solve for facts first_fact .. first_fact + 63, and pick the loads they replace.
+void CLoadForwarding::SolveChunk(ICArray & ica, int first_fact)
+{
+  int num_blocks = mCFG->GetNumBlocks();
+  Bits all = BitChunk::Mask(first_fact, mFacts.size());
+  Bits escapes = StartChunk(ica, first_fact);
+
+  // Available: made true on every path into the block, and not made false since.  Only
+  // facts that outlive a block can be available on entry to one.
+  std::vector<Bits> avail_in;
+  if (escapes) {
+    const std::vector<int> & order = mCFG->GetDomOrder();
+    avail_in.assign(num_blocks, 0);
+    std::vector<Bits> avail_out(num_blocks, escapes);
+    for (bool changed = true; changed; ) {
+      changed = false;
+      for (int i = 0; i < (int) order.size(); i++) {
+        int b = order[i];
+        Bits in = 0;
+        if (b != 0) {
+          in = escapes;
+          const std::vector<int> & preds = mCFG->GetBlock(b).mPreds;
+          for (int p = 0; p < (int) preds.size(); p++) {
+            if (mCFG->IsReachable(preds[p])) in &= avail_out[preds[p]];
+          }
+        }
+        avail_in[b] = in;
+        Bits out = (mGen[b] | (in & ~mKill[b])) & escapes;
+        if (out != avail_out[b]) { avail_out[b] = out; changed = true; }
+      }
+    }
+  }
+
+  // Walk the lines again with what is available before each, replacing loads it covers.
+  // Constants sort after scalars, so the highest fact is the most useful one.
+  Bits avail = 0;
+  for (int l = 0; l < (int) mLines.size(); l++) {
+    int line = mLines[l], block = mCFG->GetBlockOf(line);
+    if (l == 0 || block != mCFG->GetBlockOf(mLines[l - 1])) avail = escapes ? avail_in[block] : 0;
+    const ICEntry * entry = ica.GetEntry(line);
+    int element = mLineElement[line];
+    if (entry->GetOpcode() == Opcode::AR_GET_IDX && element != -1 && mForward[line].IsNone()) {
+      Bits known = avail & mElementMask[element];
+      if (known) {
+        int fact = BitChunk::SIZE - 1;
+        while (!(known & (1ULL << fact))) fact--;
+        mForward[line] = mFacts[first_fact + fact].mValue;
+        mNumForwarded++;
+      }
+    }
+    avail &= ~LineKills(entry, line, all);
+    int fact = mLineFact[line] - first_fact;
+    if (fact >= 0 && fact < BitChunk::SIZE) avail |= 1ULL << fact;
+  }
+  EndChunk(first_fact);
+}
+
+// A forwarded load becomes a copy, or goes entirely if its output already holds the value.
+void CLoadForwarding::ApplyChanges(ICArray & ica)
+{
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    if (mForward[line].IsNone()) continue;
+    ICEntry * entry = ica.GetEntry(line);
+    if (mForward[line] == entry->GetOperand(2)) entry->SetDelete(true);
+    else entry->SetToCopy(mForward[line]);
+  }
+}
+
+int CLoadForwarding::Run(ICArray & ica)
+{
+  mNumForwarded = 0;
+  if (ica.GetNumEntries() == 0) return 0;
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  mCFG = &cfg;
+
+  int num_ids = 0;
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      num_ids = std::max(num_ids, entry->GetArgID(i) + 1);
+    }
+  }
+  FindFacts(ica, num_ids);
+  if (mFacts.size() == 0) return 0;
+
+  mScalarMask.assign(num_ids, 0);
+  mArrayMask.assign(num_ids, 0);
+  mArrayVarMask.assign(num_ids, 0);
+  mGen.assign(cfg.GetNumBlocks(), 0);
+  mKill.assign(cfg.GetNumBlocks(), 0);
+  SortFacts(ica);
+  mForward.assign(ica.GetNumEntries(), ICOperand());
+  for (int first = 0; first < (int) mFacts.size(); first += BitChunk::SIZE) {
+    SolveChunk(ica, first);
+  }
+  ApplyChanges(ica);
+  return mNumForwarded;
+}
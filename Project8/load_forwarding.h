@@ -0,0 +1,88 @@
+#ifndef LOAD_FORWARDING_H
+#define LOAD_FORWARDING_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CLoadForwarding replaces array loads whose value is already in hand with a copy of it: the
+//  value last stored to the same element (store-to-load forwarding), or the scalar an earlier
+//  load of it went into (redundant load elimination).  Unlike CLocalValueNumbering, this works
+//  across blocks, and a store to one element leaves what is known about the others alone.
+//
+//  Each ar_set_idx "a i v" and ar_get_idx "a i x" makes a fact true: "a[i] holds v" (or x).
+//  A forward bit-vector problem over the CFG finds the facts that hold on every path into
+//  each line; a load of a[i] with such a fact becomes "val_copy v x" (and goes entirely if v
+//  is x).  A fact stops holding when:
+//    * i or v is written (so a[i] may be a different element, or v a different value);
+//    * a store may write the same element: any store to a with a scalar index, and stores
+//      with a constant index to that index or to an element indexed by a scalar;
+//    * a is resized, pushed, popped, or copied into, or a pointer is stored through.
+//  Elements match by array and index operand, the same way CDeadCodeElimination matches them.
+//  Edges are the real ones (see cfg.h), so a call loses whatever the function body changes.
+//
+//  Only elements that are loaded, and accessed on two or more lines, have facts.  The vectors
+//  are 64 bits wide and the problem is solved for 64 facts at a time, looking only at the
+//  lines that touch the arrays and scalars those facts name.  Facts that never outlive the
+//  block that makes them true (an element indexed by a loop counter that is bumped at the end
+//  of the body, say) are grouped together, and their chunks skip the dataflow entirely.
+//
+
+#include <vector>
+
+#include "bit_chunk.h"
+#include "ic.h"
+
+class CControlFlowGraph;
+
+class CLoadForwarding {
+private:
+  typedef BitChunk::Bits Bits;
+
+  // "mArray[mIndex] holds mValue"; mElement numbers the (mArray, mIndex) pair.
+  struct CFact {
+    int mArray;
+    int mElement;
+    ICOperand mIndex;
+    ICOperand mValue;
+  };
+
+  const CControlFlowGraph * mCFG;
+  std::vector<CFact> mFacts;                    // Grouped by array.
+  std::vector<int> mLineElement;                // IC line -> element it loads or stores (or -1).
+  std::vector<int> mLineFact;                   // IC line -> fact it makes true (or -1).
+  std::vector<std::vector<int> > mArrayLines;   // Array ID -> lines that use it.
+  std::vector<std::vector<int> > mScalarWrites; // Scalar ID -> lines that write it.
+  std::vector<int> mPointerStores;              // Lines that store through a pointer.
+
+  // Kill masks for the current chunk: its facts that name each scalar, that lie in each array
+  // (all of them, or those indexed by a scalar), and that are about each element.
+  std::vector<Bits> mScalarMask;
+  std::vector<Bits> mArrayMask;
+  std::vector<Bits> mArrayVarMask;
+  std::vector<Bits> mElementMask;
+
+  // For the current chunk: the lines that can change its facts, and per block, the facts
+  // still true at its end and the facts made false in it (zero for blocks not in mLines).
+  std::vector<int> mLines;
+  std::vector<Bits> mGen;
+  std::vector<Bits> mKill;
+
+  std::vector<ICOperand> mForward;              // IC line -> value its load is replaced with.
+  int mNumForwarded;
+
+  void FindFacts(ICArray & ica, int num_ids);
+  void SortFacts(ICArray & ica);
+  Bits LineKills(const ICEntry * entry, int line, Bits all) const;
+  Bits StartChunk(ICArray & ica, int first_fact);
+  void EndChunk(int first_fact);
+  void SolveChunk(ICArray & ica, int first_fact);
+  void ApplyChanges(ICArray & ica);
+
+public:
+  CLoadForwarding() : mCFG(NULL), mNumForwarded(0) { ; }
+  ~CLoadForwarding() { ; }
+
+  // Forward stored and loaded values to later loads; returns how many loads were replaced.
+  int Run(ICArray & ica);
+};
+
+#endif
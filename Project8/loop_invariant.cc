@@ -0,0 +1,169 @@
+#include "loop_invariant.h"
+#include "cfg.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN CLoopInvariantMotion
+ *****************************************/
+
+// Do any of these lines write inside the loop?  Lines already moved out in front of the loop
+// (or of one around it) no longer count.
+bool CLoopInvariantMotion::WrittenInLoop(const std::vector<int> & lines, int loop) const
+{
+  int header = mCFG->GetLoop(loop).mHeader;
+  for (int i = 0; i < (int) lines.size(); i++) {
+    if (mMovedTo[lines[i]] != -1 && mCFG->InLoop(header, mMovedTo[lines[i]])) continue;
+    if (mCFG->InLoop(mCFG->GetBlockOf(lines[i]), loop)) return true;
+  }
+  return false;
+}
+
+// Mark the blocks where scalar 'id' is live on entry, walking back from its upward-exposed reads.
+void CLoopInvariantMotion::FindLiveness(ICArray & ica, int id)
+{
+  mLiveStamp++;
+  const std::vector<int> & lines = mScalarLines[id];
+  std::vector<int> worklist;
+  int block = -1;
+  bool written = false;
+  for (int i = 0; i < (int) lines.size(); i++) {
+    const ICEntry * entry = ica.GetEntry(lines[i]);
+    if (mCFG->GetBlockOf(lines[i]) != block) {
+      block = mCFG->GetBlockOf(lines[i]);
+      written = false;
+    }
+    if (!written && entry->ReadsScalar(id) && mLiveIn[block] != mLiveStamp) {
+      mLiveIn[block] = mLiveStamp;
+      worklist.push_back(block);
+    }
+    for (int arg = 0; arg < (int) entry->GetNumArgs(); arg++) {
+      if (Opcode::IsArgWritten(entry->GetOpcode(), arg) && entry->GetArgID(arg) == id) written = true;
+    }
+    if (written) mWrittenIn[block] = mLiveStamp;  // The walk below stops here.
+  }
+
+  while (worklist.size() > 0) {
+    int cur = worklist.back();
+    worklist.pop_back();
+    const std::vector<int> & preds = mCFG->GetBlock(cur).mPreds;
+    for (int p = 0; p < (int) preds.size(); p++) {
+      int pred = preds[p];
+      if (mLiveIn[pred] == mLiveStamp || mWrittenIn[pred] == mLiveStamp) continue;
+      mLiveIn[pred] = mLiveStamp;
+      worklist.push_back(pred);
+    }
+  }
+}
+
+// Can 'line' be moved out in front of 'loop'?  (Needs FindLiveness() for its output first.)
+bool CLoopInvariantMotion::CanMove(ICArray & ica, int line, int loop)
+{
+  const CLoop & info = mCFG->GetLoop(loop);
+  if (info.mPreheaderLine == -1 || info.mHasCall) return false;
+  const ICEntry * entry = ica.GetEntry(line);
+  int op = entry->GetOpcode();
+  int out_arg = entry->GetNumArgs() - 1;
+  int out = entry->GetArgID(out_arg);
+
+  if (op == Opcode::AR_GET_SIZE) {
+    if (WrittenInLoop(mResizes[entry->GetArgID(0)], loop)) return false;
+  }
+  for (int i = 0; i < out_arg; i++) {
+    if (entry->IsScalarArg(i) && WrittenInLoop(mScalarDefs[entry->GetArgID(i)], loop)) return false;
+  }
+
+  // The only write of the output in the loop, and no read outside this line's reach.
+  for (int i = 0; i < (int) mScalarDefs[out].size(); i++) {
+    int other = mScalarDefs[out][i];
+    if (other != line && mCFG->InLoop(mCFG->GetBlockOf(other), loop)) return false;
+  }
+  if (mLiveIn[info.mHeader] == mLiveStamp) return false;
+  for (int i = 0; i < (int) info.mExits.size(); i++) {
+    if (mLiveIn[info.mExits[i]] == mLiveStamp) return false;
+  }
+  return true;
+}
+
+static bool CompareInsertLine(const std::pair<int, ICEntry *> & in1, const std::pair<int, ICEntry *> & in2)
+{
+  return in1.first < in2.first;
+}
+
+int CLoopInvariantMotion::Run(ICArray & ica)
+{
+  mNumMoved = 0;
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  mCFG = &cfg;
+  if (cfg.GetNumLoops() == 0) return 0;
+
+  int num_lines = ica.GetNumEntries();
+  int num_scalars = 0, num_arrays = 0;
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      const ICOperand & arg = entry->GetOperand(i);
+      if (arg.IsScalar()) num_scalars = std::max(num_scalars, arg.GetID() + 1);
+      if (arg.IsArray()) num_arrays = std::max(num_arrays, arg.GetID() + 1);
+    }
+  }
+  mScalarDefs.assign(num_scalars, std::vector<int>());
+  mScalarLines.assign(num_scalars, std::vector<int>());
+  mResizes.assign(num_arrays, std::vector<int>());
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    int op = entry->GetOpcode();
+    if (entry->GetDelete()) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!entry->IsScalarArg(i)) continue;
+      std::vector<int> & lines = mScalarLines[entry->GetArgID(i)];
+      if (lines.size() == 0 || lines.back() != line) lines.push_back(line);
+      if (Opcode::IsArgWritten(op, i)) mScalarDefs[entry->GetArgID(i)].push_back(line);
+    }
+    if (op == Opcode::AR_SET_SIZE || op == Opcode::AR_PUSH || op == Opcode::AR_POP) {
+      mResizes[entry->GetArgID(0)].push_back(line);
+    }
+    if (op == Opcode::AR_COPY) mResizes[entry->GetArgID(1)].push_back(line);
+  }
+
+  mMovedTo.assign(num_lines, -1);
+  mLiveIn.assign(cfg.GetNumBlocks(), 0);
+  mWrittenIn.assign(cfg.GetNumBlocks(), 0);
+  mLiveStamp = 0;
+
+  std::vector<std::pair<int, ICEntry *> > moved;
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    int op = entry->GetOpcode();
+    int innermost = cfg.GetBlock(cfg.GetBlockOf(line)).mLoop;
+    if (innermost == -1 || entry->GetDelete()) continue;
+    if (!Opcode::IsMath(op) && op != Opcode::AR_GET_SIZE) continue;
+    if (Opcode::IsMath(op) && entry->GetOperand(0).IsImmediate() && entry->GetOperand(1).IsImmediate()) continue;
+    if ((op == Opcode::DIV || op == Opcode::MOD)
+        && !(entry->GetOperand(1).IsImmediate() && entry->GetOperand(1).GetValue() != 0)) continue;
+
+    // Try the outermost loop first.
+    std::vector<int> loops;
+    for (int l = innermost; l != -1; l = cfg.GetLoop(l).mParent) loops.push_back(l);
+    FindLiveness(ica, entry->GetArgID(entry->GetNumArgs() - 1));
+    for (int i = loops.size() - 1; i >= 0; i--) {
+      if (!CanMove(ica, line, loops[i])) continue;
+      mMovedTo[line] = loops[i];
+      break;
+    }
+    if (mMovedTo[line] == -1) continue;
+
+    ICEntry * copy = new ICEntry(op, "", &ica);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) copy->AddArg(entry->GetOperand(i));
+    copy->SetComment(entry->GetComment());
+    moved.push_back(std::make_pair(cfg.GetLoop(mMovedTo[line]).mPreheaderLine, copy));
+    entry->SetDelete(true);
+    mNumMoved++;
+  }
+
+  // Lines moved in front of the same loop stay in their original order (a stable sort).
+  std::stable_sort(moved.begin(), moved.end(), CompareInsertLine);
+  ica.InsertEntries(moved);
+  return mNumMoved;
+}
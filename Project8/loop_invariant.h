@@ -0,0 +1,55 @@
+#ifndef LOOP_INVARIANT_H
+#define LOOP_INVARIANT_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CLoopInvariantMotion moves computations whose inputs do not change inside a loop out in front
+//  of it, so they run once instead of on every trip around.
+//
+//  A line "op a b x" is moved out of a loop when:
+//    * op is math (div and mod only with a nonzero constant divisor) or ar_get_size; it must be
+//      safe to run even if the loop body never does, so ar_get_idx (which can go out of bounds),
+//      random and anything else with side effects stay put;
+//    * no line left in the loop writes a or b (for ar_get_size: resizes or copies into the
+//      array), and the loop makes no function calls, whose bodies could write anything;
+//    * it is the only write of x in the loop, and x is live neither on entry to the loop header
+//      nor on any edge leaving the loop, so every read of x sees this value and nothing after
+//      the loop can tell that it moved.
+//  Each line goes to the outermost loop those hold for, and is placed on the loop's preheader
+//  edge: the one edge into its header from outside the loop.  Lines keep their order, so a
+//  moved line that reads another moved line's result still comes after it.
+//
+
+#include <vector>
+
+#include "ic.h"
+
+class CControlFlowGraph;
+
+class CLoopInvariantMotion {
+private:
+  const CControlFlowGraph * mCFG;
+  std::vector<std::vector<int> > mScalarDefs;   // Scalar ID -> lines that write it.
+  std::vector<std::vector<int> > mScalarLines;  // Scalar ID -> lines that use it at all.
+  std::vector<std::vector<int> > mResizes;      // Array ID -> lines that can change its size.
+  std::vector<int> mMovedTo;         // IC line -> loop it was moved out of (-1 if not moved).
+
+  // Blocks where the scalar being looked at is live on entry (marked with mLiveStamp).
+  std::vector<int> mLiveIn;
+  std::vector<int> mWrittenIn;       // Blocks that write it (also marked with mLiveStamp).
+  int mLiveStamp;
+  int mNumMoved;
+
+  bool WrittenInLoop(const std::vector<int> & lines, int loop) const;
+  void FindLiveness(ICArray & ica, int id);
+  bool CanMove(ICArray & ica, int line, int loop);
+
+public:
+  CLoopInvariantMotion() : mCFG(NULL), mLiveStamp(0), mNumMoved(0) { ; }
+  ~CLoopInvariantMotion() { ; }
+
+  // Move every loop-invariant line out of its loops; returns how many lines moved.
+  int Run(ICArray & ica);
+};
+
+#endif
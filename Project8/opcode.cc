@@ -0,0 +1,10 @@
+#include "opcode.h"
+
+namespace Opcode {
+  int FromString(const std::string & name) {
+    for (int op = NONE + 1; op < NUM_OPCODES; op++) {
+      if (name == INFO_TABLE[op].name) return op;
+    }
+    return NONE;
+  }
+};
@@ -0,0 +1,121 @@
+#ifndef OPCODE_H
+#define OPCODE_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  This file lists every intermediate code instruction (Opcode::OpcodeNames) along with a
+//  descriptor table holding what the rest of the compiler needs to know about each one:
+//    * its name, as printed in IC output,
+//    * the kind of each of its (up to three) arguments,
+//    * whether it has effects beyond writing its output (control flow, I/O, memory, RNG),
+//    * whether its two inputs can be swapped, and
+//    * which TubeCode template ICEntry::PrintTC() lowers it with.
+//
+//  The table is indexed by opcode, so lookups are a single array access.
+//
+//  ar_get_ptr, ptr_get and ptr_set hold the TubeCode address of an array element in a scalar.
+//  The AST never produces them and TubeIC does not know them; ICArray::ReduceStrength() adds
+//  them just before register allocation, once the IC will only be lowered to TubeCode.
+//
+
+#include <string>
+
+namespace Opcode {
+  enum OpcodeNames {
+    NONE=0,         // A label with no instruction.
+    VAL_COPY, ADD, SUB, MULT, DIV, MOD,
+    TEST_LESS, TEST_GTR, TEST_EQU, TEST_NEQU, TEST_LTE, TEST_GTE,
+    JUMP, JUMP_IF_0, JUMP_IF_N0,
+    RANDOM, OUT_INT, OUT_CHAR, NOP, PUSH, POP,
+    AR_GET_IDX, AR_SET_IDX, AR_GET_SIZE, AR_SET_SIZE, AR_COPY, AR_PUSH, AR_POP,
+    AR_GET_PTR, PTR_GET, PTR_SET,
+    NUM_OPCODES
+  };
+
+  // What each argument of an instruction must be:
+  // * ARG_VALUE  - an input value: literal numbers or chars, scalars, labels, etc.
+  // * ARG_SCALAR - an output scalar variable that gets written to.
+  // * ARG_ARRAY  - an array that gets somehow manipulated.
+  enum ArgKind { ARG_NONE=0, ARG_VALUE, ARG_SCALAR, ARG_ARRAY };
+
+  // Which template ICEntry::PrintTC() uses to lower an instruction.
+  enum Lowering {
+    LOWER_NONE=0,   // Nothing to emit.
+    LOWER_COPY,     // val_copy
+    LOWER_BINARY,   // op a b -> c  (math and comparisons)
+    LOWER_OUTPUT,   // op a  (out_int, out_char, jump)
+    LOWER_BRANCH,   // op a label  (jump_if_0, jump_if_n0)
+    LOWER_RANDOM,
+    LOWER_NOP,
+    LOWER_PUSH,
+    LOWER_POP,
+    LOWER_AR_INDEX, // ar_get_idx, ar_set_idx
+    LOWER_AR_GET_SIZE,
+    LOWER_AR_SET_SIZE,
+    LOWER_AR_COPY,
+    LOWER_AR_PUSH,
+    LOWER_AR_POP,
+    LOWER_AR_GET_PTR,
+    LOWER_PTR_GET,
+    LOWER_PTR_SET
+  };
+
+  struct Info {
+    const char * name;
+    int num_args;
+    ArgKind args[3];
+    bool side_effects;
+    bool commutative;
+    Lowering lowering;
+  };
+
+  constexpr Info INFO_TABLE[NUM_OPCODES] = {
+    // name          #  arg kinds                               effects commute lowering
+    { "",            0, { ARG_NONE,   ARG_NONE,   ARG_NONE   }, false, false, LOWER_NONE },
+    { "val_copy",    2, { ARG_VALUE,  ARG_SCALAR, ARG_NONE   }, false, false, LOWER_COPY },
+    { "add",         3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, true,  LOWER_BINARY },
+    { "sub",         3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_BINARY },
+    { "mult",        3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, true,  LOWER_BINARY },
+    { "div",         3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_BINARY },
+    { "mod",         3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_BINARY },
+    { "test_less",   3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_BINARY },
+    { "test_gtr",    3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_BINARY },
+    { "test_equ",    3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, true,  LOWER_BINARY },
+    { "test_nequ",   3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, true,  LOWER_BINARY },
+    { "test_lte",    3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_BINARY },
+    { "test_gte",    3, { ARG_VALUE,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_BINARY },
+    { "jump",        1, { ARG_VALUE,  ARG_NONE,   ARG_NONE   }, true,  false, LOWER_OUTPUT },
+    { "jump_if_0",   2, { ARG_VALUE,  ARG_VALUE,  ARG_NONE   }, true,  false, LOWER_BRANCH },
+    { "jump_if_n0",  2, { ARG_VALUE,  ARG_VALUE,  ARG_NONE   }, true,  false, LOWER_BRANCH },
+    { "random",      2, { ARG_VALUE,  ARG_SCALAR, ARG_NONE   }, true,  false, LOWER_RANDOM },
+    { "out_int",     1, { ARG_VALUE,  ARG_NONE,   ARG_NONE   }, true,  false, LOWER_OUTPUT },
+    { "out_char",    1, { ARG_VALUE,  ARG_NONE,   ARG_NONE   }, true,  false, LOWER_OUTPUT },
+    { "nop",         0, { ARG_NONE,   ARG_NONE,   ARG_NONE   }, false, false, LOWER_NOP },
+    { "push",        1, { ARG_VALUE,  ARG_NONE,   ARG_NONE   }, true,  false, LOWER_PUSH },
+    { "pop",         1, { ARG_SCALAR, ARG_NONE,   ARG_NONE   }, true,  false, LOWER_POP },
+    { "ar_get_idx",  3, { ARG_ARRAY,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_AR_INDEX },
+    { "ar_set_idx",  3, { ARG_ARRAY,  ARG_VALUE,  ARG_VALUE  }, true,  false, LOWER_AR_INDEX },
+    { "ar_get_size", 2, { ARG_ARRAY,  ARG_SCALAR, ARG_NONE   }, false, false, LOWER_AR_GET_SIZE },
+    { "ar_set_size", 2, { ARG_ARRAY,  ARG_VALUE,  ARG_NONE   }, true,  false, LOWER_AR_SET_SIZE },
+    { "ar_copy",     2, { ARG_ARRAY,  ARG_ARRAY,  ARG_NONE   }, true,  false, LOWER_AR_COPY },
+    { "ar_push",     1, { ARG_ARRAY,  ARG_NONE,   ARG_NONE   }, true,  false, LOWER_AR_PUSH },
+    { "ar_pop",      1, { ARG_ARRAY,  ARG_NONE,   ARG_NONE   }, true,  false, LOWER_AR_POP },
+    { "ar_get_ptr",  3, { ARG_ARRAY,  ARG_VALUE,  ARG_SCALAR }, false, false, LOWER_AR_GET_PTR },
+    { "ptr_get",     2, { ARG_VALUE,  ARG_SCALAR, ARG_NONE   }, false, false, LOWER_PTR_GET },
+    { "ptr_set",     2, { ARG_VALUE,  ARG_VALUE,  ARG_NONE   }, true,  false, LOWER_PTR_SET },
+  };
+
+  constexpr const Info & GetInfo(int op) { return INFO_TABLE[op]; }
+  constexpr const char * AsString(int op) { return INFO_TABLE[op].name; }
+  constexpr ArgKind GetArgKind(int op, int pos) { return INFO_TABLE[op].args[pos]; }
+  constexpr bool IsArgWritten(int op, int pos) { return INFO_TABLE[op].args[pos] == ARG_SCALAR; }
+  constexpr bool HasSideEffects(int op) { return INFO_TABLE[op].side_effects; }
+  constexpr bool IsCommutative(int op) { return INFO_TABLE[op].commutative; }
+  constexpr bool IsJump(int op) { return op == JUMP || op == JUMP_IF_0 || op == JUMP_IF_N0; }
+  constexpr bool IsMath(int op) { return op >= ADD && op <= TEST_GTE; }
+
+  // Look up an opcode by its IC name (NONE if there is no such instruction).
+  int FromString(const std::string & name);
+};
+
+#endif
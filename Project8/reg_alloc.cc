@@ -0,0 +1,388 @@
+#include "reg_alloc.h"
+#include "cfg.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+/******************************************
+ * BEGIN CRegAllocator
+ *****************************************/
+
+std::string CRegAllocator::RegName(int reg)
+{
+  std::string name = "reg";
+  name += (char) ('A' + reg);
+  return name;
+}
+
+// The array templates in ICEntry::PrintTC that use regC - regF as scratch.
+bool CRegAllocator::ClobbersRegs(int op)
+{
+  return op == Opcode::AR_SET_SIZE || op == Opcode::AR_COPY ||
+         op == Opcode::AR_PUSH || op == Opcode::AR_POP;
+}
+
+void CRegAllocator::ComputeLiveness(ICArray & ica)
+{
+  int num_lines = ica.GetNumEntries();
+  mLineUses.assign(num_lines, std::vector<int>());
+  mLineDefs.assign(num_lines, std::vector<int>());
+  mLiveAfter.assign(num_lines, std::set<int>());
+  mLoopDepth.assign(num_lines, 0);
+  if (num_lines == 0) return;
+
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  int num_blocks = cfg.GetNumBlocks();
+  for (int i = 0; i < num_lines; i++) mLoopDepth[i] = cfg.GetLoopDepth(i);
+
+  // Reads and writes of every line, and upward-exposed uses / defs of each block.
+  std::vector< std::vector<int> > & line_uses = mLineUses;
+  std::vector< std::vector<int> > & line_defs = mLineDefs;
+  for (int i = 0; i < num_lines; i++) {
+    ICEntry * entry = ica.GetEntry(i);
+    for (int arg = 0; arg < (int) entry->GetNumArgs(); arg++) {
+      if (!entry->IsScalarArg(arg)) continue;
+      if (ica.IsArgWritten(entry->GetOpcode(), arg)) line_defs[i].push_back(entry->GetArgID(arg));
+      else line_uses[i].push_back(entry->GetArgID(arg));
+    }
+  }
+
+  std::vector< std::set<int> > block_use(num_blocks), block_def(num_blocks);
+  for (int b = 0; b < num_blocks; b++) {
+    for (int i = cfg.GetBlock(b).mFirstLine; i <= cfg.GetBlock(b).mLastLine; i++) {
+      for (int u = 0; u < (int) line_uses[i].size(); u++) {
+        if (block_def[b].count(line_uses[i][u]) == 0) block_use[b].insert(line_uses[i][u]);
+      }
+      for (int d = 0; d < (int) line_defs[i].size(); d++) block_def[b].insert(line_defs[i][d]);
+    }
+  }
+
+  // Standard backwards liveness, iterated to a fixed point.
+  std::vector< std::set<int> > live_in(num_blocks), live_out(num_blocks);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int b = num_blocks - 1; b >= 0; b--) {
+      std::set<int> out;
+      const std::vector<int> & succs = cfg.GetBlock(b).mSuccs;
+      for (int s = 0; s < (int) succs.size(); s++) {
+        out.insert(live_in[succs[s]].begin(), live_in[succs[s]].end());
+      }
+      std::set<int> in = block_use[b];
+      for (std::set<int>::iterator it = out.begin(); it != out.end(); ++it) {
+        if (block_def[b].count(*it) == 0) in.insert(*it);
+      }
+      if (in.size() != live_in[b].size()) changed = true;
+      live_in[b].swap(in);
+      live_out[b].swap(out);
+    }
+  }
+
+  // Walk each block backwards to find what is live after every line.
+  for (int b = 0; b < num_blocks; b++) {
+    std::set<int> live = live_out[b];
+    for (int i = cfg.GetBlock(b).mLastLine; i >= cfg.GetBlock(b).mFirstLine; i--) {
+      mLiveAfter[i] = live;
+      for (int d = 0; d < (int) line_defs[i].size(); d++) live.erase(line_defs[i][d]);
+      live.insert(line_uses[i].begin(), line_uses[i].end());
+    }
+  }
+}
+
+void CRegAllocator::ComputeIntervals(ICArray & ica)
+{
+  ComputeLiveness(ica);
+  int num_lines = ica.GetNumEntries();
+  std::vector< std::vector<int> > & line_uses = mLineUses;
+  std::vector< std::vector<int> > & line_defs = mLineDefs;
+  mIntervals.clear();
+
+  // Grow the interval of everything live at (or touched by) each line.
+  std::map<int, int> interval_of;
+  for (int i = 0; i < num_lines; i++) {
+    std::set<int> touched = mLiveAfter[i];
+    touched.insert(line_uses[i].begin(), line_uses[i].end());
+    touched.insert(line_defs[i].begin(), line_defs[i].end());
+
+    for (std::set<int>::iterator it = touched.begin(); it != touched.end(); ++it) {
+      if (interval_of.find(*it) == interval_of.end()) {
+        CLiveInterval interval;
+        interval.mVarID = *it;
+        interval.mStart = i;
+        interval.mEnd = i;
+        interval.mStartsWithDef = false;
+        interval.mUseCount = 0;
+        interval.mForbidden = 0;
+        interval.mReg = -1;
+        interval_of[*it] = mIntervals.size();
+        mIntervals.push_back(interval);
+      }
+      CLiveInterval & interval = mIntervals[interval_of[*it]];
+      interval.mStart = std::min(interval.mStart, i);
+      interval.mEnd = std::max(interval.mEnd, i);
+    }
+
+    // Anything that survives one of the long array templates can't use its scratch registers.
+    if (ClobbersRegs(ica.GetEntry(i)->GetOpcode())) {
+      for (std::set<int>::iterator it = mLiveAfter[i].begin(); it != mLiveAfter[i].end(); ++it) {
+        mIntervals[interval_of[*it]].mForbidden |= CLOBBER_MASK;
+      }
+    }
+
+    for (int d = 0; d < (int) line_defs[i].size(); d++) mIntervals[interval_of[line_defs[i][d]]].mUseCount++;
+    for (int u = 0; u < (int) line_uses[i].size(); u++) mIntervals[interval_of[line_uses[i][u]]].mUseCount++;
+  }
+
+  // An interval that opens with a pure write can share a register with one
+  // that is read for the last time on that same line.
+  for (int i = 0; i < (int) mIntervals.size(); i++) {
+    CLiveInterval & interval = mIntervals[i];
+    const std::vector<int> & defs = line_defs[interval.mStart];
+    const std::vector<int> & uses = line_uses[interval.mStart];
+    interval.mStartsWithDef =
+      std::find(defs.begin(), defs.end(), interval.mVarID) != defs.end() &&
+      std::find(uses.begin(), uses.end(), interval.mVarID) == uses.end();
+  }
+}
+
+void CRegAllocator::SaveAssignment(ICArray & ica)
+{
+  for (int i = 0; i < (int) mIntervals.size(); i++) {
+    if (mIntervals[i].mReg >= 0) {
+      ica.AddReg(mIntervals[i].mVarID, RegName(mIntervals[i].mReg));
+    }
+  }
+}
+
+/******************************************
+ * BEGIN CLinearScanAllocator
+ *****************************************/
+
+static bool CompareStart(const CLiveInterval & in1, const CLiveInterval & in2)
+{
+  if (in1.mStart != in2.mStart) return in1.mStart < in2.mStart;
+  return in1.mVarID < in2.mVarID;
+}
+
+void CLinearScanAllocator::Allocate(ICArray & ica)
+{
+  ComputeIntervals(ica);
+  std::sort(mIntervals.begin(), mIntervals.end(), CompareStart);
+
+  std::vector<int> active;            // Intervals currently holding a register.
+  int free_regs = ALLOCATABLE_MASK;
+
+  for (int cur_id = 0; cur_id < (int) mIntervals.size(); cur_id++) {
+    CLiveInterval & cur = mIntervals[cur_id];
+
+    // Release the registers of intervals that have already ended.
+    for (int i = 0; i < (int) active.size(); i++) {
+      CLiveInterval & old = mIntervals[active[i]];
+      if (old.mEnd < cur.mStart || (old.mEnd == cur.mStart && cur.mStartsWithDef)) {
+        free_regs |= 1 << old.mReg;
+        active.erase(active.begin() + i);
+        i--;
+      }
+    }
+
+    int usable = free_regs & ~cur.mForbidden;
+    if (usable != 0) {
+      int reg = 0;
+      while ((usable & (1 << reg)) == 0) reg++;
+      cur.mReg = reg;
+      free_regs &= ~(1 << reg);
+      active.push_back(cur_id);
+      continue;
+    }
+
+    // No register free: spill whichever interval (this one included) ends last.
+    int spill = -1;
+    for (int i = 0; i < (int) active.size(); i++) {
+      CLiveInterval & old = mIntervals[active[i]];
+      if ((cur.mForbidden & (1 << old.mReg)) != 0) continue;
+      if (old.mEnd <= cur.mEnd) continue;
+      if (spill == -1 || old.mEnd > mIntervals[active[spill]].mEnd) spill = i;
+    }
+    if (spill == -1) continue;      // cur stays in memory.
+
+    CLiveInterval & victim = mIntervals[active[spill]];
+    cur.mReg = victim.mReg;
+    victim.mReg = -1;
+    active[spill] = cur_id;
+  }
+
+  SaveAssignment(ica);
+}
+
+/******************************************
+ * BEGIN CGraphColorAllocator
+ *****************************************/
+
+int CGraphColorAllocator::Find(int node)
+{
+  while (mAlias[node] != node) {
+    mAlias[node] = mAlias[mAlias[node]];
+    node = mAlias[node];
+  }
+  return node;
+}
+
+int CGraphColorAllocator::NumColors(int node)
+{
+  int usable = ALLOCATABLE_MASK & ~mIntervals[node].mForbidden;
+  int count = 0;
+  for (int reg = 0; reg < NUM_REGS; reg++) {
+    if (usable & (1 << reg)) count++;
+  }
+  return count;
+}
+
+void CGraphColorAllocator::AddEdge(int node1, int node2)
+{
+  if (node1 == node2) return;
+  mAdj[node1].insert(node2);
+  mAdj[node2].insert(node1);
+}
+
+// Briggs' conservative test: merging is safe if the combined node would have
+// fewer than K neighbors of significant degree.
+bool CGraphColorAllocator::CanCoalesce(int node1, int node2)
+{
+  if (mAdj[node1].count(node2)) return false;
+
+  int forbidden = mIntervals[node1].mForbidden | mIntervals[node2].mForbidden;
+  int usable = ALLOCATABLE_MASK & ~forbidden;
+  int k = 0;
+  for (int reg = 0; reg < NUM_REGS; reg++) {
+    if (usable & (1 << reg)) k++;
+  }
+  if (k == 0) return false;
+
+  std::set<int> neighbors = mAdj[node1];
+  neighbors.insert(mAdj[node2].begin(), mAdj[node2].end());
+  int significant = 0;
+  for (std::set<int>::iterator it = neighbors.begin(); it != neighbors.end(); ++it) {
+    if ((int) mAdj[*it].size() >= NumColors(*it)) significant++;
+  }
+  return significant < k;
+}
+
+void CGraphColorAllocator::Merge(int keep, int drop)
+{
+  mAlias[drop] = keep;
+  for (std::set<int>::iterator it = mAdj[drop].begin(); it != mAdj[drop].end(); ++it) {
+    mAdj[*it].erase(drop);
+    AddEdge(keep, *it);
+  }
+  mAdj[drop].clear();
+  mIntervals[keep].mForbidden |= mIntervals[drop].mForbidden;
+  mSpillCost[keep] += mSpillCost[drop];
+}
+
+void CGraphColorAllocator::Allocate(ICArray & ica)
+{
+  ComputeIntervals(ica);
+  int num_nodes = mIntervals.size();
+  int num_lines = ica.GetNumEntries();
+
+  std::map<int, int> node_of;
+  for (int i = 0; i < num_nodes; i++) node_of[mIntervals[i].mVarID] = i;
+
+  mAlias.resize(num_nodes);
+  for (int i = 0; i < num_nodes; i++) mAlias[i] = i;
+  mAdj.assign(num_nodes, std::set<int>());
+  mSpillCost.assign(num_nodes, 0.0);
+
+  // Build the interference graph: whatever a line writes conflicts with
+  // everything live after it, except the source of a plain copy.
+  std::vector< std::pair<int, int> > moves;
+  for (int i = 0; i < num_lines; i++) {
+    ICEntry * entry = ica.GetEntry(i);
+    int copy_src = -1;
+    if (entry->GetOpcode() == Opcode::VAL_COPY && entry->IsScalarArg(0) && entry->IsScalarArg(1)) {
+      copy_src = entry->GetArgID(0);
+      moves.push_back(std::make_pair(node_of[copy_src], node_of[entry->GetArgID(1)]));
+    }
+    for (int d = 0; d < (int) mLineDefs[i].size(); d++) {
+      int def_node = node_of[mLineDefs[i][d]];
+      for (std::set<int>::iterator it = mLiveAfter[i].begin(); it != mLiveAfter[i].end(); ++it) {
+        if (*it == copy_src) continue;
+        AddEdge(def_node, node_of[*it]);
+      }
+    }
+
+    // Each access costs more the deeper it is nested in loops.
+    double weight = 1.0;
+    for (int depth = 0; depth < mLoopDepth[i] && depth < 6; depth++) weight *= 10.0;
+    for (int d = 0; d < (int) mLineDefs[i].size(); d++) mSpillCost[node_of[mLineDefs[i][d]]] += weight;
+    for (int u = 0; u < (int) mLineUses[i].size(); u++) mSpillCost[node_of[mLineUses[i][u]]] += weight;
+  }
+
+  // Coalesce copies until nothing else can be merged safely.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int m = 0; m < (int) moves.size(); m++) {
+      int node1 = Find(moves[m].first);
+      int node2 = Find(moves[m].second);
+      if (node1 == node2 || !CanCoalesce(node1, node2)) continue;
+      Merge(node1, node2);
+      changed = true;
+    }
+  }
+
+  // Simplify: repeatedly pull out a node with fewer neighbors than colors; if
+  // there is none, optimistically push the cheapest node to spill (Briggs).
+  std::vector<int> degree(num_nodes, 0);
+  std::vector<bool> removed(num_nodes, true);
+  int remaining = 0;
+  for (int i = 0; i < num_nodes; i++) {
+    if (Find(i) != i) continue;
+    removed[i] = false;
+    degree[i] = mAdj[i].size();
+    remaining++;
+  }
+
+  std::vector<int> select_stack;
+  while (remaining > 0) {
+    int pick = -1;
+    for (int i = 0; i < num_nodes; i++) {
+      if (!removed[i] && degree[i] < NumColors(i)) { pick = i; break; }
+    }
+    if (pick == -1) {
+      double best = 0.0;
+      for (int i = 0; i < num_nodes; i++) {
+        if (removed[i]) continue;
+        double cost = mSpillCost[i] / (degree[i] + 1);
+        if (pick == -1 || cost < best) { pick = i; best = cost; }
+      }
+    }
+    removed[pick] = true;
+    remaining--;
+    select_stack.push_back(pick);
+    for (std::set<int>::iterator it = mAdj[pick].begin(); it != mAdj[pick].end(); ++it) {
+      degree[*it]--;
+    }
+  }
+
+  // Select: give each node the lowest register none of its neighbors took.
+  // Anything left without one stays in memory.
+  while (select_stack.size() > 0) {
+    int node = select_stack.back();
+    select_stack.pop_back();
+    int usable = ALLOCATABLE_MASK & ~mIntervals[node].mForbidden;
+    for (std::set<int>::iterator it = mAdj[node].begin(); it != mAdj[node].end(); ++it) {
+      if (mIntervals[*it].mReg >= 0) usable &= ~(1 << mIntervals[*it].mReg);
+    }
+    mIntervals[node].mReg = -1;
+    for (int reg = 0; reg < NUM_REGS; reg++) {
+      if (usable & (1 << reg)) { mIntervals[node].mReg = reg; break; }
+    }
+  }
+
+  for (int i = 0; i < num_nodes; i++) mIntervals[i].mReg = mIntervals[Find(i)].mReg;
+
+  SaveAssignment(ica);
+}
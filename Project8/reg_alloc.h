@@ -0,0 +1,108 @@
+#ifndef REG_ALLOC_H
+#define REG_ALLOC_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The classes in this file decide which scalar variables of an ICArray are
+//  kept in TubeCode registers instead of in their memory position.  The
+//  decisions are handed back to the ICArray (through AddReg) and are used by
+//  ICEntry::PrintTC when it lowers each instruction.
+//
+//  CLiveInterval : The span of IC lines over which a scalar must hold its value.
+//  CRegAllocator : Base class; computes liveness and live intervals for the IC.
+//  CLinearScanAllocator : Linear-scan allocation over the live intervals.
+//  CGraphColorAllocator : Chaitin/Briggs coloring of the interference graph, with
+//                         copy coalescing and loop-weighted spill costs (-O2).
+//
+//  Register conventions in the generated TubeCode:
+//    regA, regB  : scratch registers for operands that stay in memory.
+//    regC - regG : allocatable.  regC - regF are also used as scratch by the
+//                  long array templates (ar_set_size, ar_copy, ar_push, ar_pop),
+//                  so nothing that is live across one of those can use them.
+//    regH        : stack pointer.
+//
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ic.h"
+
+struct CLiveInterval {
+  int mVarID;          // Scalar variable this interval belongs to.
+  int mStart;          // First IC line where the variable is live (or defined).
+  int mEnd;            // Last IC line where the variable is live (or used).
+  bool mStartsWithDef; // Does the interval begin with a write (not a read)?
+  int mUseCount;       // Number of reads and writes of the variable.
+  int mForbidden;      // Bitmask of registers this variable may not occupy.
+  int mReg;            // Assigned register (-1 if it stays in memory).
+};
+
+class CRegAllocator {
+public:
+  enum { REG_A = 0, REG_B, REG_C, REG_D, REG_E, REG_F, REG_G, REG_H, NUM_REGS };
+
+  // Registers that can be handed out, and those trashed by the array templates.
+  static const int ALLOCATABLE_MASK = (1 << REG_C) | (1 << REG_D) | (1 << REG_E)
+                                    | (1 << REG_F) | (1 << REG_G);
+  static const int CLOBBER_MASK = (1 << REG_C) | (1 << REG_D) | (1 << REG_E)
+                                | (1 << REG_F);
+
+protected:
+  std::vector<CLiveInterval> mIntervals;
+
+  // Per IC line: scalars read, scalars written, scalars live afterwards, and
+  // how many loops the line sits inside.
+  std::vector< std::vector<int> > mLineUses;
+  std::vector< std::vector<int> > mLineDefs;
+  std::vector< std::set<int> > mLiveAfter;
+  std::vector<int> mLoopDepth;
+
+  // Fill the per-line tables above.
+  void ComputeLiveness(ICArray & ica);
+
+  // Fill mIntervals with the live interval of every scalar used in the IC
+  // (runs ComputeLiveness first).
+  void ComputeIntervals(ICArray & ica);
+
+  // Pass the final assignment in mIntervals back to the ICArray.
+  void SaveAssignment(ICArray & ica);
+
+public:
+  CRegAllocator() { ; }
+  virtual ~CRegAllocator() { ; }
+
+  static std::string RegName(int reg);
+  static bool ClobbersRegs(int op);
+
+  virtual void Allocate(ICArray & ica) = 0;
+};
+
+class CLinearScanAllocator : public CRegAllocator {
+public:
+  CLinearScanAllocator() { ; }
+  ~CLinearScanAllocator() { ; }
+
+  void Allocate(ICArray & ica);
+};
+
+class CGraphColorAllocator : public CRegAllocator {
+private:
+  std::vector<int> mAlias;              // Union-find parent of each node (coalescing).
+  std::vector< std::set<int> > mAdj;    // Interference edges between nodes.
+  std::vector<double> mSpillCost;       // Loop-weighted number of reads and writes.
+
+  int Find(int node);
+  int NumColors(int node);              // Registers this node is allowed to take.
+  void AddEdge(int node1, int node2);
+  bool CanCoalesce(int node1, int node2);
+  void Merge(int keep, int drop);
+
+public:
+  CGraphColorAllocator() { ; }
+  ~CGraphColorAllocator() { ; }
+
+  void Allocate(ICArray & ica);
+};
+
+#endif
@@ -0,0 +1,663 @@
+#include "ssa.h"
+#include "cfg.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+/******************************************
+ * BEGIN CSSAForm
+ *****************************************/
+
+// Follow a chain of copies back to the value it starts from.
+static ICOperand Resolve(const std::vector<ICOperand> & copy_of, ICOperand arg)
+{
+  while (arg.IsScalar() && arg.GetID() < (int) copy_of.size() && !copy_of[arg.GetID()].IsNone()) {
+    arg = copy_of[arg.GetID()];
+  }
+  return arg;
+}
+
+static ICEntry * MakeCopy(ICArray & ica, const ICOperand & from, const ICOperand & to)
+{
+  ICEntry * entry = new ICEntry(Opcode::VAL_COPY, "", &ica);
+  entry->AddArg(from);
+  entry->AddArg(to);
+  return entry;
+}
+
+static bool ByLine(const std::pair<int, ICEntry *> & a, const std::pair<int, ICEntry *> & b)
+{
+  return a.first < b.first;
+}
+
+bool CSSAForm::IsName(const ICOperand & arg) const
+{
+  return arg.IsScalar() && arg.GetID() < (int) mVarOf.size() && mVarOf[arg.GetID()] != -1;
+}
+
+int CSSAForm::NewName(int var)
+{
+  mVarOf.push_back(var);
+  mDefLine.push_back(-1);
+  mDefPhi.push_back(-1);
+  return mVarOf.size() - 1;
+}
+
+// Rename only the scalars that are used nowhere but in main-line code that can run.
+bool CSSAForm::FindScalars(ICArray & ica)
+{
+  int num_lines = ica.GetNumEntries();
+  int num_blocks = mCFG->GetNumBlocks();
+  // Entry values come in at the top of block 0, so nothing else may lead there.
+  if (mCFG->GetBlock(0).mDomPreds.size() > 0) return false;
+
+  std::map<int, int> label_block;
+  for (int line = 0; line < num_lines; line++) {
+    const std::string & label = ica.GetEntry(line)->GetLabel();
+    if (label != "") label_block[ICOperand::InternLabel(label)] = mCFG->GetBlockOf(line);
+  }
+
+  // Function bodies: everything reachable from a called label.
+  std::vector<bool> in_function(num_blocks, false);
+  std::vector<int> worklist;
+  for (int b = 0; b < num_blocks; b++) {
+    const CBasicBlock & info = mCFG->GetBlock(b);
+    if (!info.mIsCall) continue;
+    std::map<int, int>::iterator target =
+      label_block.find(ica.GetEntry(info.mLastLine)->GetOperand(0).GetValue());
+    if (target != label_block.end()) worklist.push_back(target->second);
+  }
+  while (worklist.size() > 0) {
+    int block = worklist.back();
+    worklist.pop_back();
+    if (in_function[block]) continue;
+    in_function[block] = true;
+    const std::vector<int> & succs = mCFG->GetBlock(block).mDomSuccs;
+    worklist.insert(worklist.end(), succs.begin(), succs.end());
+  }
+
+  mFirstName = ica.static_memory_size;
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (entry->IsScalarArg(i)) mFirstName = std::max(mFirstName, entry->GetArgID(i) + 1);
+    }
+  }
+
+  mVarOf.assign(mFirstName, -1);
+  std::vector<bool> excluded(mFirstName, false);
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    int block = mCFG->GetBlockOf(line);
+    bool outside = in_function[block] || !mCFG->IsReachable(block);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!entry->IsScalarArg(i)) continue;
+      if (outside) excluded[entry->GetArgID(i)] = true;
+      else mVarOf[entry->GetArgID(i)] = entry->GetArgID(i);
+    }
+  }
+
+  bool any = false;
+  for (int id = 0; id < mFirstName; id++) {
+    if (excluded[id]) mVarOf[id] = -1;
+    else if (mVarOf[id] != -1) any = true;
+  }
+  mDefLine.assign(mFirstName, -1);
+  mDefPhi.assign(mFirstName, -1);
+  return any;
+}
+
+// For every name: the blocks that read it before writing it, and the blocks that write it.
+void CSSAForm::ScanBlocks(ICArray & ica, std::vector<std::vector<int> > & read_blocks,
+                          std::vector<std::vector<int> > & write_blocks) const
+{
+  int num_ids = mVarOf.size();
+  read_blocks.assign(num_ids, std::vector<int>());
+  write_blocks.assign(num_ids, std::vector<int>());
+  for (int b = 0; b < mCFG->GetNumBlocks(); b++) {
+    for (int line = mFirstLine[b]; line <= mLastLine[b]; line++) {
+      const ICEntry * entry = ica.GetEntry(line);
+      if (entry->GetDelete()) continue;
+      for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+        if (!IsName(entry->GetOperand(i)) || Opcode::IsArgWritten(entry->GetOpcode(), i)) continue;
+        int id = entry->GetArgID(i);
+        bool written = write_blocks[id].size() > 0 && write_blocks[id].back() == b;
+        bool seen = read_blocks[id].size() > 0 && read_blocks[id].back() == b;
+        if (!written && !seen) read_blocks[id].push_back(b);
+      }
+      for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+        if (!IsName(entry->GetOperand(i)) || !Opcode::IsArgWritten(entry->GetOpcode(), i)) continue;
+        int id = entry->GetArgID(i);
+        if (write_blocks[id].size() == 0 || write_blocks[id].back() != b) write_blocks[id].push_back(b);
+      }
+    }
+  }
+}
+
+// Walk back from the blocks that read 'id' first, stopping at blocks that write it.  Leaves
+// mLiveMark set to 'id' on exactly the blocks it is live into.
+void CSSAForm::FindLiveIn(int id, const std::vector<int> & read_blocks, const std::vector<int> & write_blocks,
+                          std::vector<int> & live_in)
+{
+  for (int i = 0; i < (int) write_blocks.size(); i++) mWriteMark[write_blocks[i]] = id;
+  live_in = read_blocks;
+  for (int i = 0; i < (int) live_in.size(); i++) mLiveMark[live_in[i]] = id;
+  for (int next = 0; next < (int) live_in.size(); next++) {
+    const std::vector<int> & preds = mCFG->GetBlock(live_in[next]).mDomPreds;
+    for (int p = 0; p < (int) preds.size(); p++) {
+      if (mLiveMark[preds[p]] == id || mWriteMark[preds[p]] == id) continue;
+      mLiveMark[preds[p]] = id;
+      live_in.push_back(preds[p]);
+    }
+  }
+}
+
+// Cytron et al.'s placement, pruned: a scalar gets a phi in each block of the iterated
+// dominance frontier of its writes that it is live into.
+void CSSAForm::PlacePhis(ICArray & ica)
+{
+  int num_blocks = mCFG->GetNumBlocks();
+
+  // Dominance frontiers as Cooper, Harvey & Kennedy find them: walk up the dominator tree from
+  // each predecessor of a join until reaching the join's immediate dominator.
+  std::vector<std::vector<int> > frontier(num_blocks);
+  for (int b = 0; b < num_blocks; b++) {
+    const CBasicBlock & info = mCFG->GetBlock(b);
+    if (!mCFG->IsReachable(b) || info.mDomPreds.size() < 2) continue;
+    for (int p = 0; p < (int) info.mDomPreds.size(); p++) {
+      if (!mCFG->IsReachable(info.mDomPreds[p])) continue;
+      for (int runner = info.mDomPreds[p]; runner != info.mIDom; runner = mCFG->GetBlock(runner).mIDom) {
+        if (frontier[runner].size() == 0 || frontier[runner].back() != b) frontier[runner].push_back(b);
+      }
+    }
+  }
+
+  std::vector<std::vector<int> > read_blocks, write_blocks;
+  ScanBlocks(ica, read_blocks, write_blocks);
+  mBlockPhis.assign(num_blocks, std::vector<int>());
+  mLiveMark.assign(num_blocks, -1);
+  mWriteMark.assign(num_blocks, -1);
+  std::vector<int> has_phi(num_blocks, -1);
+  std::vector<int> live_in, worklist;
+  for (int id = 0; id < mFirstName; id++) {
+    if (mVarOf[id] == -1 || read_blocks[id].size() == 0 || write_blocks[id].size() == 0) continue;
+    FindLiveIn(id, read_blocks[id], write_blocks[id], live_in);
+
+    worklist = write_blocks[id];
+    while (worklist.size() > 0) {
+      int block = worklist.back();
+      worklist.pop_back();
+      for (int f = 0; f < (int) frontier[block].size(); f++) {
+        int join = frontier[block][f];
+        if (has_phi[join] == id || mLiveMark[join] != id) continue;
+        has_phi[join] = id;
+        CPhi phi;
+        phi.mBlock = join;
+        phi.mVar = id;
+        phi.mName = -1;
+        phi.mArgs.resize(mCFG->GetBlock(join).mDomPreds.size());
+        phi.mDead = false;
+        mBlockPhis[join].push_back(mPhis.size());
+        mPhis.push_back(phi);
+        if (mWriteMark[join] != id) worklist.push_back(join);
+      }
+    }
+  }
+}
+
+// Hand out names walking the dominator tree; each scalar's stack holds the names in scope, and
+// an empty stack means the value it had on entry.
+void CSSAForm::Rename(ICArray & ica)
+{
+  std::vector<std::vector<int> > stacks(mFirstName);
+  std::vector<int> pushed;                    // Scalars pushed onto, in order.
+  std::vector<int> marks;                     // Size of 'pushed' on entering each block below.
+  std::vector<std::pair<int, int> > walk;     // (block, next dominator-tree child to visit)
+
+  int block = 0;
+  while (block != -1) {
+    marks.push_back(pushed.size());
+    const std::vector<int> & phis = mBlockPhis[block];
+    for (int p = 0; p < (int) phis.size(); p++) {
+      CPhi & phi = mPhis[phis[p]];
+      phi.mName = NewName(phi.mVar);
+      mDefPhi[phi.mName] = phis[p];
+      stacks[phi.mVar].push_back(phi.mName);
+      pushed.push_back(phi.mVar);
+    }
+
+    const CBasicBlock & info = mCFG->GetBlock(block);
+    for (int line = info.mFirstLine; line <= info.mLastLine; line++) {
+      ICEntry * entry = ica.GetEntry(line);
+      if (entry->GetDelete()) continue;
+      for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+        if (!IsName(entry->GetOperand(i)) || Opcode::IsArgWritten(entry->GetOpcode(), i)) continue;
+        int var = entry->GetArgID(i);
+        if (stacks[var].size() > 0) entry->SetOperand(i, ICOperand::Scalar(stacks[var].back()));
+      }
+      for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+        if (!IsName(entry->GetOperand(i)) || !Opcode::IsArgWritten(entry->GetOpcode(), i)) continue;
+        int var = entry->GetArgID(i);
+        int name = NewName(var);
+        mDefLine[name] = line;
+        stacks[var].push_back(name);
+        pushed.push_back(var);
+        entry->SetOperand(i, ICOperand::Scalar(name));
+      }
+    }
+
+    for (int s = 0; s < (int) info.mDomSuccs.size(); s++) {
+      int succ = info.mDomSuccs[s];
+      const std::vector<int> & preds = mCFG->GetBlock(succ).mDomPreds;
+      int which = std::find(preds.begin(), preds.end(), block) - preds.begin();
+      for (int p = 0; p < (int) mBlockPhis[succ].size(); p++) {
+        CPhi & phi = mPhis[mBlockPhis[succ][p]];
+        int var = phi.mVar;
+        phi.mArgs[which] = ICOperand::Scalar(stacks[var].size() > 0 ? stacks[var].back() : var);
+      }
+    }
+    walk.push_back(std::make_pair(block, 0));
+
+    // On to the next block of the dominator tree, leaving the ones that are finished.
+    block = -1;
+    while (walk.size() > 0 && block == -1) {
+      const std::vector<int> & children = mCFG->GetBlock(walk.back().first).mDomChildren;
+      int & next = walk.back().second;
+      if (next < (int) children.size()) {
+        block = children[next++];
+        continue;
+      }
+      while ((int) pushed.size() > marks.back()) {
+        stacks[pushed.back()].pop_back();
+        pushed.pop_back();
+      }
+      marks.pop_back();
+      walk.pop_back();
+    }
+  }
+}
+
+// A name written once by a copy is the copy's source everywhere; so is a phi all of whose
+// inputs (other than itself) are the same.
+void CSSAForm::PropagateCopies(ICArray & ica)
+{
+  int num_lines = ica.GetNumEntries();
+  std::vector<ICOperand> copy_of(mVarOf.size());
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete() || entry->GetOpcode() != Opcode::VAL_COPY || !IsName(entry->GetOperand(1))) continue;
+    const ICOperand & from = entry->GetOperand(0);
+    if (from.IsImmediate() || IsName(from)) copy_of[entry->GetArgID(1)] = from;
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int p = 0; p < (int) mPhis.size(); p++) {
+      CPhi & phi = mPhis[p];
+      if (phi.mDead) continue;
+      ICOperand same;
+      bool agree = true;
+      for (int a = 0; a < (int) phi.mArgs.size() && agree; a++) {
+        ICOperand arg = Resolve(copy_of, phi.mArgs[a]);
+        if (arg.IsNone() || arg == ICOperand::Scalar(phi.mName)) continue;
+        if (same.IsNone()) same = arg;
+        else if (arg != same) agree = false;
+      }
+      if (!agree || same.IsNone()) continue;
+      copy_of[phi.mName] = same;
+      phi.mDead = true;
+      changed = true;
+    }
+  }
+
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    if (entry->GetOpcode() == Opcode::VAL_COPY && IsName(entry->GetOperand(1)) &&
+        !copy_of[entry->GetArgID(1)].IsNone()) {
+      entry->SetDelete(true);
+      mNumChanged++;
+      continue;
+    }
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!IsName(entry->GetOperand(i)) || Opcode::IsArgWritten(entry->GetOpcode(), i)) continue;
+      entry->SetOperand(i, Resolve(copy_of, entry->GetOperand(i)));
+    }
+  }
+  for (int p = 0; p < (int) mPhis.size(); p++) {
+    CPhi & phi = mPhis[p];
+    for (int a = 0; a < (int) phi.mArgs.size(); a++) phi.mArgs[a] = Resolve(copy_of, phi.mArgs[a]);
+  }
+}
+
+// Work back from the lines that do something (output, control flow, memory, or writing a
+// scalar that is not renamed) to the names they need; lines and phis for any other name go.
+void CSSAForm::RemoveDeadCode(ICArray & ica)
+{
+  int num_lines = ica.GetNumEntries();
+  std::vector<bool> needed(mVarOf.size(), false);
+  std::vector<int> worklist;
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    bool writes_name = false;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (Opcode::IsArgWritten(entry->GetOpcode(), i) && IsName(entry->GetOperand(i))) writes_name = true;
+    }
+    if (writes_name && !Opcode::HasSideEffects(entry->GetOpcode())) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!IsName(entry->GetOperand(i)) || Opcode::IsArgWritten(entry->GetOpcode(), i)) continue;
+      if (!needed[entry->GetArgID(i)]) {
+        needed[entry->GetArgID(i)] = true;
+        worklist.push_back(entry->GetArgID(i));
+      }
+    }
+  }
+
+  while (worklist.size() > 0) {
+    int name = worklist.back();
+    worklist.pop_back();
+    std::vector<ICOperand> inputs;
+    if (mDefLine[name] != -1) {
+      const ICEntry * entry = ica.GetEntry(mDefLine[name]);
+      for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+        if (!Opcode::IsArgWritten(entry->GetOpcode(), i)) inputs.push_back(entry->GetOperand(i));
+      }
+    }
+    else if (mDefPhi[name] != -1) inputs = mPhis[mDefPhi[name]].mArgs;
+    for (int i = 0; i < (int) inputs.size(); i++) {
+      if (IsName(inputs[i]) && !needed[inputs[i].GetID()]) {
+        needed[inputs[i].GetID()] = true;
+        worklist.push_back(inputs[i].GetID());
+      }
+    }
+  }
+
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete() || Opcode::HasSideEffects(entry->GetOpcode())) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!Opcode::IsArgWritten(entry->GetOpcode(), i) || !IsName(entry->GetOperand(i))) continue;
+      if (needed[entry->GetArgID(i)]) continue;
+      entry->SetDelete(true);
+      mNumChanged++;
+    }
+  }
+  for (int p = 0; p < (int) mPhis.size(); p++) {
+    if (!needed[mPhis[p].mName]) mPhis[p].mDead = true;
+  }
+}
+
+// Sreedhar's method I: each phi gets a new name of its own, written at the end of every
+// predecessor and copied into the phi's name at the top of its block.  The new name is only
+// ever live across the edges into the block, so it cannot clash with anything.
+void CSSAForm::InsertCopies(ICArray & ica)
+{
+  std::vector<std::pair<int, ICEntry *> > copies;
+  std::vector<std::pair<int, ICEntry *> > ends;
+  std::map<ICEntry *, int> block_of;
+  for (int p = 0; p < (int) mPhis.size(); p++) {
+    const CPhi & phi = mPhis[p];
+    if (phi.mDead) continue;
+    const CBasicBlock & info = mCFG->GetBlock(phi.mBlock);
+    ICOperand merged = ICOperand::Scalar(NewName(phi.mVar));
+
+    int top = info.mFirstLine;
+    if (ica.GetEntry(top)->GetOpcode() == Opcode::NONE && ica.GetEntry(top)->GetLabel() != "") top++;
+    copies.push_back(std::make_pair(top, MakeCopy(ica, merged, ICOperand::Scalar(phi.mName))));
+    block_of[copies.back().second] = phi.mBlock;
+
+    for (int a = 0; a < (int) phi.mArgs.size(); a++) {
+      if (phi.mArgs[a].IsNone()) continue;
+      int end = mCFG->GetBlock(info.mDomPreds[a]).mLastLine;
+      if (!Opcode::IsJump(ica.GetEntry(end)->GetOpcode())) end++;
+      ends.push_back(std::make_pair(end, MakeCopy(ica, phi.mArgs[a], merged)));
+      block_of[ends.back().second] = info.mDomPreds[a];
+    }
+  }
+
+  // Where a block's top is also the end of a predecessor, its own phis are read first.
+  copies.insert(copies.end(), ends.begin(), ends.end());
+  std::stable_sort(copies.begin(), copies.end(), ByLine);
+  ica.InsertEntries(copies);
+  mNumChanged += copies.size();
+
+  // Each copy went at the top or the end of its block, so the blocks are the same runs of
+  // lines as before, just longer.
+  std::vector<int> old_block_of;
+  old_block_of.swap(mBlockOf);
+  int old_line = 0;
+  for (int line = 0; line < ica.GetNumEntries(); line++) {
+    std::map<ICEntry *, int>::iterator added = block_of.find(ica.GetEntry(line));
+    mBlockOf.push_back(added != block_of.end() ? added->second : old_block_of[old_line++]);
+  }
+  FindLineRanges();
+}
+
+void CSSAForm::FindLineRanges()
+{
+  int num_blocks = mCFG->GetNumBlocks();
+  mFirstLine.assign(num_blocks, -1);
+  mLastLine.assign(num_blocks, -2);
+  for (int line = 0; line < (int) mBlockOf.size(); line++) {
+    if (mFirstLine[mBlockOf[line]] == -1) mFirstLine[mBlockOf[line]] = line;
+    mLastLine[mBlockOf[line]] = line;
+  }
+}
+
+int CSSAForm::Find(int name)
+{
+  while (mParent[name] != name) {
+    mParent[name] = mParent[mParent[name]];
+    name = mParent[name];
+  }
+  return mParent[name];
+}
+
+// Merge two groups of names; returns the group they now form.
+int CSSAForm::Union(int group1, int group2, std::vector<std::vector<int> > & defs,
+                    std::vector<std::vector<int> > & live_in)
+{
+  if (defs[group1].size() < defs[group2].size()) std::swap(group1, group2);
+  mParent[group2] = group1;
+  defs[group1].insert(defs[group1].end(), defs[group2].begin(), defs[group2].end());
+  std::vector<int> merged;
+  std::set_union(live_in[group1].begin(), live_in[group1].end(), live_in[group2].begin(),
+                 live_in[group2].end(), std::back_inserter(merged));
+  live_in[group1].swap(merged);
+  std::vector<int>().swap(defs[group2]);
+  std::vector<int>().swap(live_in[group2]);
+  return group1;
+}
+
+// Is some name in 'group' still to be read right after 'line'?
+bool CSSAForm::LiveAfter(ICArray & ica, int line, int group, const std::vector<int> & live_in)
+{
+  const CBasicBlock & info = mCFG->GetBlock(mBlockOf[line]);
+  for (int next = line + 1; next <= mLastLine[mBlockOf[line]]; next++) {
+    const ICEntry * entry = ica.GetEntry(next);
+    if (entry->GetDelete()) continue;
+    bool written = false;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!IsName(entry->GetOperand(i)) || Find(entry->GetArgID(i)) != group) continue;
+      if (!Opcode::IsArgWritten(entry->GetOpcode(), i)) return true;
+      written = true;
+    }
+    if (written) return false;
+  }
+  for (int s = 0; s < (int) info.mDomSuccs.size(); s++) {
+    if (std::binary_search(live_in.begin(), live_in.end(), info.mDomSuccs[s])) return true;
+  }
+  return false;
+}
+
+// Does some write of 'group' (other than a copy from 'other') happen while 'other' is still
+// to be read?
+bool CSSAForm::WrittenWhileLive(ICArray & ica, int group, int other, const std::vector<std::vector<int> > & defs,
+                                const std::vector<std::vector<int> > & live_in)
+{
+  std::vector<int> lines;
+  if (defs[group].size() <= live_in[other].size() + defs[other].size()) lines = defs[group];
+  else {
+    // A group with many writes: only look in the blocks where 'other' can be live at all.
+    std::vector<int> blocks = live_in[other];
+    for (int d = 0; d < (int) defs[other].size(); d++) blocks.push_back(mBlockOf[defs[other][d]]);
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    for (int b = 0; b < (int) blocks.size(); b++) {
+      for (int line = mFirstLine[blocks[b]]; line <= mLastLine[blocks[b]]; line++) {
+        const ICEntry * entry = ica.GetEntry(line);
+        for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+          if (Opcode::IsArgWritten(entry->GetOpcode(), i) && IsName(entry->GetOperand(i)) &&
+              Find(entry->GetArgID(i)) == group) lines.push_back(line);
+        }
+      }
+    }
+  }
+
+  for (int l = 0; l < (int) lines.size(); l++) {
+    const ICEntry * entry = ica.GetEntry(lines[l]);
+    if (entry->GetDelete()) continue;
+    // Right after a copy between them, the two hold the same value.
+    if (entry->GetOpcode() == Opcode::VAL_COPY && IsName(entry->GetOperand(0)) &&
+        Find(entry->GetArgID(0)) == other) continue;
+    if (LiveAfter(ica, lines[l], other, live_in[other])) return true;
+  }
+  return false;
+}
+
+// Two groups of names clash if one is written while the other is still to be read, or if
+// both still hold the values they started the program with.
+bool CSSAForm::Interfere(ICArray & ica, int group1, int group2, const std::vector<std::vector<int> > & defs,
+                         const std::vector<std::vector<int> > & live_in)
+{
+  const std::vector<int> & live1 = live_in[group1];
+  const std::vector<int> & live2 = live_in[group2];
+  if (std::binary_search(live1.begin(), live1.end(), 0) && std::binary_search(live2.begin(), live2.end(), 0)) {
+    return true;
+  }
+  return WrittenWhileLive(ica, group1, group2, defs, live_in) || WrittenWhileLive(ica, group2, group1, defs, live_in);
+}
+
+// Merge the two sides of each copy where that is safe, hottest copies first, then give every
+// group of names a scalar ID.
+void CSSAForm::Coalesce(ICArray & ica)
+{
+  int num_lines = ica.GetNumEntries();
+  int num_names = mVarOf.size();
+  int num_blocks = mCFG->GetNumBlocks();
+
+  std::vector<std::vector<int> > read_blocks, write_blocks;
+  ScanBlocks(ica, read_blocks, write_blocks);
+  std::vector<std::vector<int> > live_in(num_names), defs(num_names);
+  mLiveMark.assign(num_blocks, -1);
+  mWriteMark.assign(num_blocks, -1);
+  for (int id = 0; id < num_names; id++) {
+    if (mVarOf[id] == -1 || read_blocks[id].size() == 0) continue;
+    FindLiveIn(id, read_blocks[id], write_blocks[id], live_in[id]);
+    std::sort(live_in[id].begin(), live_in[id].end());
+  }
+
+  std::vector<std::pair<int, int> > copies;   // (minus loop depth, line)
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (IsName(entry->GetOperand(i)) && Opcode::IsArgWritten(entry->GetOpcode(), i)) {
+        defs[entry->GetArgID(i)].push_back(line);
+      }
+    }
+    if (entry->GetOpcode() == Opcode::VAL_COPY && IsName(entry->GetOperand(0)) && IsName(entry->GetOperand(1))) {
+      copies.push_back(std::make_pair(-mCFG->GetBlock(mBlockOf[line]).mLoopDepth, line));
+    }
+  }
+  std::sort(copies.begin(), copies.end());
+
+  mParent.resize(num_names);
+  for (int id = 0; id < num_names; id++) mParent[id] = id;
+  for (int c = 0; c < (int) copies.size(); c++) {
+    ICEntry * entry = ica.GetEntry(copies[c].second);
+    int group1 = Find(entry->GetArgID(1));
+    int group2 = Find(entry->GetArgID(0));
+    if (group1 != group2) {
+      if (Interfere(ica, group1, group2, defs, live_in)) continue;
+      Union(group1, group2, defs, live_in);
+    }
+    entry->SetDelete(true);
+    mNumChanged++;
+  }
+
+  // The register allocators see a function return to every place it is called from, so a
+  // value live across one call looks live across them all, and each takes a register for the
+  // whole stretch.  Pack the groups that live across calls into as few scalars as will go.
+  std::vector<int> return_points;
+  for (int b = 0; b < num_blocks; b++) {
+    if (mCFG->GetBlock(b).mIsCall && b + 1 < num_blocks) return_points.push_back(b + 1);
+  }
+  std::vector<int> packed;   // Groups live across a call, as merged so far.
+  for (int id = 0; id < num_names; id++) {
+    if (mVarOf[id] == -1 || Find(id) != id) continue;
+    bool crosses = false;
+    for (int r = 0; r < (int) return_points.size() && !crosses; r++) {
+      crosses = std::binary_search(live_in[id].begin(), live_in[id].end(), return_points[r]);
+    }
+    if (!crosses) continue;
+    int p = 0;
+    while (p < (int) packed.size() && Interfere(ica, packed[p], id, defs, live_in)) p++;
+    if (p < (int) packed.size()) packed[p] = Union(packed[p], id, defs, live_in);
+    else packed.push_back(id);
+  }
+
+  // A group holding a scalar's entry value must keep that scalar's ID; otherwise a group takes
+  // the ID of the scalar it came from if no other group has, or a new one if it has.
+  ica.static_memory_size = std::max(ica.static_memory_size, mFirstName);
+  std::vector<int> final_id(num_names, -1);
+  std::vector<bool> taken(mFirstName, false);
+  for (int line = 0; line < num_lines; line++) {
+    const ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!IsName(entry->GetOperand(i)) || entry->GetArgID(i) >= mFirstName) continue;
+      final_id[Find(entry->GetArgID(i))] = entry->GetArgID(i);
+      taken[entry->GetArgID(i)] = true;
+    }
+  }
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    if (entry->GetDelete()) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!IsName(entry->GetOperand(i))) continue;
+      int group = Find(entry->GetArgID(i));
+      if (final_id[group] == -1) {
+        int var = mVarOf[entry->GetArgID(i)];
+        final_id[group] = taken[var] ? ica.static_memory_size++ : var;
+        taken[var] = true;
+      }
+      if (final_id[group] != mVarOf[entry->GetArgID(i)]) mNumChanged++;
+      entry->SetOperand(i, ICOperand::Scalar(final_id[group]));
+    }
+  }
+}
+
+int CSSAForm::Run(ICArray & ica)
+{
+  mNumChanged = 0;
+  if (ica.GetNumEntries() == 0) return 0;
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  mCFG = &cfg;
+  if (!FindScalars(ica)) return 0;
+  for (int line = 0; line < ica.GetNumEntries(); line++) mBlockOf.push_back(cfg.GetBlockOf(line));
+  FindLineRanges();
+
+  PlacePhis(ica);
+  Rename(ica);
+  PropagateCopies(ica);
+  RemoveDeadCode(ica);
+
+  InsertCopies(ica);
+  Coalesce(ica);
+  return mNumChanged;
+}
@@ -0,0 +1,94 @@
+#ifndef SSA_H
+#define SSA_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CSSAForm takes the scalars of an ICArray into static single assignment form, cleans up what
+//  that makes easy to see, and takes them back out again.
+//    * Every write of a scalar gets a new name, and a phi goes at the top of each block in the
+//      iterated dominance frontier of its writes where the scalar is still live (pruned SSA).
+//      Names are handed out walking the dominator tree, so each read sees the one write (or
+//      phi) that reaches it.  The value a scalar has when the program starts keeps its ID.
+//    * With one write per name, copies propagate globally: "val_copy x t" sends every read of
+//      t to x (or to the number, if x is one), and a phi whose inputs all agree is a copy too.
+//      Lines and phis whose names nothing needs are then dropped, including loops of phis that
+//      only feed each other.
+//    * Leaving SSA, each phi gets a scalar of its own, written at the end of each predecessor
+//      and copied into the phi's name at the top of its block (Sreedhar's method I, which is
+//      safe on critical edges and against the lost-copy and swap problems).  Copies whose two
+//      sides never hold different live values are then coalesced, innermost loops first, and
+//      whatever is left of each scalar gets an ID of its own.  Unrelated uses of a variable
+//      (a loop counter reused by the next loop, say) so end up in different scalars.
+//
+//  Phis live in a table on the side rather than in the IC: they take one input per
+//  predecessor, and an ICEntry holds at most three arguments.  None survive Run().
+//
+//  Only scalars that no function body touches are renamed.  Dominators come from the
+//  call-summary view (see cfg.h), where a call goes straight to its return point; that view
+//  is exact for those scalars and for no others.
+//
+
+#include <vector>
+
+#include "ic.h"
+
+class CControlFlowGraph;
+
+class CSSAForm {
+private:
+  struct CPhi {
+    int mBlock;
+    int mVar;                        // Scalar it merges.
+    int mName;                       // Name it defines.
+    std::vector<ICOperand> mArgs;    // Value coming in from each of the block's mDomPreds.
+    bool mDead;
+  };
+
+  const CControlFlowGraph * mCFG;
+  int mFirstName;                            // IDs from here up are names made by renaming.
+  std::vector<int> mVarOf;                   // ID -> scalar it is a name of (-1: not renamed).
+  std::vector<int> mDefLine;                 // Name -> line that writes it (-1 if none).
+  std::vector<int> mDefPhi;                  // Name -> phi that defines it (-1 if none).
+  std::vector<CPhi> mPhis;
+  std::vector<std::vector<int> > mBlockPhis; // Block -> its phis.
+  std::vector<int> mBlockOf;                 // Line -> block (kept up to date as copies go in).
+  std::vector<int> mFirstLine;               // Block -> its first and last lines.
+  std::vector<int> mLastLine;
+  std::vector<int> mParent;                  // Union-find over names while coalescing.
+  std::vector<int> mLiveMark;                // Block -> last ID found live into it.
+  std::vector<int> mWriteMark;               // Block -> last ID found written in it.
+  int mNumChanged;
+
+  bool IsName(const ICOperand & arg) const;
+  int NewName(int var);
+  bool FindScalars(ICArray & ica);
+  void FindLineRanges();
+  void ScanBlocks(ICArray & ica, std::vector<std::vector<int> > & read_blocks,
+                  std::vector<std::vector<int> > & write_blocks) const;
+  void FindLiveIn(int id, const std::vector<int> & read_blocks, const std::vector<int> & write_blocks,
+                  std::vector<int> & live_in);
+  void PlacePhis(ICArray & ica);
+  void Rename(ICArray & ica);
+  void PropagateCopies(ICArray & ica);
+  void RemoveDeadCode(ICArray & ica);
+  void InsertCopies(ICArray & ica);
+  void Coalesce(ICArray & ica);
+
+  int Find(int name);
+  int Union(int group1, int group2, std::vector<std::vector<int> > & defs,
+            std::vector<std::vector<int> > & live_in);
+  bool LiveAfter(ICArray & ica, int line, int group, const std::vector<int> & live_in);
+  bool WrittenWhileLive(ICArray & ica, int group, int other, const std::vector<std::vector<int> > & defs,
+                        const std::vector<std::vector<int> > & live_in);
+  bool Interfere(ICArray & ica, int group1, int group2, const std::vector<std::vector<int> > & defs,
+                 const std::vector<std::vector<int> > & live_in);
+
+public:
+  CSSAForm() : mCFG(NULL), mFirstName(0), mNumChanged(0) { ; }
+  ~CSSAForm() { ; }
+
+  // Go into SSA form, simplify, and come back out; returns how many lines changed.
+  int Run(ICArray & ica);
+};
+
+#endif
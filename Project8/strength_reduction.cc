@@ -0,0 +1,305 @@
+#include "strength_reduction.h"
+#include "cfg.h"
+
+#include <algorithm>
+#include <set>
+
+/******************************************
+ * BEGIN CStrengthReduction
+ *****************************************/
+
+// The only line in the loop that writes scalar 'id': -1 if there is none, -2 if several.
+int CStrengthReduction::DefInLoop(int id, int loop) const
+{
+  int found = -1;
+  const std::vector<int> & defs = mScalarDefs[id];
+  for (int i = 0; i < (int) defs.size(); i++) {
+    if (!mCFG->InLoop(mCFG->GetBlockOf(defs[i]), loop)) continue;
+    if (found != -1) return -2;
+    found = defs[i];
+  }
+  return found;
+}
+
+// Is the entry "add id c out" / "add c id out" / "sub id c out" for a constant c?  Sets 'step'.
+static bool IsStep(const ICEntry * entry, int id, int out, int & step)
+{
+  int op = entry->GetOpcode();
+  if ((op != Opcode::ADD && op != Opcode::SUB) || entry->GetArgID(2) != out) return false;
+  const ICOperand var = ICOperand::Scalar(id);
+  const ICOperand & arg0 = entry->GetOperand(0);
+  const ICOperand & arg1 = entry->GetOperand(1);
+  if (arg0 == var && arg1.IsImmediate()) step = arg1.GetValue();
+  else if (op == Opcode::ADD && arg1 == var && arg0.IsImmediate()) step = arg0.GetValue();
+  else return false;
+  if (op == Opcode::SUB) step = -step;
+  return true;
+}
+
+bool CStrengthReduction::FindInduction(ICArray & ica, int id, int loop, CInduction & iv) const
+{
+  int def = DefInLoop(id, loop);
+  if (def < 0) return false;
+  const ICEntry * entry = ica.GetEntry(def);
+  iv.mDefLine = def;
+  iv.mStepLine = def;
+  if (IsStep(entry, id, id, iv.mStep)) return true;
+
+  // "add i c t; ... val_copy t i", both in one block.
+  if (entry->GetOpcode() != Opcode::VAL_COPY || !entry->IsScalarArg(0)) return false;
+  int temp = entry->GetArgID(0);
+  int step = DefInLoop(temp, loop);
+  if (step < 0 || step > def || mCFG->GetBlockOf(step) != mCFG->GetBlockOf(def)) return false;
+  iv.mStepLine = step;
+  return IsStep(ica.GetEntry(step), id, temp, iv.mStep);
+}
+
+// Is the index of the array access on 'line' an induction variable of the loop plus a constant?
+bool CStrengthReduction::FindIndex(ICArray & ica, int line, int loop, int & var, int & offset) const
+{
+  const ICEntry * entry = ica.GetEntry(line);
+  if (!entry->IsScalarArg(1)) return false;
+  int index = entry->GetArgID(1);
+  CInduction iv;
+  if (FindInduction(ica, index, loop, iv)) {
+    var = index;
+    offset = 0;
+    return true;
+  }
+
+  // "add i k x" earlier in the block, with i not written in between.
+  int def = DefInLoop(index, loop);
+  if (def < 0 || def > line || mCFG->GetBlockOf(def) != mCFG->GetBlockOf(line)) return false;
+  const ICEntry * add = ica.GetEntry(def);
+  if (add->GetOpcode() != Opcode::ADD && add->GetOpcode() != Opcode::SUB) return false;
+  int pos = add->IsScalarArg(0) ? 0 : 1;
+  if (!add->IsScalarArg(pos) || add->GetArgID(pos) == index) return false;
+  var = add->GetArgID(pos);
+  if (!IsStep(add, var, index, offset)) return false;
+  if (!FindInduction(ica, var, loop, iv)) return false;
+  return !(iv.mDefLine > def && iv.mDefLine < line && mCFG->GetBlockOf(iv.mDefLine) == mCFG->GetBlockOf(line));
+}
+
+void CStrengthReduction::AddInsertion(ICArray & ica, int line, int op, const ICOperand & arg0,
+                                      const ICOperand & arg1, const ICOperand & arg2)
+{
+  ICEntry * entry = new ICEntry(op, "", &ica);
+  entry->AddArg(arg0);
+  entry->AddArg(arg1);
+  if (!arg2.IsNone()) entry->AddArg(arg2);
+  mInsertions.push_back(std::make_pair(line, entry));
+}
+
+// The pointer to a[var + offset] in the loop, setting it up on first use.
+int CStrengthReduction::GetPointer(ICArray & ica, int loop, int array, int var, int offset)
+{
+  std::vector<int> key;
+  key.push_back(loop);
+  key.push_back(array);
+  key.push_back(var);
+  key.push_back(offset);
+  std::map<std::vector<int>, int>::iterator it = mPointerIDs.find(key);
+  if (it != mPointerIDs.end()) return mPointers[it->second].mScalar;
+
+  CPointer ptr = { loop, array, var, offset, ica.static_memory_size++ };
+  ICOperand scalar = ICOperand::Scalar(ptr.mScalar);
+  int preheader = mCFG->GetLoop(loop).mPreheaderLine;
+  AddInsertion(ica, preheader, Opcode::AR_GET_PTR, ICOperand::Array(array), ICOperand::Scalar(var), scalar);
+  if (offset != 0) AddInsertion(ica, preheader, Opcode::ADD, scalar, ICOperand::Int(offset), scalar);
+  mInitReads[var].push_back(mCFG->GetLoop(loop).mHeader);
+
+  CInduction iv;
+  FindInduction(ica, var, loop, iv);
+  AddInsertion(ica, iv.mDefLine + 1, Opcode::ADD, scalar, ICOperand::Int(iv.mStep), scalar);
+
+  mPointerIDs[key] = mPointers.size();
+  mPointers.push_back(ptr);
+  return ptr.mScalar;
+}
+
+// Can scalar 'id' be read after the loop exits?  Pointers set up in front of a loop read their
+// variable there too; those count as reads at the top of the loop's header.
+bool CStrengthReduction::LiveAtExit(ICArray & ica, int id, int loop) const
+{
+  int num_blocks = mCFG->GetNumBlocks();
+  std::vector<bool> live_in(num_blocks, false), written(num_blocks, false);
+  std::vector<int> worklist;
+  const std::vector<int> & lines = mScalarLines[id];
+  for (int i = 0; i < (int) lines.size(); i++) {
+    const ICEntry * entry = ica.GetEntry(lines[i]);
+    int block = mCFG->GetBlockOf(lines[i]);
+    if (entry->GetDelete()) continue;
+    if (!written[block] && !live_in[block] && entry->ReadsScalar(id)) {
+      live_in[block] = true;
+      worklist.push_back(block);
+    }
+    for (int arg = 0; arg < (int) entry->GetNumArgs(); arg++) {
+      if (Opcode::IsArgWritten(entry->GetOpcode(), arg) && entry->GetArgID(arg) == id) written[block] = true;
+    }
+  }
+  const std::vector<int> & headers = mInitReads[id];
+  for (int i = 0; i < (int) headers.size(); i++) {
+    if (!live_in[headers[i]]) {
+      live_in[headers[i]] = true;
+      worklist.push_back(headers[i]);
+    }
+  }
+
+  while (worklist.size() > 0) {
+    int cur = worklist.back();
+    worklist.pop_back();
+    const std::vector<int> & preds = mCFG->GetBlock(cur).mPreds;
+    for (int p = 0; p < (int) preds.size(); p++) {
+      if (live_in[preds[p]] || written[preds[p]]) continue;
+      live_in[preds[p]] = true;
+      worklist.push_back(preds[p]);
+    }
+  }
+
+  const std::vector<int> & exits = mCFG->GetLoop(loop).mExits;
+  for (int i = 0; i < (int) exits.size(); i++) {
+    if (live_in[exits[i]]) return true;
+  }
+  return false;
+}
+
+// If the pointer's variable is only stepped and compared in the loop, compare the pointer
+// instead and stop stepping the variable.
+void CStrengthReduction::ReplaceTest(ICArray & ica, const CPointer & ptr)
+{
+  CInduction iv;
+  if (!FindInduction(ica, ptr.mVar, ptr.mLoop, iv)) return;
+  const ICOperand var = ICOperand::Scalar(ptr.mVar);
+
+  // Pointers set up in front of a loop nested in this one read the variable there, on lines
+  // that are not in the IC yet.
+  const CLoop & loop = mCFG->GetLoop(ptr.mLoop);
+  const std::vector<int> & headers = mInitReads[ptr.mVar];
+  for (int i = 0; i < (int) headers.size(); i++) {
+    if (headers[i] != loop.mHeader && mCFG->InLoop(headers[i], ptr.mLoop)) return;
+  }
+
+  int test = -1;
+  const std::vector<int> & lines = mScalarLines[ptr.mVar];
+  for (int i = 0; i < (int) lines.size(); i++) {
+    int line = lines[i];
+    const ICEntry * entry = ica.GetEntry(line);
+    if (line == iv.mStepLine || entry->GetDelete() || !entry->ReadsScalar(ptr.mVar)) continue;
+    if (!mCFG->InLoop(mCFG->GetBlockOf(line), ptr.mLoop)) continue;
+    int op = entry->GetOpcode();
+    if (test != -1 || op < Opcode::TEST_LESS || op > Opcode::TEST_GTE) return;
+    const ICOperand & other = entry->GetOperand(entry->GetOperand(0) == var ? 1 : 0);
+    if (other == var) return;
+    if (other.IsScalar() && DefInLoop(other.GetID(), ptr.mLoop) != -1) return;
+    test = line;
+  }
+  if (test == -1 || LiveAtExit(ica, ptr.mVar, ptr.mLoop)) return;
+
+  // The temporary holding the new value must not be needed for anything else either.
+  if (iv.mStepLine != iv.mDefLine) {
+    int temp = ica.GetEntry(iv.mStepLine)->GetArgID(2);
+    const std::vector<int> & temp_lines = mScalarLines[temp];
+    for (int i = 0; i < (int) temp_lines.size(); i++) {
+      const ICEntry * entry = ica.GetEntry(temp_lines[i]);
+      if (temp_lines[i] != iv.mDefLine && !entry->GetDelete() && entry->ReadsScalar(temp)) return;
+    }
+    if (LiveAtExit(ica, temp, ptr.mLoop)) return;
+  }
+
+  // Compare against the address of a[bound + offset], worked out in front of the loop.
+  ICEntry * entry = ica.GetEntry(test);
+  int pos = (entry->GetOperand(0) == var) ? 0 : 1;
+  const ICOperand bound = entry->GetOperand(1 - pos);
+  ICOperand limit = ICOperand::Scalar(ica.static_memory_size++);
+  AddInsertion(ica, loop.mPreheaderLine, Opcode::AR_GET_PTR, ICOperand::Array(ptr.mArray), bound, limit);
+  if (ptr.mOffset != 0) AddInsertion(ica, loop.mPreheaderLine, Opcode::ADD, limit, ICOperand::Int(ptr.mOffset), limit);
+  if (bound.IsScalar()) mInitReads[bound.GetID()].push_back(loop.mHeader);
+  entry->SetOperand(pos, ICOperand::Scalar(ptr.mScalar));
+  entry->SetOperand(1 - pos, limit);
+
+  ica.GetEntry(iv.mStepLine)->SetDelete(true);
+  ica.GetEntry(iv.mDefLine)->SetDelete(true);
+  std::vector<int> & defs = mScalarDefs[ptr.mVar];
+  defs.erase(std::find(defs.begin(), defs.end(), iv.mDefLine));
+}
+
+static bool CompareInsertLine(const std::pair<int, ICEntry *> & in1, const std::pair<int, ICEntry *> & in2)
+{
+  return in1.first < in2.first;
+}
+
+int CStrengthReduction::Run(ICArray & ica)
+{
+  mNumReduced = 0;
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  mCFG = &cfg;
+  if (cfg.GetNumLoops() == 0) return 0;
+
+  int num_lines = ica.GetNumEntries();
+  int num_scalars = 0, num_arrays = 0;
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      const ICOperand & arg = entry->GetOperand(i);
+      if (arg.IsScalar()) num_scalars = std::max(num_scalars, arg.GetID() + 1);
+      if (arg.IsArray()) num_arrays = std::max(num_arrays, arg.GetID() + 1);
+    }
+  }
+  mScalarDefs.assign(num_scalars, std::vector<int>());
+  mScalarLines.assign(num_scalars, std::vector<int>());
+  mInitReads.assign(num_scalars, std::vector<int>());
+  mResizes.assign(num_arrays, std::vector<int>());
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    int op = entry->GetOpcode();
+    if (entry->GetDelete()) continue;
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!entry->IsScalarArg(i)) continue;
+      std::vector<int> & lines = mScalarLines[entry->GetArgID(i)];
+      if (lines.size() == 0 || lines.back() != line) lines.push_back(line);
+      if (Opcode::IsArgWritten(op, i)) mScalarDefs[entry->GetArgID(i)].push_back(line);
+    }
+    if (op == Opcode::AR_SET_SIZE || op == Opcode::AR_PUSH || op == Opcode::AR_POP) {
+      mResizes[entry->GetArgID(0)].push_back(line);
+    }
+    if (op == Opcode::AR_COPY) mResizes[entry->GetArgID(1)].push_back(line);
+  }
+
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    int op = entry->GetOpcode();
+    if (op != Opcode::AR_GET_IDX && op != Opcode::AR_SET_IDX) continue;
+    int array = entry->GetArgID(0);
+    int var = -1, offset = 0, loop = cfg.GetBlock(cfg.GetBlockOf(line)).mLoop;
+
+    // Use the innermost loop the index steps through.  Loops that move the array's elements
+    // are out, and so are the loops around them.
+    for (; loop != -1; loop = cfg.GetLoop(loop).mParent) {
+      bool resized = false;
+      for (int i = 0; i < (int) mResizes[array].size(); i++) {
+        if (cfg.InLoop(cfg.GetBlockOf(mResizes[array][i]), loop)) resized = true;
+      }
+      if (resized) { loop = -1; break; }
+      const CLoop & info = cfg.GetLoop(loop);
+      if (info.mPreheaderLine != -1 && !info.mHasCall && FindIndex(ica, line, loop, var, offset)) break;
+    }
+    if (loop == -1) continue;
+
+    ICOperand ptr = ICOperand::Scalar(GetPointer(ica, loop, array, var, offset));
+    entry->SetInstruction(op == Opcode::AR_GET_IDX ? Opcode::PTR_GET : Opcode::PTR_SET,
+                          ptr, entry->GetOperand(2));
+    mNumReduced++;
+  }
+
+  std::set<std::pair<int, int> > tried;   // (loop, variable) pairs already looked at.
+  for (int i = 0; i < (int) mPointers.size(); i++) {
+    if (!tried.insert(std::make_pair(mPointers[i].mLoop, mPointers[i].mVar)).second) continue;
+    ReplaceTest(ica, mPointers[i]);
+  }
+
+  // Lines set up in front of the same loop stay in the order they were made (a stable sort).
+  std::stable_sort(mInsertions.begin(), mInsertions.end(), CompareInsertLine);
+  ica.InsertEntries(mInsertions);
+  return mNumReduced;
+}
@@ -0,0 +1,81 @@
+#ifndef STRENGTH_REDUCTION_H
+#define STRENGTH_REDUCTION_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CStrengthReduction rewrites array accesses in loops that step through the array, so that each
+//  element's address is carried along in a scalar instead of being rebuilt on every access.
+//
+//  A basic induction variable of a loop is a scalar i written exactly once in it, by
+//  "add i c i" (or "sub i c i"), or by "add i c t; ... val_copy t i" in one block, where c is a
+//  constant.  For each "ar_get_idx a x v" / "ar_set_idx a x v" in the loop whose index x is i,
+//  or is "add i k x" earlier in the same block, the pass
+//    * puts "ar_get_ptr a i p" (and "add p k p") on the loop's preheader edge,
+//    * adds "add p c p" right after the write of i, so p always holds the address of a[i+k],
+//    * and turns the access into "ptr_get p v" / "ptr_set p v".
+//  That drops the load of the array's base and two adds from every access.  The array must not
+//  be resized or copied into inside the loop (its elements could move), and loops that call a
+//  function are left alone.
+//
+//  If i is then read only by its own step and one comparison against a value the loop does not
+//  change (no pointer of a loop nested in this one is set up from it), and is dead once the loop
+//  exits, the comparison is done on p instead, against the address that value would give, and i
+//  is no longer stepped at all.
+//
+//  Multiplications by an induction variable are not reduced: in TubeCode mult costs the same
+//  cycle as add, so there would be nothing to gain.
+//
+
+#include <map>
+#include <vector>
+
+#include "ic.h"
+
+class CControlFlowGraph;
+
+class CStrengthReduction {
+private:
+  // A basic induction variable of a loop.
+  struct CInduction {
+    int mStep;             // Amount added each time it is written.
+    int mDefLine;          // Its only write in the loop.
+    int mStepLine;         // The add (or sub) computing the new value (mDefLine or earlier).
+  };
+
+  // A pointer scalar stepping through a[i + k] in a loop.
+  struct CPointer {
+    int mLoop;
+    int mArray;
+    int mVar;
+    int mOffset;
+    int mScalar;
+  };
+
+  const CControlFlowGraph * mCFG;
+  std::vector<std::vector<int> > mScalarDefs;   // Scalar ID -> lines that write it.
+  std::vector<std::vector<int> > mScalarLines;  // Scalar ID -> lines that use it at all.
+  std::vector<std::vector<int> > mResizes;      // Array ID -> lines that can move its elements.
+  std::vector<std::vector<int> > mInitReads;    // Scalar ID -> headers of loops set up from it.
+  std::vector<CPointer> mPointers;
+  std::map<std::vector<int>, int> mPointerIDs;  // (loop, array, var, offset) -> pointer.
+  std::vector<std::pair<int, ICEntry *> > mInsertions;
+  int mNumReduced;
+
+  int DefInLoop(int id, int loop) const;
+  bool FindInduction(ICArray & ica, int id, int loop, CInduction & iv) const;
+  bool FindIndex(ICArray & ica, int line, int loop, int & var, int & offset) const;
+  int GetPointer(ICArray & ica, int loop, int array, int var, int offset);
+  bool LiveAtExit(ICArray & ica, int id, int loop) const;
+  void ReplaceTest(ICArray & ica, const CPointer & ptr);
+  void AddInsertion(ICArray & ica, int line, int op, const ICOperand & arg0,
+                    const ICOperand & arg1, const ICOperand & arg2);
+
+public:
+  CStrengthReduction() : mCFG(NULL), mNumReduced(0) { ; }
+  ~CStrengthReduction() { ; }
+
+  // Rewrite array accesses in loops to use pointers; returns how many were rewritten.
+  int Run(ICArray & ica);
+};
+
+#endif
@@ -18,6 +18,7 @@
 #include <sstream>
 #include <vector>
 
+#include "arena.h"
 #include "type_info.h"
 
 class ASTNode;
@@ -25,6 +26,7 @@ class CSymbolTable;
 
 class CTableEntry {
   friend class CSymbolTable;
+  friend class CArena;
 protected:
   int mTypeID;       // What is the type of this variable?
   std::string mName;  // Variable name used by sourcecode.
@@ -51,6 +53,7 @@ protected:
     , mNegative(false)
     , mContent("")
   {
+    compile_context.GetParseArena().OnRelease(this);
   }
 
   CTableEntry(int inType, const std::string inName)
@@ -66,10 +69,15 @@ protected:
     , mNegative(false)
     , mContent("")
   {
+    compile_context.GetParseArena().OnRelease(this);
   }
   virtual ~CTableEntry() { ; }
 
 public:
+  // Entries live in the parse arena and are all freed together when it is released.
+  static void * operator new(size_t size) { return compile_context.GetParseArena().Allocate(size); }
+  static void operator delete(void *) { ; }
+
   int GetType()            const { return mTypeID; }
   std::string GetName()    const { return mName; }
   int GetScope()           const { return mScope; }
@@ -98,6 +106,7 @@ public:
 
 class CFunctionEntry {
  friend class CSymbolTable;
+ friend class CArena;
 protected:
   int mReturnType;        // Type of variable that is returned
   std::string mName;      // Function name used by sourcecode.
@@ -128,7 +137,7 @@ protected:
     //, mSize(0)
     //, mIsTemp(true)
     //, mNegative(false)
-    { ; }
+    { compile_context.GetParseArena().OnRelease(this); }
 
   CFunctionEntry(std::string inName, int returnType )
     : mReturnType(returnType)
@@ -142,10 +151,14 @@ protected:
     //, mSize(0)
     //, mIsTemp(false)
     //, mNegative(false)
-    { SetName(inName); }
+    { SetName(inName); compile_context.GetParseArena().OnRelease(this); }
   virtual ~CFunctionEntry() { ; }
 
 public:
+  // Entries live in the parse arena and are all freed together when it is released.
+  static void * operator new(size_t size) { return compile_context.GetParseArena().Allocate(size); }
+  static void operator delete(void *) { ; }
+
   int GetReturnType()      const { return mReturnType; }
   std::string GetName()    const { return mName; }
   std::string GetLabel()    const { return mLabel; }
@@ -207,6 +220,7 @@ private:
   int mCurrentScope;                                // Current mScope level
   int mNextVarID;                                   // Next variable ID to use.
   int mNextLabelID;                                 // Next label ID to use.
+  int mNumEntries;                                  // Entries created (variables, temps, functions).
   std::vector<std::string> mWhileEndStack;  // End labels of active while commands
   bool mFunctionMode;
   ASTNode * mFunctions;
@@ -219,6 +233,7 @@ public:
     : mCurrentScope(0)
     , mNextVarID(1)
     , mNextLabelID(0)
+    , mNumEntries(0)
     , mCurrentFunction(NULL)
     , mFunctionMode(false)
 
@@ -228,12 +243,12 @@ public:
 
   ~CSymbolTable()
   {
-    // Clean up all variable entries
-    while (mCurrentScope >= 0) DecScope();
-    for (int i = 0; i < (int) mVarArchive.size(); i++) delete mVarArchive[i];
+    // The entries themselves are freed with the parse arena; only the scope lists are ours.
+    for (int i = 0; i < (int) mScopeInfo.size(); i++) delete mScopeInfo[i];
   }
 
   int GetSize()     const { return (int) mTableMap.size(); }
+  int GetNumEntries() const { return mNumEntries; }
   int GetCurScope() const { return mCurrentScope; }
   const std::vector<CTableEntry *> & GetScopeVars(int scope)
   {
@@ -293,9 +308,7 @@ public:
   int NextLabelID() { return mNextLabelID++; }
   std::string NextLabelID(std::string prefix)
   {
-    std::stringstream sstm;
-    sstm << prefix << mNextLabelID++;
-    return sstm.str();
+    return prefix + std::to_string(mNextLabelID++);
   }
 
   int GetWhileDepth() { return (int) mWhileEndStack.size(); }
@@ -339,6 +352,7 @@ public:
     // Create the new entry for this variable.
     CTableEntry * newEntry = new CTableEntry(inType, inName);
     newEntry->SetVarID( GetNextID() );
+    mNumEntries++;
     newEntry->SetScope(mCurrentScope);
 
     // If an old entry exists by this name, shadow it.
@@ -365,6 +379,7 @@ public:
   {
     CFunctionEntry * newEntry = new CFunctionEntry(inType);
     newEntry->SetVarID( GetNextID() );
+    mNumEntries++;
     return newEntry;
   }
 
@@ -373,6 +388,7 @@ public:
   {
     CFunctionEntry * newEntry = new CFunctionEntry(name, type);
     newEntry->SetVarID( GetNextID());
+    mNumEntries++;
     mDefinedFunctionMap[name] = newEntry;
     newEntry->SetReturn(AddTempEntry(type));
     newEntry->SetReturnValue(AddTempEntry(type));
@@ -383,6 +399,7 @@ public:
   {
     CFunctionEntry * newEntry = new CFunctionEntry(name,type);
     newEntry->SetVarID( GetNextID());
+    mNumEntries++;
     mDeclaredFunctionMap[name] = newEntry;
     newEntry->SetReturn(AddTempEntry(type));
     newEntry->SetReturnValue(AddTempEntry(type));
@@ -393,6 +410,7 @@ public:
   CTableEntry * AddTempEntry(int inType) {
     CTableEntry * newEntry = new CTableEntry(inType);
     newEntry->SetVarID( GetNextID() );
+    mNumEntries++;
     return newEntry;
   }
 
@@ -402,8 +420,8 @@ public:
   void FreeTempVarID(int id) { (void) id; /* Nothing for now... */ }
 
   void RemoveEntry(CTableEntry * del_var) {
-    // We no longer nead this entry...
-    delete del_var;
+    // We no longer nead this entry; its memory goes back when the parse arena is released.
+    (void) del_var;
   }
 
   std::string CheckFunctions() {
@@ -0,0 +1,249 @@
+#include "tc_peephole.h"
+#include "tube_vm.h"
+
+/******************************************
+ * BEGIN CTCPeephole
+ *****************************************/
+
+const CTCPeephole::CRule CTCPeephole::RULES[] = {
+  // name              opcodes                                one-instruction rule           two-instruction rule
+  { "jump to next",    { ANY_JUMP,          TubeOp::NUM_OPS }, &CTCPeephole::JumpToNext, NULL },
+  { "jump chain",      { ANY_JUMP,          TubeOp::NUM_OPS }, &CTCPeephole::JumpChain,  NULL },
+  { "self copy",       { TubeOp::VAL_COPY,  TubeOp::NUM_OPS }, &CTCPeephole::SelfCopy,   NULL },
+  { "store-load",      { TubeOp::STORE,     TubeOp::LOAD    }, NULL, &CTCPeephole::StoreLoad },
+  { "load-store",      { TubeOp::LOAD,      TubeOp::STORE   }, NULL, &CTCPeephole::LoadStore },
+  { "load-load",       { TubeOp::LOAD,      TubeOp::LOAD    }, NULL, &CTCPeephole::LoadLoad },
+  { "store-store",     { TubeOp::STORE,     TubeOp::STORE   }, NULL, &CTCPeephole::StoreStore },
+  { "copy-store",      { TubeOp::VAL_COPY,  TubeOp::STORE   }, NULL, &CTCPeephole::CopyStore },
+  { "nop",             { TubeOp::NOP,       TubeOp::NUM_OPS }, &CTCPeephole::RemoveNop,  NULL },
+};
+
+const int CTCPeephole::NUM_RULES = sizeof(RULES) / sizeof(RULES[0]);
+
+bool CTCPeephole::IsJump(int op)
+{
+  return op == TubeOp::JUMP || op == TubeOp::JUMP_IF_0 || op == TubeOp::JUMP_IF_N0;
+}
+
+bool CTCPeephole::Matches(int pattern, int op)
+{
+  return (pattern == ANY_JUMP) ? IsJump(op) : pattern == op;
+}
+
+// Find the labels that are followed by nothing but nops, comments and other labels before
+// a jump to a named label, and where each such chain of jumps finally ends up.
+void CTCPeephole::FindRedirects()
+{
+  mRedirect.clear();
+  std::vector<int> pending;   // Labels still waiting for their first instruction.
+  for (int i = 0; i < mCode->GetNumLines(); i++) {
+    const CTCLine & line = Line(i);
+    if (line.mKind == CTCLine::COMMENT) continue;
+    if (line.mKind == CTCLine::LABEL) {
+      pending.push_back(line.mArgs[0].mValue);
+      continue;
+    }
+    if (pending.size() == 0 || line.mOp == TubeOp::NOP) continue;
+    if (line.mOp == TubeOp::JUMP && line.mArgs[0].mKind == CTCArg::NAME) {
+      for (int p = 0; p < (int) pending.size(); p++) mRedirect[pending[p]] = line.mArgs[0].mValue;
+    }
+    pending.clear();
+  }
+
+  // Follow each chain to its end; labels on a loop of jumps are left alone.
+  std::vector<int> loops;
+  std::map<int, int>::iterator it;
+  for (it = mRedirect.begin(); it != mRedirect.end(); it++) {
+    int target = it->second;
+    std::map<int, int>::iterator next;
+    for (int hops = 0; hops <= (int) mRedirect.size(); hops++) {
+      next = mRedirect.find(target);
+      if (next == mRedirect.end()) break;
+      target = next->second;
+    }
+    if (next != mRedirect.end()) loops.push_back(it->first);
+    else it->second = target;
+  }
+  for (int i = 0; i < (int) loops.size(); i++) mRedirect.erase(loops[i]);
+}
+
+// The next instruction that runs straight after 'line', or -1 if a label comes first.
+int CTCPeephole::NextInst(int line)
+{
+  for (int next = line + 1; next < mCode->GetNumLines(); next++) {
+    const CTCLine & cur = Line(next);
+    if (cur.mKind == CTCLine::COMMENT || (cur.mKind == CTCLine::INST && cur.mDelete)) continue;
+    return (cur.mKind == CTCLine::INST) ? next : -1;
+  }
+  return -1;
+}
+
+// Is register 'reg' written after 'line' before anything reads it?  Only looks as far as the
+// next label or jump.
+bool CTCPeephole::IsDeadAfter(int line, int reg)
+{
+  for (int next = line + 1; next < mCode->GetNumLines(); next++) {
+    const CTCLine & cur = Line(next);
+    if (cur.mKind == CTCLine::COMMENT || (cur.mKind == CTCLine::INST && cur.mDelete)) continue;
+    if (cur.mKind != CTCLine::INST || cur.mOp == TubeOp::DEBUG_STATUS) return false;
+    const TubeOp::Info & info = TubeOp::GetInfo(cur.mOp);
+    for (int i = 0; i < info.num_args; i++) {
+      if (info.args[i] == TubeOp::ARG_VALUE && cur.mArgs[i].IsReg(reg)) return false;
+    }
+    for (int i = 0; i < info.num_args; i++) {
+      if (info.args[i] == TubeOp::ARG_REG && cur.mArgs[i].IsReg(reg)) return true;
+    }
+    if (IsJump(cur.mOp)) return false;
+  }
+  return false;
+}
+
+// Try the rules, in table order, on each instruction, starting over on an instruction
+// whenever one fires (which may set up another).
+void CTCPeephole::Run(CTubeCode & code)
+{
+  mCode = &code;
+  mHits.assign(NUM_RULES, 0);
+  mOpRules.assign(TubeOp::NUM_OPS, std::vector<int>());
+  for (int op = 0; op < TubeOp::NUM_OPS; op++) {
+    for (int r = 0; r < NUM_RULES; r++) {
+      if (Matches(RULES[r].mOps[0], op)) mOpRules[op].push_back(r);
+    }
+  }
+  FindRedirects();
+
+  for (int first = 0; first < mCode->GetNumLines(); first++) {
+    if (Line(first).mKind != CTCLine::INST) continue;
+    for (bool changed = true; changed && !Line(first).mDelete; ) {
+      changed = false;
+      const std::vector<int> & rules = mOpRules[Line(first).mOp];
+      for (int i = 0; i < (int) rules.size() && !changed; i++) {
+        const CRule & rule = RULES[rules[i]];
+        if (rule.mApplyOne != NULL) {
+          changed = (this->*rule.mApplyOne)(first);
+        }
+        else {
+          int second = NextInst(first);
+          if (second == -1 || !Matches(rule.mOps[1], Line(second).mOp)) continue;
+          changed = (this->*rule.mApplyTwo)(first, second);
+        }
+        if (changed) mHits[rules[i]]++;
+      }
+    }
+  }
+  mCode = NULL;
+}
+
+/****** Rules ******/
+
+// store X M; load M R  ->  store X M; val_copy X R
+bool CTCPeephole::StoreLoad(int first, int second)
+{
+  const CTCLine & store = Line(first);
+  CTCLine & load = Line(second);
+  if (store.mArgs[1] != load.mArgs[0]) return false;
+  if (store.mArgs[0] == load.mArgs[1]) {
+    load.mDelete = true;
+    return true;
+  }
+  load.mOp = TubeOp::VAL_COPY;
+  load.mArgs[0] = store.mArgs[0];
+  return true;
+}
+
+// load M R; store R M  ->  load M R  (unless M is R, which the load changes)
+bool CTCPeephole::LoadStore(int first, int second)
+{
+  const CTCLine & load = Line(first);
+  CTCLine & store = Line(second);
+  if (load.mArgs[1] != store.mArgs[0] || load.mArgs[0] != store.mArgs[1]) return false;
+  if (load.mArgs[0] == load.mArgs[1]) return false;
+  store.mDelete = true;
+  return true;
+}
+
+// load M R; load M R2  ->  load M R; val_copy R R2  (unless M is R)
+bool CTCPeephole::LoadLoad(int first, int second)
+{
+  const CTCLine & load1 = Line(first);
+  CTCLine & load2 = Line(second);
+  if (load1.mArgs[0] != load2.mArgs[0] || load1.mArgs[0] == load1.mArgs[1]) return false;
+  if (load1.mArgs[1] == load2.mArgs[1]) {
+    load2.mDelete = true;
+    return true;
+  }
+  load2.mOp = TubeOp::VAL_COPY;
+  load2.mArgs[0] = load1.mArgs[1];
+  return true;
+}
+
+// store X M; store Y M  ->  store Y M
+bool CTCPeephole::StoreStore(int first, int second)
+{
+  if (Line(first).mArgs[1] != Line(second).mArgs[1]) return false;
+  Line(first).mDelete = true;
+  return true;
+}
+
+// val_copy X R; store R M  ->  store X M, when nothing reads R again before it is written
+bool CTCPeephole::CopyStore(int first, int second)
+{
+  CTCLine & copy = Line(first);
+  CTCLine & store = Line(second);
+  if (copy.mArgs[1] != store.mArgs[0] || copy.mArgs[1] == store.mArgs[1]) return false;
+  if (!IsDeadAfter(second, copy.mArgs[1].mValue)) return false;
+  store.mArgs[0] = copy.mArgs[0];
+  copy.mDelete = true;
+  return true;
+}
+
+// val_copy R R  ->  nothing
+bool CTCPeephole::SelfCopy(int line)
+{
+  if (Line(line).mArgs[0] != Line(line).mArgs[1]) return false;
+  Line(line).mDelete = true;
+  return true;
+}
+
+// jump L, where L only jumps on to L2  ->  jump L2
+bool CTCPeephole::JumpChain(int line)
+{
+  CTCLine & jump = Line(line);
+  CTCArg & target = jump.mArgs[TubeOp::GetInfo(jump.mOp).num_args - 1];
+  if (target.mKind != CTCArg::NAME || mRedirect.size() == 0) return false;
+  std::map<int, int>::const_iterator it = mRedirect.find(target.mValue);
+  if (it == mRedirect.end()) return false;
+  target.mValue = it->second;
+  return true;
+}
+
+// jump L; (nops and other labels) L:  ->  nothing
+bool CTCPeephole::JumpToNext(int line)
+{
+  const CTCLine & jump = Line(line);
+  const CTCArg & target = jump.mArgs[TubeOp::GetInfo(jump.mOp).num_args - 1];
+  if (target.mKind != CTCArg::NAME) return false;
+  for (int next = line + 1; next < mCode->GetNumLines(); next++) {
+    const CTCLine & cur = Line(next);
+    if (cur.mKind == CTCLine::COMMENT) continue;
+    if (cur.mKind == CTCLine::INST && (cur.mDelete || cur.mOp == TubeOp::NOP)) continue;
+    if (cur.mKind != CTCLine::LABEL) return false;
+    if (cur.mArgs[0] == target) {
+      Line(line).mDelete = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+// nop  ->  nothing, as long as an instruction follows for the labels before it to mark
+bool CTCPeephole::RemoveNop(int line)
+{
+  for (int next = line + 1; next < mCode->GetNumLines(); next++) {
+    const CTCLine & cur = Line(next);
+    if (cur.mKind != CTCLine::INST || cur.mDelete || cur.mOp == TubeOp::NOP) continue;
+    Line(line).mDelete = true;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,81 @@
+#ifndef TC_PEEPHOLE_H
+#define TC_PEEPHOLE_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CTCPeephole cleans up the TubeCode that the fixed templates in ICEntry::PrintTC produce,
+//  after the whole program has been lowered into a CTubeCode and before it is written out.
+//  A table of rules rewrites its lines in place:
+//    * store X M; load M R       ->  store X M; val_copy X R  (or nothing, if X is R)
+//    * load M R; store R M       ->  load M R
+//    * load M R; load M R2       ->  load M R; val_copy R R2  (or nothing, if R2 is R)
+//    * store X M; store Y M      ->  store Y M
+//    * val_copy X R; store R M   ->  store X M, when R is overwritten before it is read again
+//    * val_copy R R              ->  nothing
+//    * a jump to a label that only jumps on goes straight to where that one goes;
+//    * a jump (or conditional jump) to a label it would fall through to anyway goes;
+//    * a nop goes, as long as an instruction comes after it for its labels to mark.
+//  Two-instruction rules only match instructions next to each other (comments aside) with no
+//  label between them.  Addresses match when they are the same number, or the same register.
+//
+//  Run() counts how often each rule fired; GetHits() reports the counts, which ICArray::PrintTC
+//  passes on to the -time-report table (there is no other output).
+//
+
+#include <map>
+#include <vector>
+
+#include "tube_code.h"
+
+class CTCPeephole {
+private:
+  // A rule applies to an instruction with opcode mOps[0] (followed, for two-instruction
+  // rules, by one with mOps[1]) and returns whether it changed anything.  Exactly one of
+  // mApplyOne and mApplyTwo is set.
+  struct CRule {
+    const char * mName;
+    int mOps[2];
+    bool (CTCPeephole::*mApplyOne)(int line);
+    bool (CTCPeephole::*mApplyTwo)(int first, int second);
+  };
+
+  static const int ANY_JUMP = -1;          // In CRule::mOps: jump, jump_if_0 or jump_if_n0.
+  static const CRule RULES[];
+  static const int NUM_RULES;
+
+  CTubeCode * mCode;
+  std::map<int, int> mRedirect;  // Label ID -> label it jumps straight on to.
+  std::vector<long> mHits;       // Rule -> times it fired.
+  std::vector<std::vector<int> > mOpRules;  // TubeOp -> rules that start with it.
+
+  static bool IsJump(int op);
+  static bool Matches(int pattern, int op);
+
+  CTCLine & Line(int line) { return mCode->GetLine(line); }
+  void FindRedirects();
+  int NextInst(int line);
+  bool IsDeadAfter(int line, int reg);
+
+  bool StoreLoad(int first, int second);
+  bool LoadStore(int first, int second);
+  bool LoadLoad(int first, int second);
+  bool StoreStore(int first, int second);
+  bool CopyStore(int first, int second);
+  bool SelfCopy(int line);
+  bool JumpChain(int line);
+  bool JumpToNext(int line);
+  bool RemoveNop(int line);
+
+public:
+  CTCPeephole() : mCode(NULL) { ; }
+  ~CTCPeephole() { ; }
+
+  // Rewrite the lines of 'code' in place.
+  void Run(CTubeCode & code);
+
+  int GetNumRules() const { return NUM_RULES; }
+  const char * GetRuleName(int rule) const { return RULES[rule].mName; }
+  long GetHits(int rule) const { return mHits[rule]; }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "time_report.h"
+#include "arena.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <sys/resource.h>
+
+CTimeReport time_report;
+
+// Count every heap allocation the compiler makes, and the bytes in use, by routing operator
+// new and delete through here.
+static long num_heap_allocs = 0;
+static long heap_bytes = 0;
+static long peak_heap_bytes = 0;
+
+void * operator new(size_t size)
+{
+  num_heap_allocs++;
+  void * mem = malloc(size ? size : 1);
+  if (mem == NULL) throw std::bad_alloc();
+  heap_bytes += malloc_usable_size(mem);
+  if (heap_bytes > peak_heap_bytes) peak_heap_bytes = heap_bytes;
+  return mem;
+}
+
+void operator delete(void * mem) noexcept
+{
+  if (mem != NULL) heap_bytes -= malloc_usable_size(mem);
+  free(mem);
+}
+
+void operator delete(void * mem, size_t) noexcept { operator delete(mem); }
+
+/******************************************
+ * BEGIN CTimeReport
+ *****************************************/
+
+long CTimeReport::GetHeapAllocs()
+{
+  return num_heap_allocs;
+}
+
+long CTimeReport::GetPeakHeap()
+{
+  return peak_heap_bytes / 1024;
+}
+
+long CTimeReport::GetPeakRSS()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void CTimeReport::BeginPhase(const std::string & name)
+{
+  EndPhase();
+  mRunning = true;
+  mCurName = name;
+  mCurHeapAllocs = GetHeapAllocs();
+  mCurArenaAllocs = CArena::GetTotalAllocs();
+  mCurStart = std::chrono::steady_clock::now();
+}
+
+void CTimeReport::EndPhase()
+{
+  if (!mRunning) return;
+  Phase phase;
+  phase.mName = mCurName;
+  phase.mSeconds =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - mCurStart).count();
+  phase.mHeapAllocs = GetHeapAllocs() - mCurHeapAllocs;
+  phase.mArenaAllocs = CArena::GetTotalAllocs() - mCurArenaAllocs;
+  phase.mPeakHeap = GetPeakHeap();
+  phase.mPeakRSS = GetPeakRSS();
+  mPhases.push_back(phase);
+  mRunning = false;
+}
+
+void CTimeReport::SetCount(const std::string & name, long value)
+{
+  for (int i = 0; i < (int) mCounts.size(); i++) {
+    if (mCounts[i].first == name) { mCounts[i].second = value; return; }
+  }
+  mCounts.push_back(std::make_pair(name, value));
+}
+
+void CTimeReport::Print(std::ostream & os) const
+{
+  char line[160];
+  snprintf(line, sizeof(line), "%-28s %10s %12s %12s %14s %14s\n",
+           "phase", "wall ms", "heap allocs", "arena allocs", "peak heap KB", "peak RSS KB");
+  os << line;
+
+  double total_seconds = 0.0;
+  long total_heap = 0, total_arena = 0, peak_heap = 0, peak_rss = 0;
+  for (int i = 0; i < (int) mPhases.size(); i++) {
+    const Phase & phase = mPhases[i];
+    snprintf(line, sizeof(line), "%-28s %10.2f %12ld %12ld %14ld %14ld\n", phase.mName.c_str(),
+             phase.mSeconds * 1000.0, phase.mHeapAllocs, phase.mArenaAllocs, phase.mPeakHeap,
+             phase.mPeakRSS);
+    os << line;
+    total_seconds += phase.mSeconds;
+    total_heap += phase.mHeapAllocs;
+    total_arena += phase.mArenaAllocs;
+    if (phase.mPeakHeap > peak_heap) peak_heap = phase.mPeakHeap;
+    if (phase.mPeakRSS > peak_rss) peak_rss = phase.mPeakRSS;
+  }
+  snprintf(line, sizeof(line), "%-28s %10.2f %12ld %12ld %14ld %14ld\n", "total",
+           total_seconds * 1000.0, total_heap, total_arena, peak_heap, peak_rss);
+  os << line;
+
+  for (int i = 0; i < (int) mCounts.size(); i++) {
+    snprintf(line, sizeof(line), "%-28s %10ld\n", mCounts[i].first.c_str(), mCounts[i].second);
+    os << line;
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CTimeReport records where a compile spends its time and memory (the -time-report flag).
+//
+//  The compiler is split into a flat sequence of phases; BeginPhase() closes the phase that is
+//  running (if any) and opens a new one.  For each phase it keeps:
+//    * the wall-clock time spent in it,
+//    * how many heap allocations (global operator new) and arena allocations it made, and
+//    * the peak heap in use (operator new bytes, arena chunks included) and the peak resident
+//      set size of the process when it ended.
+//  Named counts (AST nodes, IC entries, ...) can be attached with SetCount().
+//
+//  Phases are always recorded (it only costs a clock read and a getrusage() per phase); the
+//  report is only printed when -time-report is given.
+//
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class CTimeReport {
+private:
+  struct Phase {
+    std::string mName;
+    double mSeconds;
+    long mHeapAllocs;
+    long mArenaAllocs;
+    long mPeakHeap;           // In KB.
+    long mPeakRSS;            // In KB.
+  };
+
+  std::vector<Phase> mPhases;
+  std::vector<std::pair<std::string, long> > mCounts;
+  bool mRunning;
+  std::string mCurName;
+  std::chrono::steady_clock::time_point mCurStart;
+  long mCurHeapAllocs;
+  long mCurArenaAllocs;
+
+public:
+  CTimeReport() : mRunning(false), mCurHeapAllocs(0), mCurArenaAllocs(0) { ; }
+  ~CTimeReport() { ; }
+
+  void BeginPhase(const std::string & name);
+  void EndPhase();
+  void SetCount(const std::string & name, long value);
+
+  void Print(std::ostream & os) const;
+
+  static long GetHeapAllocs();    // Calls to operator new since the program started.
+  static long GetPeakHeap();      // Most bytes ever held through operator new, in KB.
+  static long GetPeakRSS();       // Peak resident set size so far, in KB.
+};
+
+extern CTimeReport time_report;
+
+#endif
@@ -2,11 +2,15 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <stdio.h>
 
 #include "symbol_table.h"
 #include "ast.h"
 #include "type_info.h"
+#include "reg_alloc.h"
+#include "time_report.h"
+#include "ic_interp.h"
 
 #define YYDEBUG 1
 
@@ -15,6 +19,10 @@ extern int yylex();
 extern std::string out_filename;
 extern bool debug;
 extern bool ICmode;
+extern bool O2mode;
+extern bool TimeReportMode;
+extern bool RunICMode;
+extern bool CheckICMode;
 CSymbolTable symbol_table;
 int error_count = 0;
 
@@ -67,13 +75,11 @@ function_declare_name
 %%
 
 program:      statement_list {
+                 time_report.BeginPhase("AST -> IC");
                  ICArray ic_array;             // Array to contain the IC
                  $1->CompileTubeIC(symbol_table, ic_array); //Fill IC array
                  std::ofstream out_file(out_filename.c_str());  // Open the output file
 
-                 //ic_array.PrintIC(out_file);
-                 ic_array.OptimizeIC();
-                 //std::cout << "statement_list" << std::endl;
                  ic_array.static_memory_size = symbol_table.GetTempVarID();
                  std::string function = symbol_table.CheckFunctions();
                  if(function != "")
@@ -83,11 +89,63 @@ program:      statement_list {
                     yyerror(errString);
                     exit(1);
                  }
+                 time_report.SetCount("AST nodes", ASTNode::GetNumNodes());
+                 time_report.SetCount("symbol table entries", symbol_table.GetNumEntries());
+                 time_report.SetCount("IC entries before optimize", ic_array.GetNumEntries());
+                 compile_context.EndParse();   // The AST and symbol table entries are done with.
+
+                 // With -check-ic, run the IC before and after optimizing it; the output must match.
+                 const long check_limit = 100000000;
+                 CICInterpreter * check_before = NULL;
+                 std::stringstream check_before_out;
+                 if (CheckICMode) {
+                   check_before = new CICInterpreter(ic_array);
+                   check_before->Run(check_before_out, check_limit);
+                 }
+
+                 //ic_array.PrintIC(out_file);
+                 ic_array.OptimizeIC(O2mode);
+                 time_report.SetCount("IC entries after optimize", ic_array.GetNumEntries());
+                 time_report.SetCount("static memory size", ic_array.static_memory_size);
+
+                 if (CheckICMode) {
+                   time_report.BeginPhase("check IC");
+                   CICInterpreter check_after(ic_array);
+                   std::stringstream check_after_out;
+                   check_after.Run(check_after_out, check_limit);
+                   CICInterpreter::PrintComparison(*check_before, check_after, std::cerr);
+                   if (check_before_out.str() != check_after_out.str()) {
+                     std::cerr << "INTERNAL ERROR: Optimized IC gives different output." << std::endl
+                               << "Before:" << std::endl << check_before_out.str() << std::endl
+                               << "After:" << std::endl << check_after_out.str() << std::endl;
+                     exit(1);
+                   }
+                   delete check_before;
+                 }
+                 if (RunICMode) {
+                   time_report.BeginPhase("run IC");
+                   CICInterpreter interpreter(ic_array);
+                   interpreter.Run(std::cout);
+                   interpreter.PrintOpCounts(std::cerr);
+                 }
+                 //std::cout << "statement_list" << std::endl;
                  if (ICmode) {
+                   time_report.BeginPhase("emit IC");
                    ic_array.PrintIC(out_file);                  // Write IC to output file!
                  } else {
+                   time_report.BeginPhase("optimize: strength reduction");
+                   ic_array.ReduceStrength();
+                   time_report.BeginPhase("register allocation");
+                   CRegAllocator * allocator;
+                   if (O2mode) allocator = new CGraphColorAllocator;
+                   else allocator = new CLinearScanAllocator;
+                   allocator->Allocate(ic_array);         // Keep hot scalars in registers.
+                   delete allocator;
+                   time_report.BeginPhase("emit TubeCode");
                    ic_array.PrintTC(out_file);            // Write Tubecode Assembly to output file!
                  }
+                 compile_context.EndIC();
+                 time_report.EndPhase();
 
               }
        ;
@@ -526,7 +584,6 @@ command:   COMMAND_PRINT argument_list {
              $$ = new ASTNodePrint(NULL);
              $$->TransferChildren($2);
              $$->SetLineNum(line_num);
-             delete $2;
            }
         |  COMMAND_BREAK {
              $$ = new ASTNodeBreak();
@@ -645,9 +702,11 @@ function_define:
                | function_define_name function_arguments command ';' {
                   CFunctionEntry * function= symbol_table.GetCurrentFunction();
                   function->SetBody($3);
+                  function->SetDefined(true);
                   symbol_table.DecScope();
 
                   $$ = new ASTNodeFunction(function, $3);
+                  $$->TransferChildren($2);
                   $$->SetLineNum(line_num);
 }
 
@@ -787,7 +846,9 @@ int main(int argc, char * argv[])
   error_count = 0;
   LexMain(argc, argv);
 
+  time_report.BeginPhase("parse");
   yyparse();
+  if (TimeReportMode) time_report.Print(std::cerr);
 
   if (error_count == 0) std::cout << "Parse Successful!" << std::endl;
 
@@ -0,0 +1,95 @@
+#include "tube_code.h"
+#include "ic.h"
+#include "tube_vm.h"
+
+#include <cstring>
+
+/******************************************
+ * BEGIN CTCArg
+ *****************************************/
+
+CTCArg CTCArg::Name(const std::string & label)
+{
+  return Name(ICOperand::InternLabel(label));
+}
+
+void CTCArg::Emit(CEmitter & out) const
+{
+  switch (mKind) {
+  case REG:    out << "reg" << (char) ('A' + mValue); break;
+  case NUMBER: out << mValue; break;
+  case CHAR:   ICOperand(ICOperand::CHAR, mValue).Emit(out); break;
+  case NAME:   out << ICOperand::GetLabelName(mValue); break;
+  }
+}
+
+/******************************************
+ * BEGIN CTubeCode
+ *****************************************/
+
+namespace {
+  const size_t WRITE_SIZE = 1 << 20;   // Bytes of text collected between writes.
+}
+
+void CTubeCode::AddInst(int op, const CTCArg & arg0, const CTCArg & arg1, const CTCArg & arg2)
+{
+  CTCLine line;
+  line.mKind = CTCLine::INST;
+  line.mOp = op;
+  line.mDelete = false;
+  line.mArgs[0] = arg0;
+  line.mArgs[1] = arg1;
+  line.mArgs[2] = arg2;
+  mLines.push_back(line);
+}
+
+void CTubeCode::AddLabel(const CTCArg & name)
+{
+  CTCLine line;
+  line.mKind = CTCLine::LABEL;
+  line.mOp = TubeOp::NUM_OPS;
+  line.mDelete = false;
+  line.mArgs[0] = name;
+  mLines.push_back(line);
+}
+
+CEmitter & CTubeCode::AddComment()
+{
+  CTCLine line;
+  line.mKind = CTCLine::COMMENT;
+  line.mOp = TubeOp::NUM_OPS;
+  line.mDelete = false;
+  line.mArgs[0] = CTCArg::Number(mComments.GetSize());
+  mLines.push_back(line);
+  return mComments;
+}
+
+void CTubeCode::Write(std::ostream & ofs) const
+{
+  CEmitter out;
+  const char * comments = mComments.GetText().data();
+  for (int i = 0; i < (int) mLines.size(); i++) {
+    const CTCLine & line = mLines[i];
+    if (line.mDelete) continue;
+    if (line.mKind == CTCLine::LABEL) {
+      line.mArgs[0].Emit(out);
+      out << ":\n";
+    }
+    else if (line.mKind == CTCLine::COMMENT) {
+      const char * text = comments + line.mArgs[0].mValue;
+      out << "# ";
+      out.Append(text, strchr(text, '\n') - text + 1);
+    }
+    else {
+      const TubeOp::Info & info = TubeOp::GetInfo(line.mOp);
+      out << "  " << info.name;
+      for (int arg = 0; arg < info.num_args; arg++) {
+        out << ' ';
+        line.mArgs[arg].Emit(out);
+      }
+      out << '\n';
+    }
+    if (out.GetSize() >= WRITE_SIZE) out.WriteTo(ofs);
+  }
+  out.WriteTo(ofs);
+}
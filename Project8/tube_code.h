@@ -0,0 +1,75 @@
+#ifndef TUBE_CODE_H
+#define TUBE_CODE_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CTubeCode holds a TubeCode program as a list of decoded lines, between ICEntry::PrintTC(),
+//  which appends the lines for each IC instruction, and Write(), which turns them into text.
+//  In between, CTCPeephole rewrites the lines in place.
+//
+//  A CTCLine is an instruction (a TubeOp plus up to three CTCArgs), a label, or a comment.
+//  A CTCArg is 8 bytes, like an ICOperand: a register, a number, a char, or a label (by its
+//  ID in ICOperand's table of interned label names), so arguments compare as plain integers.
+//  Comment text is kept in one shared buffer, each comment ending with a newline.
+//
+
+#include <deque>
+#include <ostream>
+#include <string>
+
+#include "emitter.h"
+
+struct CTCArg {
+  enum Kind { NONE=0, REG, NUMBER, CHAR, NAME };
+  int mKind;
+  int mValue;                // Register (0 for regA), number, char code, or label ID.
+
+  CTCArg() : mKind(NONE), mValue(0) { ; }
+  CTCArg(int kind, int value) : mKind(kind), mValue(value) { ; }
+
+  static CTCArg Reg(char reg) { return CTCArg(REG, reg - 'A'); }
+  static CTCArg Number(int value) { return CTCArg(NUMBER, value); }
+  static CTCArg Char(int value) { return CTCArg(CHAR, value); }
+  static CTCArg Name(int label_id) { return CTCArg(NAME, label_id); }
+  static CTCArg Name(const std::string & label);
+
+  bool IsReg(int reg) const { return mKind == REG && mValue == reg; }
+  bool operator==(const CTCArg & other) const { return mKind == other.mKind && mValue == other.mValue; }
+  bool operator!=(const CTCArg & other) const { return !(*this == other); }
+
+  void Emit(CEmitter & out) const;
+};
+
+struct CTCLine {
+  enum Kind { INST=0, LABEL, COMMENT };
+  unsigned char mKind;
+  unsigned char mOp;         // TubeOp::TubeOpNames (INST only).
+  bool mDelete;
+  CTCArg mArgs[3];           // For a LABEL, mArgs[0] is its name; for a COMMENT, mArgs[0] is
+                             // where its text starts in the comment buffer.
+};
+
+class CTubeCode {
+private:
+  std::deque<CTCLine> mLines;     // A deque grows without copying (or doubling) the lines.
+  CEmitter mComments;
+
+public:
+  CTubeCode() : mComments(1 << 16) { ; }
+  ~CTubeCode() { ; }
+
+  int GetNumLines() const { return mLines.size(); }
+  CTCLine & GetLine(int line) { return mLines[line]; }
+  const CTCLine & GetLine(int line) const { return mLines[line]; }
+
+  void AddInst(int op, const CTCArg & arg0 = CTCArg(), const CTCArg & arg1 = CTCArg(),
+               const CTCArg & arg2 = CTCArg());
+  void AddLabel(const CTCArg & name);
+  // Start a comment line; the caller writes its text (without the '#') and a newline.
+  CEmitter & AddComment();
+
+  // Write out the lines that have not been deleted, a piece at a time.
+  void Write(std::ostream & ofs) const;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TUBE_RANDOM_H
+#define TUBE_RANDOM_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CTubeRandom produces the same sequence as glibc's rand() (the additive feedback generator
+//  with the default TYPE_3 state), which is what the reference tubecode and TubeIC use for
+//  the random instruction.  Seeding with 1 matches a program that never called srand(), so
+//  "Next() % n" here gives the same values as the reference does.
+//
+
+class CTubeRandom {
+private:
+  int mState[31];
+  int mFront;
+  int mRear;
+
+public:
+  CTubeRandom(unsigned int seed = 1) { Seed(seed); }
+  ~CTubeRandom() { ; }
+
+  void Seed(unsigned int seed) {
+    if (seed == 0) seed = 1;
+    mState[0] = seed;
+    long word = seed;
+    for (int i = 1; i < 31; i++) {
+      long hi = word / 127773;
+      long lo = word % 127773;
+      word = 16807 * lo - 2836 * hi;
+      if (word < 0) word += 2147483647;
+      mState[i] = word;
+    }
+    mFront = 3;
+    mRear = 0;
+    for (int i = 0; i < 310; i++) Next();
+  }
+
+  // A value in [0, 2^31).
+  int Next() {
+    unsigned int sum = (unsigned int) mState[mFront] + (unsigned int) mState[mRear];
+    mState[mFront] = sum;
+    if (++mFront >= 31) mFront = 0;
+    if (++mRear >= 31) mRear = 0;
+    return sum >> 1;
+  }
+};
+
+#endif
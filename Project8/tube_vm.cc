@@ -0,0 +1,454 @@
+#include "tube_vm.h"
+#include "emitter.h"
+
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// Computed goto is a GNU extension; everything else falls back to a switch.
+#if defined(__GNUC__)
+#define TUBE_VM_THREADED 1
+#else
+#define TUBE_VM_THREADED 0
+#endif
+
+namespace TubeOp {
+  static const Info INFO_TABLE[NUM_OPS] = {
+    // name            #  arg kinds                               cycles
+    { "val_copy",      2, { ARG_VALUE, ARG_REG,   ARG_NONE  },   1 },
+    { "add",           3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "sub",           3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "mult",          3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "div",           3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "mod",           3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "test_less",     3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "test_gtr",      3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "test_equ",      3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "test_nequ",     3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "test_gte",      3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "test_lte",      3, { ARG_VALUE, ARG_VALUE, ARG_REG   },   1 },
+    { "jump",          1, { ARG_VALUE, ARG_NONE,  ARG_NONE  },   1 },
+    { "jump_if_0",     2, { ARG_VALUE, ARG_VALUE, ARG_NONE  },   1 },
+    { "jump_if_n0",    2, { ARG_VALUE, ARG_VALUE, ARG_NONE  },   1 },
+    { "nop",           0, { ARG_NONE,  ARG_NONE,  ARG_NONE  },   0 },
+    { "random",        2, { ARG_VALUE, ARG_REG,   ARG_NONE  },   1 },
+    { "out_int",       1, { ARG_VALUE, ARG_NONE,  ARG_NONE  },   1 },
+    { "out_float",     1, { ARG_VALUE, ARG_NONE,  ARG_NONE  },   1 },
+    { "out_char",      1, { ARG_VALUE, ARG_NONE,  ARG_NONE  },   1 },
+    { "load",          2, { ARG_VALUE, ARG_REG,   ARG_NONE  }, 100 },
+    { "store",         2, { ARG_VALUE, ARG_VALUE, ARG_NONE  }, 100 },
+    { "mem_copy",      2, { ARG_VALUE, ARG_VALUE, ARG_NONE  }, 100 },
+    { "debug_status",  0, { ARG_NONE,  ARG_NONE,  ARG_NONE  },   0 },
+    { "",              0, { ARG_NONE,  ARG_NONE,  ARG_NONE  },   0 },
+  };
+
+  const Info & GetInfo(int op) { return INFO_TABLE[op]; }
+
+  int FromString(const std::string & name) {
+    for (int op = 0; op < HALT; op++) {
+      if (name == INFO_TABLE[op].name) return op;
+    }
+    return NUM_OPS;
+  }
+};
+
+/******************************************
+ * BEGIN Loading
+ *****************************************/
+
+namespace {
+  // A single token of an assembly line.
+  struct CTubeToken {
+    enum Kind { NAME, NUMBER, CHAR, COLON };
+    int mKind;
+    std::string mText;
+    int mValue;
+  };
+
+  // Split one line into tokens, stopping at a comment.  Returns "" or an error message.
+  std::string Tokenize(const std::string & line, std::vector<CTubeToken> & tokens)
+  {
+    int pos = 0, size = line.size();
+    while (pos < size) {
+      char c = line[pos];
+      if (isspace(c)) { pos++; continue; }
+      if (c == '#') break;
+
+      CTubeToken token;
+      int start = pos;
+      if (c == ':') {
+        token.mKind = CTubeToken::COLON;
+        pos++;
+      }
+      else if (c == '\'') {
+        // 'x' or one of the escapes '\n', '\t', '\'', '\\', '\"', '\0'.
+        token.mKind = CTubeToken::CHAR;
+        if (pos + 2 < size && line[pos+1] != '\\' && line[pos+2] == '\'') {
+          token.mValue = line[pos+1];
+          pos += 3;
+        }
+        else if (pos + 3 < size && line[pos+1] == '\\' && line[pos+3] == '\'') {
+          switch (line[pos+2]) {
+          case 'n': token.mValue = '\n'; break;
+          case 't': token.mValue = '\t'; break;
+          case '0': token.mValue = '\0'; break;
+          case '\'': case '\\': case '"': token.mValue = line[pos+2]; break;
+          default: return "Unknown escape in char literal.";
+          }
+          pos += 4;
+        }
+        else return "Unknown Token '''.";
+      }
+      else if (isdigit(c) || (c == '-' && pos + 1 < size && isdigit(line[pos+1]))) {
+        token.mKind = CTubeToken::NUMBER;
+        pos++;
+        while (pos < size && isdigit(line[pos])) pos++;
+        // Out-of-range numbers wrap to 32 bits, as they do in the reference.
+        token.mValue = (int) (unsigned int) strtoll(line.c_str() + start, NULL, 10);
+      }
+      else if (isalpha(c) || c == '_') {
+        token.mKind = CTubeToken::NAME;
+        while (pos < size && (isalnum(line[pos]) || line[pos] == '_')) pos++;
+      }
+      else return std::string("Unknown Token '") + c + "'.";
+
+      token.mText = line.substr(start, pos - start);
+      tokens.push_back(token);
+    }
+    return "";
+  }
+}
+
+bool CTubeVM::LoadError(int line_num, const std::string & msg)
+{
+  std::stringstream error;
+  error << "ERROR(line " << line_num << "): " << msg;
+  mError = error.str();
+  mCode.clear();
+  mText.clear();
+  mSlots.clear();
+  return false;
+}
+
+bool CTubeVM::Load(const std::string & text)
+{
+  mCode.clear();
+  mText.clear();
+  mSlots.assign(NUM_REGS, -1);
+  mError = "";
+
+  std::map<int, int> const_slots;                              // Number -> value-file slot.
+  std::map<std::string, int> label_slots;                      // Label -> value-file slot.
+  std::map<std::string, int> label_ids;                        // Label -> instruction index.
+  std::map<std::string, int> label_lines;                      // Label -> first line using it.
+
+  int line_num = 0;
+  size_t line_start = 0;
+  while (line_start < text.size()) {
+    size_t line_end = text.find('\n', line_start);
+    if (line_end == std::string::npos) line_end = text.size();
+    std::string line = text.substr(line_start, line_end - line_start);
+    line_start = line_end + 1;
+    line_num++;
+
+    std::vector<CTubeToken> tokens;
+    std::string error = Tokenize(line, tokens);
+    if (error != "") return LoadError(line_num, error);
+    if (tokens.size() == 0) continue;
+
+    // An optional label comes first.
+    int cur = 0;
+    if (tokens.size() >= 2 && tokens[0].mKind == CTubeToken::NAME &&
+        tokens[1].mKind == CTubeToken::COLON) {
+      if (label_ids.find(tokens[0].mText) != label_ids.end()) {
+        return LoadError(line_num, "label '" + tokens[0].mText + "' defined twice.");
+      }
+      label_ids[tokens[0].mText] = mCode.size();
+      cur = 2;
+    }
+    if (cur == (int) tokens.size()) continue;
+
+    if (tokens[cur].mKind != CTubeToken::NAME) return LoadError(line_num, "syntax error");
+    int op = TubeOp::FromString(tokens[cur].mText);
+    if (op == TubeOp::NUM_OPS) {
+      return LoadError(line_num, "Unknown instruction '" + tokens[cur].mText + "'.");
+    }
+    const TubeOp::Info & info = TubeOp::GetInfo(op);
+    if ((int) tokens.size() - cur - 1 != info.num_args) {
+      return LoadError(line_num, std::string("instruction '") + info.name + "' needs " +
+                       std::to_string(info.num_args) + " arguments.");
+    }
+
+    CTubeInst inst;
+    inst.mHandler = NULL;
+    inst.mOp = op;
+    inst.mCycles = info.cycles;
+    inst.mLineNum = line_num;
+    inst.mCount = 0;
+    inst.mArg[0] = inst.mArg[1] = inst.mArg[2] = 0;
+
+    for (int i = 0; i < info.num_args; i++) {
+      const CTubeToken & token = tokens[cur + 1 + i];
+      bool is_reg = token.mKind == CTubeToken::NAME && token.mText.size() == 4 &&
+                    token.mText.compare(0, 3, "reg") == 0;
+      if (is_reg) {
+        int reg = token.mText[3] - 'A';
+        if (reg < 0 || reg >= NUM_REGS) {
+          return LoadError(line_num, token.mText + " is not a legal register; only 8 registers available.");
+        }
+        inst.mArg[i] = reg;
+      }
+      else if (info.args[i] == TubeOp::ARG_REG) {
+        return LoadError(line_num, std::string("argument ") + std::to_string(i + 1) + " of '" +
+                         info.name + "' must be a register.");
+      }
+      else if (token.mKind == CTubeToken::COLON) {
+        return LoadError(line_num, "syntax error");
+      }
+      else if (token.mKind == CTubeToken::NAME) {
+        // Labels get their slot now and their value once every label is known.
+        if (label_slots.find(token.mText) == label_slots.end()) {
+          label_slots[token.mText] = mSlots.size();
+          label_lines[token.mText] = line_num;
+          mSlots.push_back(0);
+        }
+        inst.mArg[i] = label_slots[token.mText];
+      }
+      else if (op == TubeOp::OUT_FLOAT) {
+        // The reference reads an out_float literal as a float rather than as raw bits.
+        float value = token.mValue;
+        inst.mArg[i] = mSlots.size();
+        mSlots.push_back(0);
+        memcpy(&mSlots.back(), &value, sizeof(value));
+      }
+      else {
+        if (const_slots.find(token.mValue) == const_slots.end()) {
+          const_slots[token.mValue] = mSlots.size();
+          mSlots.push_back(token.mValue);
+        }
+        inst.mArg[i] = const_slots[token.mValue];
+      }
+    }
+
+    mCode.push_back(inst);
+    mText.push_back(line.substr(0, line.find('#')));
+  }
+
+  // Resolve labels to instruction indices.
+  std::map<std::string, int>::iterator it;
+  for (it = label_slots.begin(); it != label_slots.end(); it++) {
+    if (label_ids.find(it->first) == label_ids.end()) {
+      return LoadError(label_lines[it->first], "Unknown label '" + it->first + "'.");
+    }
+    mSlots[it->second] = label_ids[it->first];
+  }
+
+  // End with a HALT for the program to fall into.
+  CTubeInst halt;
+  halt.mHandler = NULL;
+  halt.mArg[0] = halt.mArg[1] = halt.mArg[2] = 0;
+  halt.mOp = TubeOp::HALT;
+  halt.mCycles = 0;
+  halt.mLineNum = line_num + 1;
+  halt.mCount = 0;
+  mCode.push_back(halt);
+  mText.push_back("");
+  return true;
+}
+
+bool CTubeVM::LoadFile(const std::string & filename)
+{
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  if (!ifs) {
+    mError = "ERROR: Unable to open file '" + filename + "'.";
+    return false;
+  }
+  std::stringstream text;
+  text << ifs.rdbuf();
+  return Load(text.str());
+}
+
+/******************************************
+ * BEGIN Execution
+ *****************************************/
+
+CTubeVM::RunStatus CTubeVM::Run(std::ostream & os, long cycle_limit)
+{
+  if (mCode.size() == 0) return RUN_ERROR;
+  for (int i = 0; i < NUM_REGS; i++) mSlots[i] = -1;
+  mMemory.assign(MEMORY_SIZE, 0);
+  mRandom.Seed(1);
+  mCycles = 0;
+  mNumExecuted = 0;
+  for (int id = 0; id < (int) mCode.size(); id++) mCode[id].mCount = 0;
+
+  CEmitter out(1 << 16);
+  const unsigned int num_insts = mCode.size() - 1;
+  CTubeInst * const code = &mCode[0];
+  CTubeInst * const halt = code + num_insts;
+  CTubeInst * ip = code;
+  int * const slots = &mSlots[0];
+  int * const memory = &mMemory[0];
+  long cycles = 0;
+  const long limit = (cycle_limit > 0) ? cycle_limit : LONG_MAX;
+  RunStatus status = RUN_DONE;
+  unsigned int address = 0;
+
+#if TUBE_VM_THREADED
+  // Must list the handlers in TubeOp order.
+  static const void * const handlers[TubeOp::NUM_OPS] = {
+    &&op_VAL_COPY, &&op_ADD, &&op_SUB, &&op_MULT, &&op_DIV, &&op_MOD,
+    &&op_TEST_LESS, &&op_TEST_GTR, &&op_TEST_EQU, &&op_TEST_NEQU, &&op_TEST_GTE, &&op_TEST_LTE,
+    &&op_JUMP, &&op_JUMP_IF_0, &&op_JUMP_IF_N0,
+    &&op_NOP, &&op_RANDOM, &&op_OUT_INT, &&op_OUT_FLOAT, &&op_OUT_CHAR,
+    &&op_LOAD, &&op_STORE, &&op_MEM_COPY, &&op_DEBUG_STATUS,
+    &&op_HALT,
+  };
+  for (unsigned int id = 0; id <= num_insts; id++) code[id].mHandler = handlers[code[id].mOp];
+#define VM_OP(name) op_##name:
+#define VM_DISPATCH() goto *ip->mHandler
+#else
+#define VM_OP(name) case TubeOp::name:
+#define VM_DISPATCH() goto dispatch
+#endif
+
+// Finish the current instruction and move on to 'target'.
+#define VM_NEXT(target) {                                   \
+    cycles += ip->mCycles;                                  \
+    ip->mCount++;                                           \
+    if (cycles >= limit) goto hit_limit;                    \
+    ip = (target);                                          \
+    VM_DISPATCH();                                          \
+  }
+#define VM_JUMP_TARGET(pos) (((unsigned int) (pos) < num_insts) ? code + (pos) : halt)
+#define ARG0 (slots[ip->mArg[0]])
+#define ARG1 (slots[ip->mArg[1]])
+#define ARG2 (slots[ip->mArg[2]])
+
+  VM_DISPATCH();
+
+#if !TUBE_VM_THREADED
+dispatch:
+  switch (ip->mOp) {
+#endif
+
+  VM_OP(VAL_COPY)   { ARG1 = ARG0; VM_NEXT(ip + 1); }
+  VM_OP(ADD)        { ARG2 = (int) ((unsigned int) ARG0 + (unsigned int) ARG1); VM_NEXT(ip + 1); }
+  VM_OP(SUB)        { ARG2 = (int) ((unsigned int) ARG0 - (unsigned int) ARG1); VM_NEXT(ip + 1); }
+  VM_OP(MULT)       { ARG2 = (int) ((unsigned int) ARG0 * (unsigned int) ARG1); VM_NEXT(ip + 1); }
+  VM_OP(DIV) {
+    if (ARG1 == 0) out << "ERROR: div: Division by Zero\n";
+    else if (ARG1 == -1) ARG2 = (int) (0u - (unsigned int) ARG0);
+    else ARG2 = ARG0 / ARG1;
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(MOD) {
+    if (ARG1 == 0) out << "ERROR: mod: Division by Zero\n";
+    else if (ARG1 == -1) ARG2 = 0;
+    else ARG2 = ARG0 % ARG1;
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(TEST_LESS)  { ARG2 = ARG0 < ARG1;  VM_NEXT(ip + 1); }
+  VM_OP(TEST_GTR)   { ARG2 = ARG0 > ARG1;  VM_NEXT(ip + 1); }
+  VM_OP(TEST_EQU)   { ARG2 = ARG0 == ARG1; VM_NEXT(ip + 1); }
+  VM_OP(TEST_NEQU)  { ARG2 = ARG0 != ARG1; VM_NEXT(ip + 1); }
+  VM_OP(TEST_GTE)   { ARG2 = ARG0 >= ARG1; VM_NEXT(ip + 1); }
+  VM_OP(TEST_LTE)   { ARG2 = ARG0 <= ARG1; VM_NEXT(ip + 1); }
+  VM_OP(JUMP)       { VM_NEXT(VM_JUMP_TARGET(ARG0)); }
+  VM_OP(JUMP_IF_0)  { VM_NEXT((ARG0 == 0) ? VM_JUMP_TARGET(ARG1) : ip + 1); }
+  VM_OP(JUMP_IF_N0) { VM_NEXT((ARG0 != 0) ? VM_JUMP_TARGET(ARG1) : ip + 1); }
+  VM_OP(NOP)        { VM_NEXT(ip + 1); }
+  VM_OP(RANDOM) {
+    if (ARG0 <= 0) out << "ERROR: random: must have a positive upper limit\n";
+    else ARG1 = mRandom.Next() % ARG0;
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(OUT_INT) {
+    out << ARG0;
+    if (out.GetSize() > (1 << 16)) out.WriteTo(os);
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(OUT_FLOAT) {
+    float value;
+    memcpy(&value, &ARG0, sizeof(value));
+    char text[32];
+    snprintf(text, sizeof(text), "%g", value);
+    out << text;
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(OUT_CHAR) {
+    out << (char) ARG0;
+    if (out.GetSize() > (1 << 16)) out.WriteTo(os);
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(LOAD) {
+    address = ARG0;
+    if (address >= MEMORY_SIZE) goto bad_address;
+    ARG1 = memory[address];
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(STORE) {
+    address = ARG1;
+    if (address >= MEMORY_SIZE) goto bad_address;
+    memory[address] = ARG0;
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(MEM_COPY) {
+    address = ARG0;
+    if (address >= MEMORY_SIZE) goto bad_address;
+    int value = memory[address];
+    address = ARG1;
+    if (address >= MEMORY_SIZE) goto bad_address;
+    memory[address] = value;
+    VM_NEXT(ip + 1);
+  }
+  VM_OP(DEBUG_STATUS) { VM_NEXT(ip + 1); }
+  VM_OP(HALT)       { goto done; }
+
+#if !TUBE_VM_THREADED
+  }
+#endif
+
+hit_limit:
+  out << "Reached execution count limit of " << (int) limit << ".  Halting.\n";
+  status = RUN_LIMIT;
+  goto done;
+
+bad_address:
+  if ((int) address < 0) out << "ERROR: Cannot index into a negative memory position\n";
+  else out << "ERROR: Limit of " << (int) MEMORY_SIZE << " memory positions available.\n";
+  status = RUN_ERROR;
+
+done:
+  out.WriteTo(os);
+  mCycles = cycles;
+  for (unsigned int id = 0; id < num_insts; id++) mNumExecuted += code[id].mCount;
+  return status;
+
+#undef VM_OP
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_JUMP_TARGET
+#undef ARG0
+#undef ARG1
+#undef ARG2
+}
+
+void CTubeVM::PrintProfile(std::ostream & os) const
+{
+  CEmitter out;
+  out << "# line      count     cycles  instruction\n";
+  for (int id = 0; id < GetNumInsts(); id++) {
+    const CTubeInst & inst = mCode[id];
+    if (inst.mCount == 0) continue;
+    char text[64];
+    snprintf(text, sizeof(text), "%6d %10ld %10ld  ", inst.mLineNum, inst.mCount,
+             GetInstCycles(id));
+    out << text << mText[id] << '\n';
+  }
+  out.WriteTo(os);
+}
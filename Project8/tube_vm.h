@@ -0,0 +1,111 @@
+#ifndef TUBE_VM_H
+#define TUBE_VM_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CTubeVM runs TubeCode assembly (the .tca files tube8 produces) in-process, with the same
+//  results and the same cycle counts as Test_Suite/tubecode.
+//
+//  Load() decodes the assembly once into a flat array of CTubeInst: labels are resolved to
+//  instruction indices, and every argument becomes an index into a single value file that
+//  holds the registers followed by the program's constants, so no handler ever looks at what
+//  kind of operand it has.
+//  Run() then dispatches through that array with computed goto (direct threading) when the
+//  compiler supports it, and through a switch otherwise.
+//
+//  Machine model (matching the reference):
+//    * 8 registers, regA - regH, which start at -1; 65536 memory positions, which start at 0.
+//    * load, store and mem_copy cost 100 cycles; nop and debug_status cost 0; the rest cost 1.
+//    * A jump to a position outside of the program ends it.
+//    * random draws from the same generator as an unseeded glibc rand().
+//    * With a cycle limit, execution halts as soon as the cycles used reach it.
+//
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "tube_random.h"
+
+namespace TubeOp {
+  enum TubeOpNames {
+    VAL_COPY=0, ADD, SUB, MULT, DIV, MOD,
+    TEST_LESS, TEST_GTR, TEST_EQU, TEST_NEQU, TEST_GTE, TEST_LTE,
+    JUMP, JUMP_IF_0, JUMP_IF_N0,
+    NOP, RANDOM, OUT_INT, OUT_FLOAT, OUT_CHAR,
+    LOAD, STORE, MEM_COPY, DEBUG_STATUS,
+    HALT,           // Not an instruction; marks the end of the program.
+    NUM_OPS
+  };
+
+  // ARG_VALUE can be a number, char, label or register; ARG_REG must be a register.
+  enum ArgKind { ARG_NONE=0, ARG_VALUE, ARG_REG };
+
+  struct Info {
+    const char * name;
+    int num_args;
+    ArgKind args[3];
+    int cycles;
+  };
+
+  const Info & GetInfo(int op);
+  int FromString(const std::string & name);   // NUM_OPS if there is no such instruction.
+};
+
+// One decoded instruction.  Each argument is a slot in the VM's value file, which holds the
+// registers followed by every constant the program uses.
+struct CTubeInst {
+  const void * mHandler;     // Run()'s dispatch target for mOp (direct threading only).
+  int mArg[3];               // Value-file slot of each argument.
+  int mOp;                   // TubeOp::TubeOpNames
+  int mCycles;               // Cost of one execution.
+  int mLineNum;              // Line of the source file it came from.
+  long mCount;               // Times executed during the last Run().
+};
+
+class CTubeVM {
+public:
+  enum { NUM_REGS = 8, MEMORY_SIZE = 65536 };
+  enum RunStatus { RUN_DONE=0, RUN_LIMIT, RUN_ERROR };
+
+private:
+  std::vector<CTubeInst> mCode;        // The program, plus a HALT at the end.
+  std::vector<std::string> mText;      // Source text of each instruction (for profiles).
+  std::vector<int> mSlots;             // Value file: NUM_REGS registers, then constants.
+  std::vector<int> mMemory;
+  long mCycles;
+  long mNumExecuted;
+  std::string mError;
+
+  CTubeRandom mRandom;
+
+  bool LoadError(int line_num, const std::string & msg);
+
+public:
+  CTubeVM() : mCycles(0), mNumExecuted(0) { ; }
+  ~CTubeVM() { ; }
+
+  // Decode a whole program; on failure returns false and GetError() says why.
+  bool Load(const std::string & text);
+  bool LoadFile(const std::string & filename);
+
+  // Execute from the first instruction, writing the program's output to 'out'.  A limit
+  // of 0 means run until the program ends.
+  RunStatus Run(std::ostream & out, long cycle_limit = 0);
+
+  const std::string & GetError() const { return mError; }
+  long GetCycles() const { return mCycles; }
+  long GetNumExecuted() const { return mNumExecuted; }
+
+  // Static information about the loaded program, and per-instruction profile of the last run.
+  int GetNumInsts() const { return (int) mCode.size() - 1; }
+  const CTubeInst & GetInst(int id) const { return mCode[id]; }
+  const std::string & GetText(int id) const { return mText[id]; }
+  long GetInstCycles(int id) const { return mCode[id].mCount * mCode[id].mCycles; }
+
+  // Write a per-instruction profile (count, cycles, source) of the last run.
+  void PrintProfile(std::ostream & out) const;
+};
+
+#endif
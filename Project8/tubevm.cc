@@ -0,0 +1,73 @@
+// Standalone TubeCode runner built on CTubeVM: "make tubevm; ./tubevm [flags] [filename]"
+//
+// Takes the same flags as Test_Suite/tubecode and prints the same output, so it can be used
+// in its place (eg, "./tubevm -c -t 75000 out.tca").  -p additionally writes how many times
+// each line ran, and the cycles it used, to profile.dat.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "tube_vm.h"
+
+int main(int argc, char * argv[])
+{
+  bool count_cycles = false;
+  bool profile = false;
+  long limit = 0;
+  std::string filename = "";
+
+  for (int arg_id = 1; arg_id < argc; arg_id++) {
+    std::string cur_arg(argv[arg_id]);
+    if (cur_arg == "-h") {
+      std::cout << "Tube Code Assembly (in-project VM)" << std::endl
+                << "Format: " << argv[0] << " [flags] [filename]" << std::endl
+                << std::endl
+                << "Flags:" << std::endl
+                << "  -c  :  Count CPU cycles" << std::endl
+                << "  -h  :  Help (this information)" << std::endl
+                << "  -p  :  Profile.  Write the count and cycles of each line executed to profile.dat" << std::endl
+                << "  -t  [timeout] :  Set a max number of cycles executed before halting" << std::endl;
+      exit(0);
+    }
+    if (cur_arg == "-c") { count_cycles = true; continue; }
+    if (cur_arg == "-p") { profile = true; continue; }
+    if (cur_arg == "-t") {
+      if (++arg_id == argc) {
+        std::cerr << "ERROR: -t needs a cycle limit." << std::endl;
+        exit(1);
+      }
+      limit = atol(argv[arg_id]);
+      continue;
+    }
+    if (filename != "") {
+      std::cerr << "ERROR: Unknown argument '" << cur_arg << "'." << std::endl;
+      exit(1);
+    }
+    filename = cur_arg;
+  }
+
+  if (filename == "") {
+    std::cout << "Format: " << argv[0] << "[flags] [filename]" << std::endl
+              << "Type '" << argv[0] << " -h' for help." << std::endl;
+    exit(1);
+  }
+
+  CTubeVM vm;
+  if (!vm.LoadFile(filename)) {
+    std::cout << vm.GetError() << std::endl;
+    exit(1);
+  }
+
+  CTubeVM::RunStatus status = vm.Run(std::cout, limit);
+  if (status == CTubeVM::RUN_ERROR) exit(1);
+  if (count_cycles) {
+    std::cout << "[[ Total CPU cycles used: " << vm.GetCycles() << " ]]" << std::endl;
+  }
+  if (profile) {
+    std::ofstream ofs("profile.dat");
+    vm.PrintProfile(ofs);
+  }
+  return 0;
+}
@@ -0,0 +1,195 @@
+#include "value_number.h"
+#include "cfg.h"
+
+#include <algorithm>
+
+/******************************************
+ * BEGIN CLocalValueNumbering
+ *****************************************/
+
+int CLocalValueNumbering::NewValue()
+{
+  mConstOf.push_back(ICOperand());
+  mHolder.push_back(-1);
+  return mHolder.size() - 1;
+}
+
+// The value number of an input argument (constants and scalars only).
+int CLocalValueNumbering::ValueOf(const ICOperand & arg)
+{
+  if (arg.IsScalar()) {
+    int & value = mVarValue[arg.GetID()];
+    if (value == -1) {
+      value = NewValue();
+      mHolder[value] = arg.GetID();
+    }
+    return value;
+  }
+
+  std::pair<int, int> key(arg.GetKind(), arg.GetValue());
+  std::map<std::pair<int, int>, int>::iterator it = mConstValue.find(key);
+  if (it != mConstValue.end()) return it->second;
+  int value = NewValue();
+  mConstOf[value] = arg;
+  mConstValue[key] = value;
+  return value;
+}
+
+// Is some scalar still holding this value?
+bool CLocalValueNumbering::HasHolder(int value) const
+{
+  return mHolder[value] != -1 && mVarValue[mHolder[value]] == value;
+}
+
+// Record that 'line' writes 'value' into scalar 'id'.  If the block wrote to the scalar before
+// without reading it since, that earlier write is dead and goes (unless it had side effects).
+void CLocalValueNumbering::SetVar(ICArray & ica, int line, int id, int value)
+{
+  int last = mUnreadDef[id];
+  if (last != -1 && !Opcode::HasSideEffects(ica.GetEntry(last)->GetOpcode())) {
+    ica.GetEntry(last)->SetDelete(true);
+    mNumChanged++;
+  }
+  mUnreadDef[id] = line;
+  mVarValue[id] = value;
+  if (!HasHolder(value)) mHolder[value] = id;
+}
+
+void CLocalValueNumbering::ProcessBlock(ICArray & ica, int first_line, int last_line)
+{
+  // Nothing is known on entry to a block.
+  mExprValue.clear();
+  mConstValue.clear();
+  mConstOf.clear();
+  mHolder.clear();
+
+  for (int line = first_line; line <= last_line; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    int op = entry->GetOpcode();
+    if (op == Opcode::NONE || entry->GetDelete()) continue;
+    int target_arg = Opcode::IsJump(op) ? CControlFlowGraph::JumpTargetArg(op) : -1;
+
+    // Rewrite each scalar read to a constant, or to the first scalar holding its value.
+    int arg_value[3] = { -1, -1, -1 };
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      const ICOperand arg = entry->GetOperand(i);
+      if (Opcode::GetArgKind(op, i) != Opcode::ARG_VALUE) continue;
+      arg_value[i] = ValueOf(arg);
+      if (!arg.IsScalar()) continue;
+      if (i != target_arg) {
+        const ICOperand & known = mConstOf[arg_value[i]];
+        if (known.IsImmediate()) entry->SetOperand(i, known);
+        else if (mHolder[arg_value[i]] != arg.GetID() && HasHolder(arg_value[i])) {
+          entry->SetOperand(i, ICOperand::Scalar(mHolder[arg_value[i]]));
+        }
+        if (entry->GetOperand(i) != arg) mNumChanged++;
+      }
+      if (entry->IsScalarArg(i)) mUnreadDef[entry->GetArgID(i)] = -1;
+    }
+
+    // Find the value number of what the line computes, if it is a pure expression.
+    CValueKey key = { op, arg_value[0], arg_value[1], 0 };
+    bool pure = false;
+    if (Opcode::IsMath(op)) {
+      pure = true;
+      if (op == Opcode::DIV || op == Opcode::MOD) {
+        const ICOperand & divisor = mConstOf[arg_value[1]];
+        pure = divisor.IsImmediate() && divisor.GetValue() != 0;
+      }
+      if (Opcode::IsCommutative(op) && key.mArg0 > key.mArg1) std::swap(key.mArg0, key.mArg1);
+    }
+    else if (op == Opcode::AR_GET_IDX) {
+      pure = true;
+      key.mArg0 = entry->GetArgID(0);
+      key.mVersion = mArrayVersion[key.mArg0];
+    }
+    else if (op == Opcode::AR_GET_SIZE) {
+      pure = true;
+      key.mArg0 = entry->GetArgID(0);
+      key.mVersion = mSizeVersion[key.mArg0];
+    }
+
+    if (op == Opcode::VAL_COPY) {
+      SetVar(ica, line, entry->GetArgID(1), arg_value[0]);
+    }
+    else if (pure) {
+      int out_arg = entry->GetNumArgs() - 1;
+      std::map<CValueKey, int>::iterator it = mExprValue.find(key);
+      int value;
+      if (it != mExprValue.end()) {
+        value = it->second;
+        if (HasHolder(value)) {
+          int holder = mHolder[value];
+          entry->SetToCopy(ICOperand::Scalar(holder));
+          mUnreadDef[holder] = -1;
+          mNumRewritten++;
+          mNumChanged++;
+        }
+      }
+      else {
+        value = NewValue();
+        mExprValue[key] = value;
+      }
+      SetVar(ica, line, entry->GetArgID(out_arg), value);
+    }
+    else {
+      // Anything else that writes a scalar (random, pop) makes a brand new value.
+      for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+        if (Opcode::IsArgWritten(op, i)) SetVar(ica, line, entry->GetArgID(i), NewValue());
+      }
+    }
+
+    // Stores and resizes make earlier reads of the array stale.
+    switch (op) {
+    case Opcode::AR_SET_IDX:
+      mArrayVersion[entry->GetArgID(0)]++;
+      break;
+    case Opcode::AR_SET_SIZE:
+    case Opcode::AR_POP:
+      mArrayVersion[entry->GetArgID(0)]++;
+      mSizeVersion[entry->GetArgID(0)]++;
+      break;
+    case Opcode::AR_COPY:
+      mArrayVersion[entry->GetArgID(1)]++;
+      mSizeVersion[entry->GetArgID(1)]++;
+      break;
+    }
+  }
+
+  // Forget the block's scalars (clearing only what it touched keeps this linear).
+  for (int line = first_line; line <= last_line; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      if (!entry->IsScalarArg(i)) continue;
+      mVarValue[entry->GetArgID(i)] = -1;
+      mUnreadDef[entry->GetArgID(i)] = -1;
+    }
+  }
+}
+
+int CLocalValueNumbering::Run(ICArray & ica)
+{
+  mNumRewritten = 0;
+  mNumChanged = 0;
+  int num_lines = ica.GetNumEntries();
+  int num_scalars = 0, num_arrays = 0;
+  for (int line = 0; line < num_lines; line++) {
+    ICEntry * entry = ica.GetEntry(line);
+    for (int i = 0; i < (int) entry->GetNumArgs(); i++) {
+      const ICOperand & arg = entry->GetOperand(i);
+      if (arg.IsScalar()) num_scalars = std::max(num_scalars, arg.GetID() + 1);
+      if (arg.IsArray()) num_arrays = std::max(num_arrays, arg.GetID() + 1);
+    }
+  }
+  mVarValue.assign(num_scalars, -1);
+  mUnreadDef.assign(num_scalars, -1);
+  mArrayVersion.assign(num_arrays, 0);
+  mSizeVersion.assign(num_arrays, 0);
+
+  CControlFlowGraph cfg;
+  cfg.Build(ica);
+  for (int b = 0; b < cfg.GetNumBlocks(); b++) {
+    ProcessBlock(ica, cfg.GetBlock(b).mFirstLine, cfg.GetBlock(b).mLastLine);
+  }
+  return mNumChanged;
+}
@@ -0,0 +1,76 @@
+#ifndef VALUE_NUMBER_H
+#define VALUE_NUMBER_H
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  CLocalValueNumbering finds computations that are repeated inside a basic block of an ICArray
+//  and replaces the repeats with a copy of the first result.
+//
+//  Walking each block from the top, every value gets a number: each constant, each scalar read
+//  before it is written, and each (opcode, input numbers) tuple computed in the block.  Inputs
+//  of add, mult, test_equ and test_nequ are put in a fixed order first, so "a + b" and "b + a"
+//  get the same number.  If a line computes a tuple that already has a number, and a scalar
+//  still holds that value, the line becomes "val_copy <that scalar> <output>".
+//
+//  Along the way every read of a scalar is rewritten to the constant, or to the first scalar,
+//  known to hold the same value, and a write that is overwritten later in the block without
+//  being read in between is deleted, so the copies this leaves behind die and OptimizeIC can
+//  sweep them out.
+//
+//  Array reads are numbered with the array's current version: ar_set_idx, ar_set_size, ar_copy
+//  and ar_pop give the array they change a new version, so a load is only reused while nothing
+//  could have stored into the array in between (ar_get_size only cares about size changes).
+//  Instructions with side effects (random, pop, output) always produce new values, and div and
+//  mod are only reused with a nonzero constant divisor, so no runtime error message is lost.
+//
+
+#include <map>
+#include <vector>
+
+#include "ic.h"
+
+class CLocalValueNumbering {
+private:
+  // An expression: opcode plus the value numbers of its inputs, and for array reads the
+  // array ID and its version.
+  struct CValueKey {
+    int mOp;
+    int mArg0;
+    int mArg1;
+    int mVersion;
+
+    bool operator<(const CValueKey & other) const {
+      if (mOp != other.mOp) return mOp < other.mOp;
+      if (mArg0 != other.mArg0) return mArg0 < other.mArg0;
+      if (mArg1 != other.mArg1) return mArg1 < other.mArg1;
+      return mVersion < other.mVersion;
+    }
+  };
+
+  std::map<CValueKey, int> mExprValue;         // Expression -> value number.
+  std::map<std::pair<int, int>, int> mConstValue;  // (Operand kind, value) -> value number.
+  std::vector<ICOperand> mConstOf;             // Value number -> constant (NONE if not one).
+  std::vector<int> mHolder;                    // Value number -> first scalar holding it.
+  std::vector<int> mVarValue;                  // Scalar ID -> value number (-1 unknown).
+  std::vector<int> mUnreadDef;                 // Scalar ID -> line of a write not yet read.
+  std::vector<int> mArrayVersion;              // Array ID -> bumped on every store.
+  std::vector<int> mSizeVersion;               // Array ID -> bumped on every resize.
+  int mNumRewritten;                           // Lines turned into copies.
+  int mNumChanged;                             // Rewrites of any kind.
+
+  int NewValue();
+  int ValueOf(const ICOperand & arg);
+  bool HasHolder(int value) const;
+  void SetVar(ICArray & ica, int line, int id, int value);
+  void ProcessBlock(ICArray & ica, int first_line, int last_line);
+
+public:
+  CLocalValueNumbering() : mNumRewritten(0), mNumChanged(0) { ; }
+  ~CLocalValueNumbering() { ; }
+
+  // Number every basic block; returns how many operands and lines were rewritten.
+  int Run(ICArray & ica);
+  int GetNumRewritten() const { return mNumRewritten; }
+};
+
+#endif